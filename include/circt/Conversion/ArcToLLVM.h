@@ -13,7 +13,8 @@
 #include <memory>
 
 namespace circt {
-std::unique_ptr<OperationPass<ModuleOp>> createLowerArcToLLVMPass();
+std::unique_ptr<OperationPass<ModuleOp>>
+createLowerArcToLLVMPass(bool profile = false);
 } // namespace circt
 
 #endif // CIRCT_CONVERSION_ARCTOLLVM_H
@@ -24,12 +24,15 @@ std::unique_ptr<mlir::Pass>
 createAddTapsPass(std::optional<bool> tapPorts = {},
                   std::optional<bool> tapWires = {},
                   std::optional<bool> tapNamedValues = {});
-std::unique_ptr<mlir::Pass> createAllocateStatePass();
+std::unique_ptr<mlir::Pass>
+createAllocateStatePass(std::optional<unsigned> lanes = {},
+                        std::optional<bool> optimizeLayout = {});
 std::unique_ptr<mlir::Pass> createArcCanonicalizerPass();
 std::unique_ptr<mlir::Pass> createDedupPass();
 std::unique_ptr<mlir::Pass> createGroupResetsAndEnablesPass();
 std::unique_ptr<mlir::Pass>
-createInferMemoriesPass(std::optional<bool> tapPorts = {});
+createInferMemoriesPass(std::optional<bool> tapPorts = {},
+                        std::optional<uint64_t> sparseThreshold = {});
 std::unique_ptr<mlir::Pass> createInferStatePropertiesPass();
 std::unique_ptr<mlir::Pass> createInlineArcsPass();
 std::unique_ptr<mlir::Pass> createInlineModulesPass();
@@ -38,10 +41,14 @@ std::unique_ptr<mlir::Pass> createLatencyRetimingPass();
 std::unique_ptr<mlir::Pass> createLegalizeStateUpdatePass();
 std::unique_ptr<mlir::Pass> createLowerClocksToFuncsPass();
 std::unique_ptr<mlir::Pass> createLowerLUTPass();
-std::unique_ptr<mlir::Pass> createLowerStatePass();
+std::unique_ptr<mlir::Pass>
+createLowerStatePass(std::optional<bool> activityTracking = {},
+                     std::optional<bool> activityCounters = {});
 std::unique_ptr<mlir::Pass> createMakeTablesPass();
 std::unique_ptr<mlir::Pass> createMuxToControlFlowPass();
 std::unique_ptr<mlir::Pass>
+createPartitionClockTreesPass(std::optional<unsigned> numTasks = {});
+std::unique_ptr<mlir::Pass>
 createPrintStateInfoPass(llvm::StringRef stateFile = "");
 std::unique_ptr<mlir::Pass> createSimplifyVariadicOpsPass();
 std::unique_ptr<mlir::Pass> createSplitLoopsPass();
@@ -0,0 +1,85 @@
+//===- ModelInfo.h - Information about Arc models -------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Defines and computes information about Arc models, such as the layout of
+// their state storage.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CIRCT_DIALECT_ARC_MODELINFO_H
+#define CIRCT_DIALECT_ARC_MODELINFO_H
+
+#include "circt/Dialect/Arc/ArcOps.h"
+#include "circt/Support/LLVM.h"
+
+#include <string>
+#include <vector>
+
+namespace circt {
+namespace arc {
+
+/// Gathers information about a given Arc state.
+struct StateInfo {
+  enum Type { Input, Output, Register, Memory, Wire } type;
+  std::string name;
+  unsigned offset;
+  unsigned numBits;
+  unsigned memoryStride = 0;    // byte separation between memory words
+  unsigned memoryDepth = 0;     // number of words in a memory
+  unsigned memoryPageWords = 0; // words per page of a sparse memory
+};
+
+/// Gathers information about a profiling counter of an Arc model. Every clock
+/// and passthrough function of a model has a counter, followed by a counter for
+/// each arc it calls. A model lowered with profiling enabled holds the counters
+/// in a `<model>_profile` buffer of 64 bit words, two per counter: the number
+/// of invocations and the number of cycles spent in them.
+struct ProfileInfo {
+  enum Kind { Clock, Passthrough, Arc } kind;
+  std::string name;  // name of the called arc
+  unsigned function; // index of the function the counter belongs to
+};
+
+/// Gathers information about a given Arc model. If the model holds multiple
+/// lanes of state, the offsets of its states refer to the first lane, and the
+/// copy of a state for lane `i` follows `i` times the state's size later.
+struct ModelInfo {
+  std::string name;
+  size_t numStateBytes;
+  unsigned numLanes;
+  std::vector<StateInfo> states;
+  std::vector<ProfileInfo> profile;
+
+  ModelInfo(std::string name, size_t numStateBytes, unsigned numLanes,
+            std::vector<StateInfo> states)
+      : name(std::move(name)), numStateBytes(numStateBytes),
+        numLanes(numLanes), states(std::move(states)) {}
+};
+
+/// Collects information about states within the provided Arc model storage
+/// `storage`, assuming default `offset`, and adds it to `states`.
+LogicalResult collectStates(Value storage, unsigned offset,
+                            std::vector<StateInfo> &states);
+
+/// Collects the profiling counters of the Arc model `modelOp` and adds them to
+/// `profile`. Works both before and after the clocks of the model have been
+/// lowered to functions. If `counters` is given, it is populated with the index
+/// of the counter of each clock tree, passthrough, or function, and each call
+/// of an arc.
+void collectProfile(ModelOp modelOp, std::vector<ProfileInfo> &profile,
+                    DenseMap<Operation *, unsigned> *counters = nullptr);
+
+/// Collects information about all Arc models in the provided `module`, and
+/// adds it to `models`. The states of each model are sorted by offset.
+LogicalResult collectModels(mlir::ModuleOp module,
+                            SmallVectorImpl<ModelInfo> &models);
+
+} // namespace arc
+} // namespace circt
+
+#endif // CIRCT_DIALECT_ARC_MODELINFO_H
@@ -0,0 +1,97 @@
+//===- BinaryTrace.h - Binary simulation trace ------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the compact binary trace format of the llhd-sim tool, along
+// with its writer and a converter to VCD.
+//
+// A binary trace starts with the magic string "LLHDTRC2" and a signal table.
+// For each signal, identified by its index in the table, the table holds its
+// size in bytes and width in bits, the offset, size and width of its elements,
+// and the hierarchical paths it appears at. The table is followed by a
+// sequence of blocks, each consisting of a kind byte (raw, zlib-compressed or
+// end of trace), the uncompressed and stored sizes of the block, and its data.
+// The concatenated block data is a stream of records: time records, holding
+// the real time increment and the delta and epsilon steps of the following
+// changes, and change records, holding the signal index as a difference to the
+// previous change of the same time step followed by the raw signal value. All
+// integers are LEB128-encoded.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CIRCT_DIALECT_LLHD_SIMULATOR_BINARYTRACE_H
+#define CIRCT_DIALECT_LLHD_SIMULATOR_BINARYTRACE_H
+
+#include "State.h"
+
+#include "llvm/Support/Error.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+} // namespace llvm
+
+namespace circt {
+namespace llhd {
+namespace sim {
+
+/// Encodes signal changes into the binary trace format. Blocks of encoded
+/// changes are compressed and written to the output stream by a background
+/// thread, such that the simulation thread only pays for the encoding.
+class BinaryTraceWriter {
+public:
+  /// Write the signal table of the given state and start the writer thread.
+  BinaryTraceWriter(llvm::raw_ostream &out, const State &state);
+
+  /// Write the pending changes and the end of trace marker, and stop the writer
+  /// thread.
+  ~BinaryTraceWriter();
+
+  /// Record the current value of the given signal as changed at the given time.
+  void addChange(Time time, unsigned sigIndex, const uint8_t *value,
+                 uint64_t size);
+
+private:
+  /// Hand the current block over to the writer thread.
+  void pushBlock();
+
+  /// The main loop of the writer thread.
+  void writeBlocks();
+
+  llvm::raw_ostream &out;
+  // The block being encoded.
+  std::vector<uint8_t> block;
+  // The time of the last time record.
+  Time lastTime;
+  // The signal index of the last change record of the current time step.
+  uint64_t lastIndex = 0;
+  bool hasTime = false;
+
+  // The writer thread and the blocks waiting to be written.
+  std::thread writer;
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<std::vector<uint8_t>> pending;
+  bool done = false;
+};
+
+/// Convert a binary trace to VCD. Value changes of the delta and epsilon steps
+/// of a real time step are merged, such that only the final value of every
+/// real time step is dumped.
+llvm::Error convertBinaryTraceToVCD(llvm::StringRef trace,
+                                    llvm::raw_ostream &out);
+
+} // namespace sim
+} // namespace llhd
+} // namespace circt
+
+#endif // CIRCT_DIALECT_LLHD_SIMULATOR_BINARYTRACE_H
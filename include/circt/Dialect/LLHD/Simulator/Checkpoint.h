@@ -0,0 +1,54 @@
+//===- Checkpoint.h - Simulation state checkpoints --------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the checkpoints of the llhd-sim tool, which capture the
+// simulation state between two delta cycles such that a later run of the same
+// design can resume the simulation from there.
+//
+// A checkpoint starts with the magic string "LLHDCKP2", followed by the hash of
+// the design, the current simulation time, the value of every signal, the state
+// of every instance (the resume point, sense flags and persisted values of
+// processes, the register state of entities and the expected wakeup time), and
+// the pending slots of the event queue. The signal pointers persisted by
+// processes are written as signal index and byte offset, such that they can be
+// relocated to the signal values of the resuming run. All integers are
+// LEB128-encoded.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CIRCT_DIALECT_LLHD_SIMULATOR_CHECKPOINT_H
+#define CIRCT_DIALECT_LLHD_SIMULATOR_CHECKPOINT_H
+
+#include "State.h"
+
+#include "llvm/Support/Error.h"
+
+namespace llvm {
+class raw_ostream;
+} // namespace llvm
+
+namespace circt {
+namespace llhd {
+namespace sim {
+
+/// Write a checkpoint of the given state, simulating the design with the given
+/// hash. The state must be in between two delta cycles.
+void writeCheckpoint(const State &state, llvm::StringRef designHash,
+                     llvm::raw_ostream &out);
+
+/// Restore a checkpoint onto the given state, which must have just been
+/// initialized for the design with the given hash the checkpoint was taken
+/// from.
+llvm::Error restoreCheckpoint(State &state, llvm::StringRef checkpoint,
+                              llvm::StringRef designHash);
+
+} // namespace sim
+} // namespace llhd
+} // namespace circt
+
+#endif // CIRCT_DIALECT_LLHD_SIMULATOR_CHECKPOINT_H
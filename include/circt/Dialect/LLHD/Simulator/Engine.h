@@ -25,22 +25,52 @@ class ExecutionEngine;
 
 namespace llvm {
 class Error;
+template <class T>
+class Expected;
 class Module;
+namespace orc {
+class LLJIT;
+} // namespace orc
 } // namespace llvm
 
 namespace circt {
 namespace llhd {
 namespace sim {
 
+/// Counters gathered while simulating.
+struct EngineStatistics {
+  // The number of unit invocations.
+  uint64_t wakeups = 0;
+  // The number of process wakeups skipped because the process was not sensitive
+  // to the changed signal.
+  uint64_t suppressedWakeups = 0;
+};
+
+/// Options to compile the design to a model ahead of time, or to load such a
+/// precompiled model instead of JIT-compiling the design.
+struct ModelOptions {
+  // A hash of the design, embedded in compiled models and checked against the
+  // one of loaded models.
+  std::string designHash;
+  // If not empty, the object file the compiled model is written to.
+  std::string emitModelFile;
+  // If not empty, the object file of a precompiled model to load.
+  std::string modelFile;
+};
+
 class Engine {
 public:
   /// Initialize an LLHD simulation engine. This initializes the state, as well
-  /// as the mlir::ExecutionEngine with the given module.
+  /// as the mlir::ExecutionEngine with the given module, or loads the
+  /// precompiled model given in the model options. If numThreads is larger than
+  /// one, the units woken up in a delta cycle are evaluated by that many
+  /// threads.
   Engine(
       llvm::raw_ostream &out, ModuleOp module,
       llvm::function_ref<mlir::LogicalResult(mlir::ModuleOp)> mlirTransformer,
       llvm::function_ref<llvm::Error(llvm::Module *)> llvmTransformer,
-      std::string root, TraceMode tm, ArrayRef<StringRef> sharedLibPaths);
+      std::string root, TraceMode tm, ArrayRef<StringRef> sharedLibPaths,
+      unsigned numThreads = 1, const ModelOptions &modelOptions = {});
 
   /// Default destructor
   ~Engine();
@@ -49,6 +79,16 @@ public:
   /// n=0 and T=0 make the simulation run indefinitely.
   int simulate(int n, uint64_t maxTime);
 
+  /// Make the next simulation resume from the given checkpoint file instead of
+  /// starting from scratch.
+  void setRestoreFile(StringRef checkpointFile) {
+    restoreFile = checkpointFile.str();
+  }
+
+  /// Write a checkpoint of the state left by the last simulation to the given
+  /// file.
+  llvm::Error writeCheckpoint(StringRef checkpointFile);
+
   /// Build the instance layout of the design.
   void buildLayout(ModuleOp module);
 
@@ -64,15 +104,37 @@ public:
   /// Dump the instances each signal triggers.
   void dumpStateSignalTriggers();
 
+  /// Get the counters gathered by the last simulation.
+  const EngineStatistics &getStatistics() const { return stats; }
+
+  /// Dump the counters gathered by the last simulation.
+  void dumpStatistics();
+
 private:
   void walkEntity(EntityOp entity, Instance &child);
 
+  /// Load a precompiled model, checking that it was compiled from the design
+  /// with the given hash.
+  llvm::Error loadModel(StringRef modelFile, StringRef designHash,
+                        ArrayRef<StringRef> sharedLibPaths);
+
+  /// Look up the packed interface of a function of the compiled design.
+  llvm::Expected<void (*)(void **)> lookupPacked(StringRef name);
+
   llvm::raw_ostream &out;
   std::string root;
   std::unique_ptr<State> state;
   std::unique_ptr<mlir::ExecutionEngine> engine;
+  // The JIT linking a precompiled model, used instead of the engine.
+  std::unique_ptr<llvm::orc::LLJIT> model;
   ModuleOp module;
   TraceMode traceMode;
+  unsigned numThreads;
+  EngineStatistics stats;
+  // If not empty, the checkpoint the next simulation resumes from.
+  std::string restoreFile;
+  // The hash of the simulated design, recorded in checkpoints.
+  std::string designHash;
 };
 
 } // namespace sim
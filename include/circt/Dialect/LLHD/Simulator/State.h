@@ -15,12 +15,18 @@
 #define CIRCT_DIALECT_LLHD_SIMULATOR_STATE_H
 
 #include "llvm/ADT/APInt.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringMap.h"
 
+#include <array>
 #include <map>
+#include <optional>
 #include <queue>
 #include <regex>
+#include <thread>
 
 namespace circt {
 namespace llhd {
@@ -57,6 +63,10 @@ public:
 
   uint64_t getTime() const { return time; }
 
+  uint64_t getDelta() const { return delta; }
+
+  uint64_t getEps() const { return eps; }
+
 private:
   /// Simulation real time.
   uint64_t time;
@@ -64,6 +74,27 @@ private:
   uint64_t eps;
 };
 
+} // namespace sim
+} // namespace llhd
+} // namespace circt
+
+namespace llvm {
+template <>
+struct DenseMapInfo<circt::llhd::sim::Time> {
+  using Time = circt::llhd::sim::Time;
+  static Time getEmptyKey() { return Time(~0ULL, ~0ULL, ~0ULL); }
+  static Time getTombstoneKey() { return Time(~0ULL, ~0ULL, ~0ULL - 1); }
+  static unsigned getHashValue(const Time &t) {
+    return llvm::hash_combine(t.getTime(), t.getDelta(), t.getEps());
+  }
+  static bool isEqual(const Time &lhs, const Time &rhs) { return lhs == rhs; }
+};
+} // namespace llvm
+
+namespace circt {
+namespace llhd {
+namespace sim {
+
 /// Detail structure that can be easily accessed by the lowered code.
 struct SignalDetail {
   uint8_t *value;
@@ -116,22 +147,55 @@ public:
 
   uint64_t getSize() const { return size; }
 
+  /// Return the width of the signal in bits, or its size in bits if the width
+  /// is not known.
+  uint64_t getBitWidth() const { return bitWidth ? bitWidth : size * 8; }
+
   uint8_t *getValue() const { return value; }
 
   const std::vector<unsigned> &getTriggeredInstanceIndices() const {
     return instanceIndices;
   }
 
-  void pushInstanceIndex(unsigned i) { instanceIndices.push_back(i); }
+  /// Return the index of the signal in the sensitivity list of each triggered
+  /// instance, in the same order as getTriggeredInstanceIndices().
+  const std::vector<unsigned> &getTriggeredSenseIndices() const {
+    return senseIndices;
+  }
+
+  /// Add an instance this signal triggers, along with the signal's index in the
+  /// instance's sensitivity list.
+  void pushInstanceIndex(unsigned i, unsigned senseIndex) {
+    instanceIndices.push_back(i);
+    senseIndices.push_back(senseIndex);
+  }
 
   bool hasElement() const { return elements.size() > 0; }
 
   size_t getElementSize() const { return elements.size(); }
 
+  /// Return the offset and size of each element of the signal.
+  const std::vector<std::pair<unsigned, unsigned>> &getElements() const {
+    return elements;
+  }
+
   void pushElement(std::pair<unsigned, unsigned> val) {
     elements.push_back(val);
   }
 
+  /// Return the width in bits of the i-th element of the signal, or its size in
+  /// bits if the width is not known.
+  uint64_t getElementBitWidth(unsigned i) const {
+    return i < elementBitWidths.size() ? elementBitWidths[i]
+                                       : elements[i].second * 8;
+  }
+
+  /// Set the width in bits of the signal and of each of its elements.
+  void setBitWidths(uint64_t width, std::vector<unsigned> elementWidths) {
+    bitWidth = width;
+    elementBitWidths = std::move(elementWidths);
+  }
+
   /// Store JIT allocated signal pointer and size.
   void store(uint8_t *v, uint64_t s) {
     value = v;
@@ -196,9 +260,32 @@ private:
   std::string owner;
   // The list of instances this signal triggers.
   std::vector<unsigned> instanceIndices;
+  // The index of the signal in the sensitivity list of each triggered instance.
+  std::vector<unsigned> senseIndices;
   uint64_t size;
   uint8_t *value;
   std::vector<std::pair<unsigned, unsigned>> elements;
+  // The width in bits of the signal and of its elements, as given by the type
+  // of the signal.
+  uint64_t bitWidth = 0;
+  std::vector<unsigned> elementBitWidths;
+};
+
+/// A buffered drive of a signal. Drives of up to 64 bits, which are the vast
+/// majority, are stored inline in a machine word, while wider drives are stored
+/// in an APInt.
+struct Drive {
+  /// Return true if the drive is stored inline.
+  bool isWord() const { return width <= 64; }
+
+  // The bit offset of the drive into the signal.
+  unsigned bitOffset = 0;
+  // The number of driven bits.
+  unsigned width = 0;
+  // The driven value, if the drive is stored inline.
+  uint64_t word = 0;
+  // The driven value, if the drive is wider than 64 bits.
+  llvm::APInt wide;
 };
 
 /// The simulator's internal representation of one queue slot.
@@ -213,36 +300,48 @@ struct Slot {
   bool operator>(const Slot &rhs) const;
 
   /// Insert a change.
-  void insertChange(int index, int bitOffset, uint8_t *bytes, unsigned width);
+  void insertChange(int index, int bitOffset, const uint8_t *bytes,
+                    unsigned width);
 
   /// Insert a scheduled process wakeup.
   void insertChange(unsigned inst);
 
+  /// Apply the sorted changes in the range [begin, end), which must all target
+  /// the given signal, in order. Signals of up to 64 bits are merged in a
+  /// machine word without going through an APInt. Return true if the value of
+  /// the signal changed.
+  bool applyChanges(Signal &signal, size_t begin, size_t end) const;
+
   // A map from signal indexes to change buffers. Makes it easy to sort the
   // changes such that we can process one signal at a time.
   llvm::SmallVector<std::pair<unsigned, unsigned>, 32> changes;
   // Buffers for the signal changes.
-  llvm::SmallVector<std::pair<unsigned, llvm::APInt>, 32> buffers;
+  llvm::SmallVector<Drive, 32> buffers;
   // The number of used change buffers in the slot.
   size_t changesSize = 0;
 
   // Processes with scheduled wakeup.
   llvm::SmallVector<unsigned, 4> scheduled;
   Time time;
-  bool unused = false;
 };
 
-/// This is equivalent to and std::priorityQueue<Slot> ordered using the greater
-/// operator, which adds an insertion method to add changes to a slot.
-class UpdateQueue : public llvm::SmallVector<Slot, 8> {
-  unsigned topSlot = 0;
-  llvm::SmallVector<unsigned, 4> unused;
-
+/// The simulator's event queue, behaving like an std::priority_queue<Slot>
+/// ordered using the greater operator, which adds an insertion method to add
+/// changes to a slot.
+///
+/// Slots are kept in a pool and ordered by a hierarchical timing wheel over the
+/// real-time component of their timestamp. Level L of the wheel holds the
+/// slots whose real time first differs from the wheel's current time in the
+/// L-th byte, bucketed by the value of that byte. Inserting a slot is O(1), and
+/// finding the earliest slot only requires cascading the first occupied bucket
+/// of the lowest occupied level down into level 0, whose buckets each hold the
+/// slots of a single real time (differing only in delta and epsilon).
+class UpdateQueue {
 public:
   /// Check wheter a slot for the given time already exists. If that's the case,
   /// add the new change to it, else create a new slot and push it to the queue.
-  void insertOrUpdate(Time time, int index, int bitOffset, uint8_t *bytes,
-                      unsigned width);
+  void insertOrUpdate(Time time, int index, int bitOffset,
+                      const uint8_t *bytes, unsigned width);
 
   /// Check wheter a slot for the given time already exists. If that's the case,
   /// add the scheduled wakeup to it, else create a new slot and push it to the
@@ -262,7 +361,74 @@ public:
   /// unused and resets its internal structures such that they can be reused.
   void pop();
 
+  /// Return true if there are no pending slots in the queue.
+  bool empty() const { return events == 0; }
+
+  /// Return the pending slots, in time order.
+  llvm::SmallVector<const Slot *, 8> getPendingSlots() const;
+
   unsigned events = 0;
+
+private:
+  static constexpr unsigned bitsPerLevel = 8;
+  static constexpr unsigned bucketsPerLevel = 1U << bitsPerLevel;
+  static constexpr unsigned numLevels = 64 / bitsPerLevel;
+
+  /// One level of the timing wheel.
+  struct Level {
+    Level() : occupied(bucketsPerLevel) {}
+
+    std::array<llvm::SmallVector<unsigned, 2>, bucketsPerLevel> buckets;
+    // Each set bit marks a non-empty bucket.
+    llvm::BitVector occupied;
+  };
+
+  /// Insert the slot at the given pool index in the wheel, relative to the
+  /// wheel's current time.
+  void schedule(unsigned index);
+
+  /// Return the pool index of the earliest slot, cascading the wheel if
+  /// necessary.
+  unsigned getTopIndex();
+
+  // The pool of slots, reused once popped.
+  llvm::SmallVector<Slot, 8> slots;
+  // The pool indices of the unused slots.
+  llvm::SmallVector<unsigned, 4> unused;
+  // Map from the timestamp of each pending slot to its pool index.
+  llvm::DenseMap<Time, unsigned> slotMap;
+  std::array<Level, numLevels> levels;
+  // The wheel's current real time. No pending slot is ever earlier than it.
+  uint64_t now = 0;
+  // The cached pool index of the earliest slot, if already known.
+  std::optional<unsigned> topSlot;
+};
+
+/// The events emitted by one unit invocation while the wakeup set of a delta
+/// cycle is evaluated by multiple threads. They are committed to the queue in
+/// invocation order once all the units have run, which keeps the resulting
+/// queue identical to the one of a serial evaluation.
+struct StagedEvents {
+  /// A drive, with the driven value stored in the shared bytes buffer.
+  struct StagedDrive {
+    Time time;
+    int index;
+    int bitOffset;
+    unsigned width;
+    size_t byteOffset;
+  };
+
+  /// Remove all the staged events, keeping the allocated storage.
+  void clear() {
+    drives.clear();
+    bytes.clear();
+    wakeups.clear();
+  }
+
+  llvm::SmallVector<StagedDrive, 4> drives;
+  llvm::SmallVector<uint8_t, 32> bytes;
+  // Scheduled process wakeups, as absolute time and instance index.
+  llvm::SmallVector<std::pair<Time, unsigned>, 1> wakeups;
 };
 
 /// State structure for process persistence across suspension.
@@ -292,6 +458,12 @@ struct Instance {
   llvm::SmallVector<SignalDetail, 0> sensitivityList;
   ProcState *procState;
   uint8_t *entityState;
+  // The sizes in bytes of the process and entity state allocations.
+  uint64_t procStateSize = 0;
+  uint64_t entityStateSize = 0;
+  // The byte offsets in the process state allocation of the persisted signal
+  // structs, which point into signal values.
+  std::vector<uint64_t> procSignalSlots;
   Time expectedWakeup;
   // A pointer to the base unit jitted function.
   void (*unitFPtr)(void **);
@@ -317,6 +489,17 @@ struct State {
   /// Push a new scheduled wakeup event in the event queue.
   void pushQueue(Time time, unsigned inst);
 
+  /// Push a new drive event, at the given absolute time, in the event queue.
+  void pushDrive(Time time, int index, int bitOffset, const uint8_t *bytes,
+                 unsigned width);
+
+  /// Return the staging buffer the calling thread should emit its events to,
+  /// or null if the events go straight to the event queue.
+  StagedEvents *getStagedEvents();
+
+  /// Commit the given staged events to the event queue.
+  void commitStagedEvents(const StagedEvents &events);
+
   /// Find an instance in the instances list by name and return an
   /// iterator for it.
   llvm::SmallVectorTemplateCommon<Instance>::iterator
@@ -330,8 +513,9 @@ struct State {
 
   void addSignalElement(unsigned, unsigned, unsigned);
 
-  /// Add a pointer to the process persistence state to a process instance.
-  void addProcPtr(std::string name, ProcState *procStatePtr);
+  /// Add a pointer to the process persistence state, of the given size in
+  /// bytes, to a process instance.
+  void addProcPtr(std::string name, ProcState *procStatePtr, uint64_t size);
 
   /// Dump a signal to the out stream. One entry is added for every instance
   /// the signal appears in.
@@ -348,6 +532,10 @@ struct State {
   llvm::SmallVector<Instance, 0> instances;
   llvm::SmallVector<Signal, 0> signals;
   UpdateQueue queue;
+  // The threads evaluating units in parallel, along with the staging buffer of
+  // the unit each one is currently evaluating. Each entry's buffer is only ever
+  // accessed by its own thread.
+  llvm::SmallVector<std::pair<std::thread::id, StagedEvents *>, 0> staging;
 };
 
 } // namespace sim
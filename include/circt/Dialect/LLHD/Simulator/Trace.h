@@ -27,7 +27,17 @@ namespace circt {
 namespace llhd {
 namespace sim {
 
-enum class TraceMode { Full, Reduced, Merged, MergedReduce, NamedOnly, None };
+enum class TraceMode {
+  Full,
+  Reduced,
+  Merged,
+  MergedReduce,
+  NamedOnly,
+  Binary,
+  None
+};
+
+class BinaryTraceWriter;
 
 class Trace {
   llvm::raw_ostream &out;
@@ -42,6 +52,8 @@ class Trace {
   std::map<std::pair<unsigned, int>, std::string> mergedChanges;
   // Buffer of last dumped change for each signal.
   std::map<std::pair<std::string, int>, std::string> lastValue;
+  // The writer of the binary format, created on the first change.
+  std::unique_ptr<BinaryTraceWriter> binaryWriter;
 
   /// Push one change to the changes vector.
   void pushChange(unsigned inst, unsigned sigIndex, int elem);
@@ -64,6 +76,9 @@ public:
   Trace(std::unique_ptr<State> const &state, llvm::raw_ostream &out,
         TraceMode mode);
 
+  /// Finish writing the binary trace, if any.
+  ~Trace();
+
   /// Add a value change to the trace changes buffer.
   void addChange(unsigned);
 
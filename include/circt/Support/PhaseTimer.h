@@ -0,0 +1,39 @@
+//===- PhaseTimer.h - Time pass phases into statistics ----------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines a scoped timer that accumulates the time spent in a phase
+// of a pass into a pass statistic.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CIRCT_SUPPORT_PHASETIMER_H
+#define CIRCT_SUPPORT_PHASETIMER_H
+
+#include "mlir/Pass/Pass.h"
+
+#include <chrono>
+
+namespace circt {
+
+/// Measures the time spent in a phase of a pass, from its construction to its
+/// destruction, and adds it in microseconds to a statistic.
+struct PhaseTimer {
+  using Clock = std::chrono::steady_clock;
+  explicit PhaseTimer(mlir::Pass::Statistic &stat) : stat(stat) {}
+  ~PhaseTimer() {
+    stat += std::chrono::duration_cast<std::chrono::microseconds>(
+                Clock::now() - start)
+                .count();
+  }
+  mlir::Pass::Statistic &stat;
+  Clock::time_point start = Clock::now();
+};
+
+} // namespace circt
+
+#endif // CIRCT_SUPPORT_PHASETIMER_H
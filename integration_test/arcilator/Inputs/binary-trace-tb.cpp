@@ -0,0 +1,41 @@
+// Drives the counter model of binary-trace.mlir, traces it with `BinaryTrace`,
+// and converts binary traces into VCD with `BinaryTraceReader`.
+
+#include "model.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+
+int main(int argc, char **argv) {
+  std::string mode = argc == 3 ? argv[1] : "";
+
+  if (mode == "write") {
+    std::ofstream os(argv[2], std::ios::binary);
+    Counter model;
+    auto trace = model.trace(os);
+    for (unsigned cycle = 0; cycle < 3; ++cycle) {
+      model.view.clock = 1;
+      model.clock();
+      model.passthrough();
+      trace.writeTimestep(1);
+      model.view.clock = 0;
+      model.passthrough();
+      trace.writeTimestep(1);
+    }
+    trace.flush();
+    return 0;
+  }
+
+  if (mode == "vcd") {
+    std::ifstream is(argv[2], std::ios::binary);
+    if (!BinaryTraceReader(is).writeVCD(std::cout)) {
+      std::cout.flush();
+      std::cerr << "error: malformed trace\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  std::cerr << "usage: " << argv[0] << " write|vcd <trace>\n";
+  return 1;
+}
@@ -0,0 +1,95 @@
+// Drives the accumulator model of snapshot.mlir through a snapshot, forks that
+// diverge from it, a restore, and a round-trip of the snapshot through a file.
+
+#include "model.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+/// Run the given number of cycles, adding `step` to the sum in each of them.
+static void run(Accumulator &model, uint8_t step, unsigned cycles) {
+  model.view.step = step;
+  for (unsigned i = 0; i < cycles; ++i) {
+    model.view.clock = 1;
+    model.clock();
+    model.passthrough();
+    model.view.clock = 0;
+    model.passthrough();
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    std::cerr << "usage: " << argv[0] << " <snapshot file>\n";
+    return 1;
+  }
+
+  // Warm up the model and take a snapshot.
+  Accumulator model;
+  run(model, 1, 5);
+  std::cout << "warmup " << unsigned(model.view.sum) << "\n";
+  Snapshot snapshot = model.snapshot();
+
+  // Forks start out at the snapshot and diverge from it, and from each other,
+  // without affecting the model the snapshot was taken from.
+  auto forkA = Accumulator::fork(snapshot);
+  auto forkB = Accumulator::fork(snapshot);
+  if (!forkA || !forkB) {
+    std::cerr << "error: fork failed\n";
+    return 1;
+  }
+  std::cout << "forked " << unsigned(forkA->view.sum) << " "
+            << unsigned(forkB->view.sum) << "\n";
+  run(*forkA, 2, 3);
+  run(*forkB, 3, 3);
+  run(model, 1, 3);
+  std::cout << "diverged " << unsigned(forkA->view.sum) << " "
+            << unsigned(forkB->view.sum) << " " << unsigned(model.view.sum)
+            << "\n";
+
+  // Restoring rewinds the model to the snapshot, which the forks did not
+  // modify.
+  if (!model.restore(snapshot)) {
+    std::cerr << "error: restore failed\n";
+    return 1;
+  }
+  std::cout << "restored " << unsigned(model.view.sum) << "\n";
+  run(model, 1, 1);
+  std::cout << "resumed " << unsigned(model.view.sum) << "\n";
+
+  // Snapshots of a model with a different layout are rejected.
+  Other other;
+  std::cout << "other restore " << other.restore(snapshot) << " fork "
+            << (Other::fork(snapshot) != nullptr) << "\n";
+
+  // Round-trip the snapshot through a file.
+  {
+    std::ofstream os(argv[1], std::ios::binary);
+    snapshot.write(os);
+  }
+  Snapshot readBack;
+  {
+    std::ifstream is(argv[1], std::ios::binary);
+    if (!Snapshot::read(is, readBack)) {
+      std::cerr << "error: reading the snapshot failed\n";
+      return 1;
+    }
+  }
+  auto forkC = Accumulator::fork(readBack);
+  if (!forkC) {
+    std::cerr << "error: fork of the read snapshot failed\n";
+    return 1;
+  }
+  std::cout << "read " << unsigned(forkC->view.sum) << "\n";
+  run(*forkC, 4, 1);
+  std::cout << "read resumed " << unsigned(forkC->view.sum) << "\n";
+
+  // A truncated snapshot is rejected.
+  std::ostringstream os;
+  snapshot.write(os);
+  std::istringstream truncated(os.str().substr(0, os.str().size() - 1));
+  Snapshot invalid;
+  std::cout << "truncated " << Snapshot::read(truncated, invalid) << "\n";
+  return 0;
+}
@@ -0,0 +1,40 @@
+// REQUIRES: clang, python
+// RUN: rm -rf %t && mkdir %t
+// RUN: arcilator %s --state-file=%t/model.json -o %t/model.ll
+// RUN: %PYTHON% %CIRCT_TOOLS%/arcilator-header-cpp.py %t/model.json > %t/model.h
+// RUN: %clangxx -std=c++17 -pthread -I %t -I %CIRCT_TOOLS% %S/Inputs/binary-trace-tb.cpp %t/model.ll -o %t/tb
+// RUN: %t/tb write %t/trace.bin
+// RUN: %t/tb vcd %t/trace.bin | FileCheck %s
+
+// A trace cut off within the value of a record is malformed.
+// RUN: head -c -1 %t/trace.bin > %t/truncated.bin
+// RUN: not %t/tb vcd %t/truncated.bin 2>&1 | FileCheck %s --check-prefix=TRUNCATED
+
+// So is a trace cut off within a number: a header declaring one 8 bit signal
+// `a`, followed by the first byte of a two byte record number.
+// RUN: printf 'ARCTRACE\001\001a\010\201' > %t/partial.bin
+// RUN: not %t/tb vcd %t/partial.bin 2>&1 | FileCheck %s --check-prefix=TRUNCATED
+
+// CHECK:      $var wire 1 [[CLK:.+]] clock $end
+// CHECK-NEXT: $var wire 8 [[CNT:.+]] count $end
+// CHECK:      $dumpvars
+// CHECK-NEXT: 0[[CLK]]
+// CHECK-NEXT: b00000000 [[CNT]]
+// CHECK:      #1
+// CHECK-NEXT: 1[[CLK]]
+// CHECK-NEXT: b00000001 [[CNT]]
+// CHECK:      #2
+// CHECK-NEXT: 0[[CLK]]
+// CHECK:      #3
+// CHECK-NEXT: 1[[CLK]]
+// CHECK-NEXT: b00000010 [[CNT]]
+// CHECK:      #6
+
+// TRUNCATED: error: malformed trace
+
+hw.module @Counter(%clock: i1) -> (count: i8) {
+  %c1_i8 = hw.constant 1 : i8
+  %0 = comb.add %count, %c1_i8 : i8
+  %count = seq.compreg %0, %clock : i8
+  hw.output %count : i8
+}
@@ -0,0 +1,16 @@
+// REQUIRES: clang, python
+// RUN: rm -rf %t && mkdir %t
+// RUN: arcilator %s --lanes=4 --state-file=%t/model.json -o %t/model.ll
+// RUN: %PYTHON% %CIRCT_TOOLS%/arcilator-header-cpp.py %t/model.json > %t/model.h
+// RUN: %clangxx -std=c++17 -pthread -I %t -I %CIRCT_TOOLS% %S/Inputs/lanes-tb.cpp %t/model.ll -o %t/tb
+// RUN: %t/tb | FileCheck %s
+
+// CHECK:      all 3 6 9 12
+// CHECK-NEXT: odd 3 10 9 20
+// CHECK-NEXT: steps 13 10 39 20
+
+hw.module @Accumulator(%clock: i1, %step: i8) -> (sum: i8) {
+  %0 = comb.add %sum, %step : i8
+  %sum = seq.compreg %0, %clock : i8
+  hw.output %sum : i8
+}
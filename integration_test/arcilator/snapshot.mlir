@@ -0,0 +1,30 @@
+// REQUIRES: clang, python
+// RUN: rm -rf %t && mkdir %t
+// RUN: arcilator %s --state-file=%t/model.json -o %t/model.ll
+// RUN: %PYTHON% %CIRCT_TOOLS%/arcilator-header-cpp.py %t/model.json > %t/model.h
+// RUN: %clangxx -std=c++17 -pthread -I %t -I %CIRCT_TOOLS% %S/Inputs/snapshot-tb.cpp %t/model.ll -o %t/tb
+// RUN: %t/tb %t/snapshot.bin | FileCheck %s
+
+// CHECK:      warmup 5
+// CHECK-NEXT: forked 5 5
+// CHECK-NEXT: diverged 11 14 8
+// CHECK-NEXT: restored 5
+// CHECK-NEXT: resumed 6
+// CHECK-NEXT: other restore 0 fork 0
+// CHECK-NEXT: read 5
+// CHECK-NEXT: read resumed 9
+// CHECK-NEXT: truncated 0
+
+hw.module @Accumulator(%clock: i1, %step: i8) -> (sum: i8) {
+  %0 = comb.add %sum, %step : i8
+  %sum = seq.compreg %0, %clock : i8
+  hw.output %sum : i8
+}
+
+// A model with a different layout, which must reject snapshots of the
+// accumulator.
+hw.module @Other(%clock: i1, %step: i16) -> (sum: i16) {
+  %0 = comb.add %sum, %step : i16
+  %sum = seq.compreg %0, %clock : i16
+  hw.output %sum : i16
+}
@@ -80,7 +80,8 @@ tool_dirs = [
 ]
 tools = [
     'circt-opt', 'circt-translate', 'firtool', 'circt-rtl-sim.py',
-    'esi-cosim-runner.py', 'equiv-rtl.sh', 'handshake-runner', 'hlstool'
+    'esi-cosim-runner.py', 'equiv-rtl.sh', 'handshake-runner', 'hlstool',
+    'arcilator'
 ]
 
 # Enable python if its path was configured
@@ -190,6 +191,15 @@ if config.clang_tidy_path != "":
   tools.append('clang-tidy')
   config.available_features.add('clang-tidy')
 
+# Enable tests that compile arcilator models into C++ programs if clang is
+# around, since the models are emitted as LLVM IR.
+clangxx = shutil.which('clang++', path=config.llvm_tools_dir) or shutil.which(
+    'clang++')
+if clangxx:
+  config.available_features.add('clang')
+  config.substitutions.append(('%clangxx', clangxx))
+  config.substitutions.append(('%CIRCT_TOOLS%', config.circt_tools_dir))
+
 # Enable systemc if it has been detected.
 if config.have_systemc != "":
   config.available_features.add('systemc')
@@ -11,6 +11,7 @@
 #include "circt/Conversion/CombToLLVM.h"
 #include "circt/Conversion/HWToLLVM.h"
 #include "circt/Dialect/Arc/ArcOps.h"
+#include "circt/Dialect/Arc/ModelInfo.h"
 #include "circt/Dialect/Comb/CombOps.h"
 #include "circt/Support/Namespace.h"
 #include "mlir/Conversion/ArithToLLVM/ArithToLLVM.h"
@@ -19,6 +20,7 @@
 #include "mlir/Conversion/LLVMCommon/ConversionTarget.h"
 #include "mlir/Conversion/LLVMCommon/TypeConverter.h"
 #include "mlir/Conversion/SCFToControlFlow/SCFToControlFlow.h"
+#include "mlir/Dialect/Arith/IR/Arith.h"
 #include "mlir/Dialect/Func/IR/FuncOps.h"
 #include "mlir/Dialect/LLVMIR/LLVMAttrs.h"
 #include "mlir/Dialect/LLVMIR/LLVMDialect.h"
@@ -199,6 +201,26 @@ struct StorageGetOpLowering : public OpConversionPattern<arc::StorageGetOp> {
     Value ptr = rewriter.create<LLVM::GEPOp>(op.getLoc(),
                                              adaptor.getStorage().getType(),
                                              adaptor.getStorage(), offset);
+
+    // Advance to the selected lane, skipping over the copies of the preceding
+    // lanes.
+    if (adaptor.getLane()) {
+      uint64_t laneSize = 0;
+      if (auto stateType = op.getType().dyn_cast<StateType>())
+        laneSize = (stateType.getType().getWidth() + 7) / 8;
+      else if (auto memType = op.getType().dyn_cast<MemoryType>())
+        laneSize = memType.getStorageSize();
+      Value lane = rewriter.create<arith::IndexCastOp>(
+          op.getLoc(), rewriter.getI64Type(), adaptor.getLane());
+      Value laneSizeValue = rewriter.create<LLVM::ConstantOp>(
+          op.getLoc(), rewriter.getI64Type(),
+          rewriter.getI64IntegerAttr(laneSize));
+      Value laneOffset =
+          rewriter.create<LLVM::MulOp>(op.getLoc(), lane, laneSizeValue);
+      ptr = rewriter.create<LLVM::GEPOp>(op.getLoc(), ptr.getType(), ptr,
+                                         laneOffset);
+    }
+
     auto type = typeConverter->convertType(op.getType());
     if (type != ptr.getType())
       ptr = rewriter.create<LLVM::BitcastOp>(op.getLoc(), type, ptr);
@@ -228,12 +250,54 @@ static MemoryAccess prepareMemoryAccess(Location loc, Value memory,
   return {ptr, withinBounds};
 }
 
+/// An access to a sparse memory. The word is located in the page the page table
+/// entry points to, which is null as long as nothing has been written to it.
+struct SparseMemoryAccess {
+  Value pageEntry;
+  Value page;
+  Value wordIndex;
+  Value withinBounds;
+};
+
+static SparseMemoryAccess
+prepareSparseMemoryAccess(Location loc, Value memory, Value address,
+                          MemoryType type,
+                          ConversionPatternRewriter &rewriter) {
+  // Compute the indices in an integer wide enough to hold the number of words,
+  // such that out-of-bounds addresses can be detected.
+  auto zextAddrType = rewriter.getIntegerType(
+      std::max(address.getType().cast<IntegerType>().getWidth() + 1, 64U));
+  auto constant = [&](uint64_t value) -> Value {
+    return rewriter.create<LLVM::ConstantOp>(
+        loc, zextAddrType, rewriter.getIntegerAttr(zextAddrType, value));
+  };
+  Value addr = rewriter.create<LLVM::ZExtOp>(loc, zextAddrType, address);
+  Value withinBounds = rewriter.create<LLVM::ICmpOp>(
+      loc, LLVM::ICmpPredicate::ult, addr, constant(type.getNumWords()));
+
+  // Look up the page in the page table. Out-of-bounds addresses use the first
+  // page table entry instead, such that the load stays within the table.
+  Value pageIndex = rewriter.create<LLVM::LShrOp>(
+      loc, addr, constant(llvm::Log2_32(type.getPageWords())));
+  pageIndex = rewriter.create<LLVM::SelectOp>(loc, withinBounds, pageIndex,
+                                              constant(0));
+  Value wordIndex = rewriter.create<LLVM::AndOp>(
+      loc, addr, constant(type.getPageWords() - 1));
+  Value pageEntry = rewriter.create<LLVM::GEPOp>(loc, memory.getType(), memory,
+                                                 ValueRange{pageIndex});
+  Value page = rewriter.create<LLVM::LoadOp>(loc, pageEntry);
+  return {pageEntry, page, wordIndex, withinBounds};
+}
+
 struct MemoryReadOpLowering : public OpConversionPattern<arc::MemoryReadOp> {
   using OpConversionPattern::OpConversionPattern;
   LogicalResult
   matchAndRewrite(arc::MemoryReadOp op, OpAdaptor adaptor,
                   ConversionPatternRewriter &rewriter) const final {
     auto type = typeConverter->convertType(op.getType());
+    auto memType = op.getMemory().getType().cast<MemoryType>();
+    if (memType.isSparse())
+      return lowerSparse(op, adaptor, rewriter, type, memType);
     auto access = prepareMemoryAccess(
         op.getLoc(), adaptor.getMemory(), adaptor.getAddress(),
         op.getMemory().getType().cast<MemoryType>(), rewriter);
@@ -253,6 +317,37 @@ struct MemoryReadOpLowering : public OpConversionPattern<arc::MemoryReadOp> {
         });
     return success();
   }
+
+  LogicalResult lowerSparse(arc::MemoryReadOp op, OpAdaptor adaptor,
+                            ConversionPatternRewriter &rewriter, Type type,
+                            MemoryType memType) const {
+    auto loc = op.getLoc();
+    auto access = prepareSparseMemoryAccess(loc, adaptor.getMemory(),
+                                            adaptor.getAddress(), memType,
+                                            rewriter);
+
+    // Pages that have not been written yet read as zero.
+    Value null = rewriter.create<LLVM::NullOp>(loc, access.page.getType());
+    Value allocated = rewriter.create<LLVM::ICmpOp>(
+        loc, LLVM::ICmpPredicate::ne, access.page, null);
+    Value cond =
+        rewriter.create<LLVM::AndOp>(loc, access.withinBounds, allocated);
+    auto ptrType = LLVM::LLVMPointerType::get(memType.getWordType());
+    rewriter.replaceOpWithNewOp<scf::IfOp>(
+        op, cond,
+        [&](auto &builder, auto loc) {
+          Value ptr = builder.template create<LLVM::GEPOp>(
+              loc, ptrType, access.page, ValueRange{access.wordIndex});
+          Value loadOp = builder.template create<LLVM::LoadOp>(loc, ptr);
+          builder.template create<scf::YieldOp>(loc, loadOp);
+        },
+        [&](auto &builder, auto loc) {
+          Value zeroValue = builder.template create<LLVM::ConstantOp>(
+              loc, type, builder.getI64IntegerAttr(0));
+          builder.template create<scf::YieldOp>(loc, zeroValue);
+        });
+    return success();
+  }
 };
 
 struct MemoryWriteOpLowering : public OpConversionPattern<arc::MemoryWriteOp> {
@@ -260,6 +355,9 @@ struct MemoryWriteOpLowering : public OpConversionPattern<arc::MemoryWriteOp> {
   LogicalResult
   matchAndRewrite(arc::MemoryWriteOp op, OpAdaptor adaptor,
                   ConversionPatternRewriter &rewriter) const final {
+    auto memType = op.getMemory().getType().cast<MemoryType>();
+    if (memType.isSparse())
+      return lowerSparse(op, adaptor, rewriter, memType);
     auto access = prepareMemoryAccess(
         op.getLoc(), adaptor.getMemory(), adaptor.getAddress(),
         op.getMemory().getType().cast<MemoryType>(), rewriter);
@@ -277,6 +375,57 @@ struct MemoryWriteOpLowering : public OpConversionPattern<arc::MemoryWriteOp> {
         });
     return success();
   }
+
+  LogicalResult lowerSparse(arc::MemoryWriteOp op, OpAdaptor adaptor,
+                            ConversionPatternRewriter &rewriter,
+                            MemoryType memType) const {
+    auto loc = op.getLoc();
+    auto access = prepareSparseMemoryAccess(loc, adaptor.getMemory(),
+                                            adaptor.getAddress(), memType,
+                                            rewriter);
+    auto enable = access.withinBounds;
+    if (adaptor.getEnable())
+      enable = rewriter.create<LLVM::AndOp>(loc, adaptor.getEnable(), enable);
+
+    // Allocate a zeroed page on the first write to any of its words, and then
+    // write the word.
+    auto pageType = access.page.getType();
+    auto i64Type = rewriter.getI64Type();
+    auto i8PtrType = LLVM::LLVMPointerType::get(rewriter.getI8Type());
+    auto ptrType = LLVM::LLVMPointerType::get(memType.getWordType());
+    Value numWords = rewriter.create<LLVM::ConstantOp>(
+        loc, i64Type, rewriter.getI64IntegerAttr(memType.getPageWords()));
+    Value stride = rewriter.create<LLVM::ConstantOp>(
+        loc, i64Type, rewriter.getI64IntegerAttr(memType.getStride()));
+    Value null = rewriter.create<LLVM::NullOp>(loc, pageType);
+    auto calloc = FlatSymbolRefAttr::get(getContext(), "calloc");
+
+    rewriter.replaceOpWithNewOp<scf::IfOp>(
+        op, enable, [&](auto &builder, auto loc) {
+          Value missing = builder.template create<LLVM::ICmpOp>(
+              loc, LLVM::ICmpPredicate::eq, access.page, null);
+          auto ifOp = builder.template create<scf::IfOp>(
+              loc, missing,
+              [&](auto &builder, auto loc) {
+                auto callOp = builder.template create<LLVM::CallOp>(
+                    loc, TypeRange{i8PtrType}, calloc,
+                    ValueRange{numWords, stride});
+                Value page = builder.template create<LLVM::BitcastOp>(
+                    loc, pageType, callOp->getResult(0));
+                builder.template create<LLVM::StoreOp>(loc, page,
+                                                       access.pageEntry);
+                builder.template create<scf::YieldOp>(loc, page);
+              },
+              [&](auto &builder, auto loc) {
+                builder.template create<scf::YieldOp>(loc, access.page);
+              });
+          Value ptr = builder.template create<LLVM::GEPOp>(
+              loc, ptrType, ifOp.getResult(0), ValueRange{access.wordIndex});
+          builder.template create<LLVM::StoreOp>(loc, adaptor.getData(), ptr);
+          builder.template create<scf::YieldOp>(loc);
+        });
+    return success();
+  }
 };
 
 /// A dummy lowering for clock gates to an AND gate.
@@ -389,8 +538,12 @@ static void populateTypeConversion(TypeConverter &typeConverter) {
     return LLVM::LLVMPointerType::get(IntegerType::get(type.getContext(), 8));
   });
   typeConverter.addConversion([&](MemoryType type) {
-    return LLVM::LLVMPointerType::get(
+    auto ptrType = LLVM::LLVMPointerType::get(
         IntegerType::get(type.getContext(), type.getStride() * 8));
+    // Sparse memories are a table of pointers to pages.
+    if (type.isSparse())
+      return LLVM::LLVMPointerType::get(ptrType);
+    return ptrType;
   });
   typeConverter.addConversion([&](StateType type) {
     return LLVM::LLVMPointerType::get(
@@ -398,6 +551,7 @@ static void populateTypeConversion(TypeConverter &typeConverter) {
   });
   typeConverter.addConversion([](hw::ArrayType type) { return type; });
   typeConverter.addConversion([](mlir::IntegerType type) { return type; });
+  typeConverter.addConversion([](mlir::IndexType type) { return type; });
 }
 
 static void populateOpConversion(RewritePatternSet &patterns,
@@ -437,12 +591,19 @@ static void populateOpConversion(RewritePatternSet &patterns,
 namespace {
 struct LowerArcToLLVMPass : public LowerArcToLLVMBase<LowerArcToLLVMPass> {
   void runOnOperation() override;
+  void insertProfiling(ModelOp modelOp);
   LogicalResult lowerToMLIR();
   LogicalResult lowerArcToLLVM();
 };
 } // namespace
 
 void LowerArcToLLVMPass::runOnOperation() {
+  // Instrument the functions and arc calls while the models still tell us
+  // which functions they consist of.
+  if (profile)
+    for (auto op : getOperation().getOps<ModelOp>())
+      insertProfiling(op);
+
   // Remove the models since we only care about the clock functions at this
   // point.
   // NOTE: In the future we may want to have an earlier pass lower the model
@@ -452,6 +613,24 @@ void LowerArcToLLVMPass::runOnOperation() {
   for (auto op : llvm::make_early_inc_range(getOperation().getOps<ModelOp>()))
     op.erase();
 
+  // Sparse memories allocate their pages on the first write.
+  auto module = getOperation();
+  auto writesSparseMemory = module.walk([](arc::MemoryWriteOp op) {
+    if (op.getMemory().getType().cast<MemoryType>().isSparse())
+      return WalkResult::interrupt();
+    return WalkResult::advance();
+  });
+  if (writesSparseMemory.wasInterrupted() &&
+      !module.lookupSymbol<LLVM::LLVMFuncOp>("calloc")) {
+    auto builder = OpBuilder::atBlockBegin(module.getBody());
+    auto i64Type = builder.getI64Type();
+    builder.create<LLVM::LLVMFuncOp>(
+        module.getLoc(), "calloc",
+        LLVM::LLVMFunctionType::get(
+            LLVM::LLVMPointerType::get(builder.getI8Type()),
+            {i64Type, i64Type}));
+  }
+
   if (failed(lowerToMLIR()))
     return signalPassFailure();
 
@@ -459,6 +638,90 @@ void LowerArcToLLVMPass::runOnOperation() {
     return signalPassFailure();
 }
 
+/// Count the invocations of the clock and passthrough functions of a model and
+/// the arcs they call, and the number of cycles spent in them. The counters are
+/// stored in a `<model>_profile` global, in the order determined by
+/// `collectProfile`.
+void LowerArcToLLVMPass::insertProfiling(ModelOp modelOp) {
+  std::vector<ProfileInfo> infos;
+  DenseMap<Operation *, unsigned> counters;
+  collectProfile(modelOp, infos, &counters);
+  if (infos.empty())
+    return;
+
+  auto module = getOperation();
+  auto moduleBuilder = OpBuilder::atBlockBegin(module.getBody());
+  auto loc = modelOp.getLoc();
+  auto i64Type = moduleBuilder.getI64Type();
+  auto i64PtrType = LLVM::LLVMPointerType::get(i64Type);
+
+  // Create the counter buffer, and declare the intrinsic reading the cycle
+  // counter if no other model has done so yet.
+  SmallString<32> bufferName(modelOp.getName());
+  bufferName += "_profile";
+  auto bufferType = LLVM::LLVMArrayType::get(i64Type, 2 * infos.size());
+  auto buffer = moduleBuilder.create<LLVM::GlobalOp>(
+      loc, bufferType, /*isConstant=*/false, LLVM::Linkage::External,
+      bufferName,
+      moduleBuilder.getZeroAttr(RankedTensorType::get(
+          {static_cast<int64_t>(2 * infos.size())}, i64Type)));
+  auto readCycles =
+      module.lookupSymbol<LLVM::LLVMFuncOp>("llvm.readcyclecounter");
+  if (!readCycles)
+    readCycles = moduleBuilder.create<LLVM::LLVMFuncOp>(
+        loc, "llvm.readcyclecounter", LLVM::LLVMFunctionType::get(i64Type, {}));
+
+  auto readCounter = [&](OpBuilder &builder, Location loc) -> Value {
+    return builder.create<LLVM::CallOp>(loc, readCycles, ValueRange{})
+        ->getResult(0);
+  };
+
+  // Add one invocation and the cycles elapsed since `start` to a counter.
+  auto updateCounter = [&](OpBuilder &builder, Location loc, unsigned counter,
+                           Value start) {
+    Value elapsed =
+        builder.create<LLVM::SubOp>(loc, readCounter(builder, loc), start);
+    Value one = builder.create<LLVM::ConstantOp>(
+        loc, i64Type, builder.getI64IntegerAttr(1));
+    Value base = builder.create<LLVM::AddressOfOp>(loc, buffer);
+    for (auto [word, amount] : {std::make_pair(2 * counter, one),
+                                std::make_pair(2 * counter + 1, elapsed)}) {
+      Value ptr = builder.create<LLVM::GEPOp>(
+          loc, i64PtrType, base,
+          ArrayRef<LLVM::GEPArg>{0, static_cast<int32_t>(word)});
+      Value sum = builder.create<LLVM::AddOp>(
+          loc, builder.create<LLVM::LoadOp>(loc, ptr), amount);
+      builder.create<LLVM::StoreOp>(loc, sum, ptr);
+    }
+  };
+
+  for (auto [op, counter] : counters) {
+    OpBuilder opBuilder(op);
+    if (isa<arc::CallOp, arc::StateOp>(op)) {
+      auto start = readCounter(opBuilder, op->getLoc());
+      opBuilder.setInsertionPointAfter(op);
+      updateCounter(opBuilder, op->getLoc(), counter, start);
+      continue;
+    }
+
+    // Time the entire function, from its entry to every return.
+    auto &body = op->getRegion(0);
+    if (body.empty())
+      continue;
+    opBuilder.setInsertionPointToStart(&body.front());
+    auto start = readCounter(opBuilder, op->getLoc());
+    for (auto &block : body) {
+      if (!block.mightHaveTerminator())
+        continue;
+      auto *terminator = block.getTerminator();
+      if (!terminator->hasTrait<OpTrait::ReturnLike>())
+        continue;
+      opBuilder.setInsertionPoint(terminator);
+      updateCounter(opBuilder, terminator->getLoc(), counter, start);
+    }
+  }
+}
+
 /// Perform the lowering to Func and SCF.
 LogicalResult LowerArcToLLVMPass::lowerToMLIR() {
   LLVM_DEBUG(llvm::dbgs() << "Lowering arcs to Func/SCF dialects\n");
@@ -499,6 +762,9 @@ LogicalResult LowerArcToLLVMPass::lowerArcToLLVM() {
   return applyFullConversion(getOperation(), target, std::move(patterns));
 }
 
-std::unique_ptr<OperationPass<ModuleOp>> circt::createLowerArcToLLVMPass() {
-  return std::make_unique<LowerArcToLLVMPass>();
+std::unique_ptr<OperationPass<ModuleOp>>
+circt::createLowerArcToLLVMPass(bool profile) {
+  auto pass = std::make_unique<LowerArcToLLVMPass>();
+  pass->profile = profile;
+  return pass;
 }
@@ -192,14 +192,19 @@ static Type unwrapLLVMPtr(Type ty) {
 
 /// Gather the types of values that are used outside of the block they're
 /// defined in. An LLVMType structure containing those types, in order of
-/// appearance, is returned.
-static Type getProcPersistenceTy(LLVM::LLVMDialect *dialect,
-                                 TypeConverter *converter, ProcOp &proc) {
+/// appearance, is returned. If sigSlots is provided, the indices of the
+/// persisted signal structs are added to it.
+static Type
+getProcPersistenceTy(LLVM::LLVMDialect *dialect, TypeConverter *converter,
+                     ProcOp &proc,
+                     SmallVectorImpl<unsigned> *sigSlots = nullptr) {
   SmallVector<Type, 3> types = SmallVector<Type, 3>();
   proc.walk([&](Operation *op) -> void {
     if (op->isUsedOutsideOfBlock(op->getBlock()) || isWaitDestArg(op)) {
       auto ty = op->getResult(0).getType();
       auto convertedTy = converter->convertType(ty);
+      if (sigSlots && ty.isa<SigType>())
+        sigSlots->push_back(types.size());
       if (ty.isa<PtrType, SigType>()) {
         // Persist the unwrapped value.
         types.push_back(unwrapLLVMPtr(convertedTy));
@@ -1044,14 +1049,23 @@ struct InstOpConversion : public ConvertToLLVMPattern {
                             "addSigStructElement", addSigStructElemFuncTy);
 
     // Get or insert allocProc library call definition.
-    auto allocProcFuncTy =
-        LLVM::LLVMFunctionType::get(voidTy, {voidPtrTy, voidPtrTy, voidPtrTy});
+    auto allocProcFuncTy = LLVM::LLVMFunctionType::get(
+        voidTy, {voidPtrTy, voidPtrTy, voidPtrTy, i64Ty});
     auto allocProcFunc = getOrInsertFunction(module, rewriter, op->getLoc(),
                                              "allocProc", allocProcFuncTy);
 
+    // Register a persisted signal struct of a process, such that the signal
+    // pointer it holds can be relocated when restoring a checkpoint.
+    // Signature: (i8* state, i8* procState, i64 offset) -> void
+    auto addProcSigSlotFuncTy =
+        LLVM::LLVMFunctionType::get(voidTy, {voidPtrTy, voidPtrTy, i64Ty});
+    auto addProcSigSlotFunc =
+        getOrInsertFunction(module, rewriter, op->getLoc(),
+                            "addProcSignalSlot", addProcSigSlotFuncTy);
+
     // Get or insert allocEntity library call definition.
-    auto allocEntityFuncTy =
-        LLVM::LLVMFunctionType::get(voidTy, {voidPtrTy, voidPtrTy, voidPtrTy});
+    auto allocEntityFuncTy = LLVM::LLVMFunctionType::get(
+        voidTy, {voidPtrTy, voidPtrTy, voidPtrTy, i64Ty});
     auto allocEntityFunc = getOrInsertFunction(
         module, rewriter, op->getLoc(), "allocEntity", allocEntityFuncTy);
 
@@ -1127,7 +1141,7 @@ struct InstOpConversion : public ConvertToLLVMPattern {
       // Add reg state pointer to global state.
       initBuilder.create<LLVM::CallOp>(
           op->getLoc(), std::nullopt, SymbolRefAttr::get(allocEntityFunc),
-          ArrayRef<Value>({initStatePtr, owner, regMall}));
+          ArrayRef<Value>({initStatePtr, owner, regMall, regSize}));
 
       // Index of the signal in the entity's signal table.
       int initCounter = 0;
@@ -1268,11 +1282,13 @@ struct InstOpConversion : public ConvertToLLVMPattern {
       // Handle process instantiation.
       auto sensesPtrTy = LLVM::LLVMPointerType::get(
           LLVM::LLVMArrayType::get(i1Ty, proc.getNumArguments()));
+      SmallVector<unsigned> sigSlots;
       auto procStatePtrTy =
           LLVM::LLVMPointerType::get(LLVM::LLVMStructType::getLiteral(
               rewriter.getContext(),
               {i32Ty, i32Ty, sensesPtrTy,
-               getProcPersistenceTy(&getDialect(), typeConverter, proc)}));
+               getProcPersistenceTy(&getDialect(), typeConverter, proc,
+                                    &sigSlots)}));
 
       auto zeroC = initBuilder.create<LLVM::ConstantOp>(
           op->getLoc(), i32Ty, rewriter.getI32IntegerAttr(0));
@@ -1345,10 +1361,30 @@ struct InstOpConversion : public ConvertToLLVMPattern {
       initBuilder.create<LLVM::StoreOp>(op->getLoc(), sensesBC,
                                         procStateSensesPtr);
 
-      std::array<Value, 3> allocProcArgs({initStatePtr, owner, procStateMall});
+      std::array<Value, 4> allocProcArgs(
+          {initStatePtr, owner, procStateMall, procStateSize});
       initBuilder.create<LLVM::CallOp>(op->getLoc(), std::nullopt,
                                        SymbolRefAttr::get(allocProcFunc),
                                        allocProcArgs);
+
+      // Register the offsets of the persisted signal structs.
+      auto sigPtrTy = LLVM::LLVMPointerType::get(getLLVMSigType(&getDialect()));
+      auto threeC = initBuilder.create<LLVM::ConstantOp>(
+          op->getLoc(), i32Ty, rewriter.getI32IntegerAttr(3));
+      for (auto slot : sigSlots) {
+        auto slotC = initBuilder.create<LLVM::ConstantOp>(
+            op->getLoc(), i32Ty, rewriter.getI32IntegerAttr(slot));
+        auto slotGep = initBuilder.create<LLVM::GEPOp>(
+            op->getLoc(), sigPtrTy, procStateNullPtr,
+            ArrayRef<Value>({zeroC, threeC, slotC}));
+        auto slotOffset =
+            initBuilder.create<LLVM::PtrToIntOp>(op->getLoc(), i64Ty, slotGep);
+        std::array<Value, 3> addSlotArgs(
+            {initStatePtr, procStateMall, slotOffset});
+        initBuilder.create<LLVM::CallOp>(
+            op->getLoc(), std::nullopt, SymbolRefAttr::get(addProcSigSlotFunc),
+            addSlotArgs);
+      }
     }
 
     rewriter.eraseOp(op);
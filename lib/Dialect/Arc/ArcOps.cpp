@@ -244,6 +244,16 @@ void RootOutputOp::getAsmResultNames(OpAsmSetValueNameFn setNameFn) {
   setNameFn(getState(), buf);
 }
 
+//===----------------------------------------------------------------------===//
+// StorageGetOp
+//===----------------------------------------------------------------------===//
+
+LogicalResult StorageGetOp::verify() {
+  if (getLane() && isa<StorageType>(getType()))
+    return emitOpError("cannot select a lane of a storage slice");
+  return success();
+}
+
 //===----------------------------------------------------------------------===//
 // ModelOp
 //===----------------------------------------------------------------------===//
@@ -24,6 +24,27 @@ unsigned MemoryType::getStride() {
   return llvm::alignToPowerOf2(stride, llvm::bit_ceil(std::min(stride, 8U)));
 }
 
+unsigned MemoryType::getNumPages() {
+  if (!isSparse())
+    return 0;
+  return llvm::divideCeil(getNumWords(), getPageWords());
+}
+
+unsigned MemoryType::getStorageSize() {
+  if (isSparse())
+    return getNumPages() * sizeof(uint64_t);
+  return getNumWords() * getStride();
+}
+
+LogicalResult
+MemoryType::verify(llvm::function_ref<InFlightDiagnostic()> emitError,
+                   unsigned numWords, IntegerType wordType,
+                   IntegerType addressType, unsigned pageWords) {
+  if (pageWords != 0 && !llvm::isPowerOf2_32(pageWords))
+    return emitError() << "sparse memory page size must be a power of two";
+  return success();
+}
+
 void ArcDialect::registerTypes() {
   addTypes<
 #define GET_TYPEDEF_LIST
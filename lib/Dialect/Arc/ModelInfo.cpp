@@ -0,0 +1,161 @@
+//===- ModelInfo.cpp - Information about Arc models -----------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Defines and computes information about Arc models.
+//
+//===----------------------------------------------------------------------===//
+
+#include "circt/Dialect/Arc/ModelInfo.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/IR/SymbolTable.h"
+#include "llvm/ADT/StringMap.h"
+
+using namespace mlir;
+using namespace circt;
+using namespace arc;
+
+LogicalResult circt::arc::collectStates(Value storage, unsigned offset,
+                                        std::vector<StateInfo> &states) {
+  for (auto *op : storage.getUsers()) {
+    if (auto substorage = dyn_cast<AllocStorageOp>(op)) {
+      if (!substorage.getOffset().has_value()) {
+        substorage.emitOpError(
+            "without allocated offset; run state allocation first");
+        return failure();
+      }
+      if (failed(collectStates(substorage.getOutput(),
+                               *substorage.getOffset() + offset, states)))
+        return failure();
+      continue;
+    }
+    if (!isa<AllocStateOp, RootInputOp, RootOutputOp, AllocMemoryOp>(op))
+      continue;
+    auto opName = op->getAttrOfType<StringAttr>("name");
+    if (!opName || opName.getValue().empty())
+      continue;
+    auto opOffset = op->getAttrOfType<IntegerAttr>("offset");
+    if (!opOffset) {
+      op->emitOpError("without allocated offset; run state allocation first");
+      return failure();
+    }
+    if (isa<AllocStateOp, RootInputOp, RootOutputOp>(op)) {
+      auto result = op->getResult(0);
+      auto &stateInfo = states.emplace_back();
+      stateInfo.type = StateInfo::Register;
+      if (isa<RootInputOp>(op))
+        stateInfo.type = StateInfo::Input;
+      else if (isa<RootOutputOp>(op))
+        stateInfo.type = StateInfo::Output;
+      else if (auto alloc = dyn_cast<AllocStateOp>(op)) {
+        if (alloc.getTap())
+          stateInfo.type = StateInfo::Wire;
+      }
+      stateInfo.name = opName.getValue().str();
+      stateInfo.offset = opOffset.getValue().getZExtValue() + offset;
+      stateInfo.numBits =
+          result.getType().cast<StateType>().getType().getWidth();
+      continue;
+    }
+    if (auto memOp = dyn_cast<AllocMemoryOp>(op)) {
+      auto stride = op->getAttrOfType<IntegerAttr>("stride");
+      if (!stride) {
+        op->emitOpError("without allocated stride; run state allocation first");
+        return failure();
+      }
+      auto memType = memOp.getType();
+      auto intType = memType.getWordType();
+      auto &stateInfo = states.emplace_back();
+      stateInfo.type = StateInfo::Memory;
+      stateInfo.name = opName.getValue().str();
+      stateInfo.offset = opOffset.getValue().getZExtValue() + offset;
+      stateInfo.numBits = intType.getWidth();
+      stateInfo.memoryStride = stride.getValue().getZExtValue();
+      stateInfo.memoryDepth = memType.getNumWords();
+      stateInfo.memoryPageWords = memType.getPageWords();
+      continue;
+    }
+  }
+  return success();
+}
+
+void circt::arc::collectProfile(ModelOp modelOp,
+                                std::vector<ProfileInfo> &profile,
+                                DenseMap<Operation *, unsigned> *counters) {
+  // Add the counter of a function, followed by one counter for each arc the
+  // function calls.
+  unsigned numFunctions = 0;
+  auto addFunction = [&](Operation *op, ProfileInfo::Kind kind) {
+    unsigned function = numFunctions++;
+    if (counters)
+      (*counters)[op] = profile.size();
+    profile.push_back({kind, "", function});
+
+    llvm::StringMap<unsigned> arcCounters;
+    op->getRegion(0).walk([&](Operation *callOp) {
+      if (!isa<CallOp, StateOp>(callOp))
+        return;
+      auto arcName = callOp->getAttrOfType<FlatSymbolRefAttr>("arc");
+      auto [it, inserted] =
+          arcCounters.insert({arcName.getValue(), profile.size()});
+      if (inserted)
+        profile.push_back({ProfileInfo::Arc, arcName.getValue().str(),
+                           function});
+      if (counters)
+        (*counters)[callOp] = it->second;
+    });
+  };
+
+  // Visit the clocks in the same order as LowerClocksToFuncs, which leaves a
+  // call to the extracted function in place of each clock.
+  modelOp.walk<WalkOrder::PreOrder>([&](Operation *op) {
+    if (isa<ClockTreeOp>(op)) {
+      addFunction(op, ProfileInfo::Clock);
+      return WalkResult::skip();
+    }
+    if (isa<PassThroughOp>(op)) {
+      addFunction(op, ProfileInfo::Passthrough);
+      return WalkResult::skip();
+    }
+    auto callOp = dyn_cast<CallOpInterface>(op);
+    if (!callOp || isa<CallOp, StateOp>(op))
+      return WalkResult::advance();
+    auto callee = callOp.getCallableForCallee().dyn_cast<SymbolRefAttr>();
+    if (!callee)
+      return WalkResult::advance();
+    auto *funcOp = SymbolTable::lookupNearestSymbolFrom(modelOp, callee);
+    if (!funcOp || isa<DefineOp>(funcOp) || funcOp->getNumRegions() != 1)
+      return WalkResult::advance();
+    bool isPassthrough = callee.getLeafReference().getValue().startswith(
+        (modelOp.getName() + "_passthrough").str());
+    addFunction(funcOp, isPassthrough ? ProfileInfo::Passthrough
+                                      : ProfileInfo::Clock);
+    return WalkResult::advance();
+  });
+}
+
+LogicalResult circt::arc::collectModels(mlir::ModuleOp module,
+                                        SmallVectorImpl<ModelInfo> &models) {
+  for (auto modelOp : module.getOps<ModelOp>()) {
+    auto storageArg = modelOp.getBody().getArgument(0);
+    auto storageType = storageArg.getType().cast<StorageType>();
+
+    std::vector<StateInfo> states;
+    if (failed(collectStates(storageArg, 0, states)))
+      return failure();
+    llvm::sort(states, [](auto &a, auto &b) { return a.offset < b.offset; });
+
+    unsigned numLanes = 1;
+    if (auto lanes = modelOp->getAttrOfType<IntegerAttr>("lanes"))
+      numLanes = lanes.getValue().getZExtValue();
+
+    models.emplace_back(modelOp.getName().str(), storageType.getSize(),
+                        numLanes, std::move(states));
+    collectProfile(modelOp, models.back().profile);
+  }
+  return success();
+}
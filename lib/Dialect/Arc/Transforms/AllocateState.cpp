@@ -26,6 +26,12 @@ struct AllocateStatePass : public AllocateStateBase<AllocateStatePass> {
   void runOnOperation() override;
   void allocateBlock(Block *block);
   void allocateOps(Value storage, Block *block, ArrayRef<Operation *> ops);
+  void orderForLocality(SmallVectorImpl<Operation *> &ops,
+                        SmallVectorImpl<bool> &groupStarts);
+
+  /// The position of each operation in the model, used to order states by
+  /// their first access.
+  DenseMap<Operation *, unsigned> opOrder;
 };
 } // namespace
 
@@ -33,6 +39,21 @@ void AllocateStatePass::runOnOperation() {
   ModelOp modelOp = getOperation();
   LLVM_DEBUG(llvm::dbgs() << "Allocating state in `" << modelOp.getName()
                           << "`\n");
+  if (lanes == 0) {
+    modelOp.emitError("number of lanes must be at least 1");
+    return signalPassFailure();
+  }
+  if (lanes > 1)
+    modelOp->setAttr("lanes", Builder(&getContext()).getI32IntegerAttr(lanes));
+  if (optimizeLayout && !llvm::isPowerOf2_32(cacheLineSize)) {
+    modelOp.emitError("cache line size must be a power of two");
+    return signalPassFailure();
+  }
+
+  opOrder.clear();
+  if (optimizeLayout)
+    modelOp.walk<WalkOrder::PreOrder>(
+        [&](Operation *op) { opOrder.insert({op, opOrder.size()}); });
 
   // Walk the blocks from innermost to outermost and group all state allocations
   // in that block in one larger allocation.
@@ -57,24 +78,133 @@ void AllocateStatePass::allocateBlock(Block *block) {
     allocateOps(storage, block, ops);
 }
 
+/// Order the allocations of a block such that the states accessed by the same
+/// clock tree are next to each other, in the order in which the tree first
+/// accesses them. Marks the allocations that begin a new group of states,
+/// which should start on a new cache line.
+void AllocateStatePass::orderForLocality(SmallVectorImpl<Operation *> &ops,
+                                         SmallVectorImpl<bool> &groupStarts) {
+  enum Category { Ports, Shared, Local, Unused, Storage, Memory };
+  struct Key {
+    unsigned category;
+    unsigned tree = 0;
+    unsigned firstAccess = 0;
+  };
+
+  // The getters created while allocating nested blocks are not numbered, but
+  // they sit right in front of the operation they were created for.
+  auto getOrder = [&](Operation *op) {
+    for (; op; op = op->getNextNode())
+      if (auto it = opOrder.find(op); it != opOrder.end())
+        return it->second;
+    return ~0u;
+  };
+
+  SmallVector<Key> keys;
+  for (auto *op : ops) {
+    auto &key = keys.emplace_back();
+    if (isa<RootInputOp, RootOutputOp>(op)) {
+      key.category = Ports;
+      continue;
+    }
+    if (isa<AllocMemoryOp>(op)) {
+      key.category = Memory;
+      continue;
+    }
+    if (isa<AllocStorageOp>(op)) {
+      key.category = Storage;
+      continue;
+    }
+    if (op->use_empty()) {
+      key.category = Unused;
+      continue;
+    }
+
+    // Find the clock tree or passthrough block each user is nested in.
+    std::optional<Operation *> tree;
+    bool shared = false;
+    key.firstAccess = ~0u;
+    for (auto *user : op->getUsers()) {
+      key.firstAccess = std::min(key.firstAccess, getOrder(user));
+      auto *userTree = user;
+      while (userTree && !isa<ClockTreeOp, PassThroughOp>(userTree))
+        userTree = userTree->getParentOp();
+      if (!tree)
+        tree = userTree;
+      else if (*tree != userTree)
+        shared = true;
+    }
+    if (shared || !*tree) {
+      key.category = Shared;
+      continue;
+    }
+    key.category = Local;
+    key.tree = getOrder(*tree);
+  }
+
+  SmallVector<unsigned> order;
+  for (unsigned index = 0, e = ops.size(); index < e; ++index)
+    order.push_back(index);
+  llvm::stable_sort(order, [&](unsigned a, unsigned b) {
+    return std::tie(keys[a].category, keys[a].tree, keys[a].firstAccess) <
+           std::tie(keys[b].category, keys[b].tree, keys[b].firstAccess);
+  });
+
+  // Start a new group whenever the category or clock tree changes. Every
+  // nested storage gets its own group, since it holds the states of a block
+  // that are laid out in the same way.
+  SmallVector<Operation *> orderedOps;
+  groupStarts.clear();
+  for (unsigned i = 0, e = order.size(); i < e; ++i) {
+    auto &key = keys[order[i]];
+    bool start = key.category != Ports && key.category != Unused;
+    if (i > 0 && key.category != Storage) {
+      auto &prevKey = keys[order[i - 1]];
+      start &= key.category != prevKey.category || key.tree != prevKey.tree;
+    }
+    orderedOps.push_back(ops[order[i]]);
+    groupStarts.push_back(start);
+  }
+  ops.assign(orderedOps.begin(), orderedOps.end());
+}
+
 void AllocateStatePass::allocateOps(Value storage, Block *block,
                                     ArrayRef<Operation *> ops) {
   SmallVector<std::tuple<Value, Value, IntegerAttr>> gettersToCreate;
 
   // Helper function to allocate storage aligned to its own size, or 8 bytes at
-  // most.
+  // most. The layout is computed for a single lane. Scaling the offsets by the
+  // number of lanes then makes room for the copies of the other lanes after
+  // each allocation.
   unsigned currentByte = 0;
   auto allocBytes = [&](unsigned numBytes) {
     currentByte = llvm::alignToPowerOf2(currentByte,
                                         llvm::bit_ceil(std::min(numBytes, 8U)));
     unsigned offset = currentByte;
     currentByte += numBytes;
-    return offset;
+    return offset * lanes;
+  };
+
+  // Helper function to start a new group of states on a cache line.
+  auto startGroup = [&] {
+    unsigned alignedByte = llvm::alignTo(currentByte, cacheLineSize);
+    numPaddingBytes += alignedByte - currentByte;
+    currentByte = alignedByte;
+    ++numLayoutGroups;
   };
 
+  // Determine the order in which to lay out the operations.
+  SmallVector<Operation *> orderedOps(ops.begin(), ops.end());
+  SmallVector<bool> groupStarts(ops.size(), false);
+  if (optimizeLayout)
+    orderForLocality(orderedOps, groupStarts);
+
   // Allocate storage for the operations.
   OpBuilder builder(block->getParentOp());
-  for (auto *op : ops) {
+  for (unsigned i = 0, e = orderedOps.size(); i < e; ++i) {
+    auto *op = orderedOps[i];
+    if (groupStarts[i])
+      startGroup();
     if (isa<AllocStateOp, RootInputOp, RootOutputOp>(op)) {
       auto result = op->getResult(0);
       auto storage = op->getOperand(0);
@@ -89,7 +219,8 @@ void AllocateStatePass::allocateOps(Value storage, Block *block,
     if (auto memOp = dyn_cast<AllocMemoryOp>(op)) {
       auto memType = memOp.getType();
       unsigned stride = memType.getStride();
-      unsigned numBytes = memType.getNumWords() * stride;
+      // Sparse memories only store their page table in the state.
+      unsigned numBytes = memType.getStorageSize();
       auto offset = builder.getI32IntegerAttr(allocBytes(numBytes));
       op->setAttr("offset", offset);
       op->setAttr("stride", builder.getI32IntegerAttr(stride));
@@ -99,7 +230,7 @@ void AllocateStatePass::allocateOps(Value storage, Block *block,
 
     if (auto allocStorageOp = dyn_cast<AllocStorageOp>(op)) {
       auto offset = builder.getI32IntegerAttr(
-          allocBytes(allocStorageOp.getType().getSize()));
+          allocBytes(allocStorageOp.getType().getSize() / lanes));
       allocStorageOp.setOffsetAttr(offset);
       gettersToCreate.emplace_back(allocStorageOp, allocStorageOp.getInput(),
                                    offset);
@@ -109,6 +240,12 @@ void AllocateStatePass::allocateOps(Value storage, Block *block,
     assert("unsupported op for allocation" && false);
   }
 
+  LLVM_DEBUG({
+    for (auto [op, groupStart] : llvm::zip(orderedOps, groupStarts))
+      llvm::dbgs() << "  " << (groupStart ? "* " : "- ") << op->getName()
+                   << " at offset " << op->getAttr("offset") << "\n";
+  });
+
   // For every user of the alloc op, create a local `StorageGetOp`.
   SmallVector<StorageGetOp> getters;
   for (auto [result, storage, offset] : gettersToCreate) {
@@ -142,16 +279,23 @@ void AllocateStatePass::allocateOps(Value storage, Block *block,
   if (storageOwner->isProperAncestor(block->getParentOp())) {
     auto substorage = builder.create<AllocStorageOp>(
         block->getParentOp()->getLoc(),
-        StorageType::get(&getContext(), currentByte), storage);
+        StorageType::get(&getContext(), currentByte * lanes), storage);
     for (auto *op : ops)
       op->replaceUsesOfWith(storage, substorage);
     for (auto op : getters)
       op->replaceUsesOfWith(storage, substorage);
   } else {
-    storage.setType(StorageType::get(&getContext(), currentByte));
+    storage.setType(StorageType::get(&getContext(), currentByte * lanes));
   }
 }
 
-std::unique_ptr<Pass> arc::createAllocateStatePass() {
-  return std::make_unique<AllocateStatePass>();
+std::unique_ptr<Pass>
+arc::createAllocateStatePass(std::optional<unsigned> lanes,
+                             std::optional<bool> optimizeLayout) {
+  auto pass = std::make_unique<AllocateStatePass>();
+  if (lanes)
+    pass->lanes = *lanes;
+  if (optimizeLayout)
+    pass->optimizeLayout = *optimizeLayout;
+  return pass;
 }
@@ -7,7 +7,9 @@
 //===----------------------------------------------------------------------===//
 
 #include "PassDetails.h"
+#include "circt/Support/PhaseTimer.h"
 #include "mlir/IR/BuiltinAttributes.h"
+#include "mlir/IR/Threading.h"
 #include "llvm/ADT/SetVector.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/SHA256.h"
@@ -39,6 +41,7 @@ struct StructuralHasher {
 private:
   void reset() {
     currentIndex = 0;
+    currentIndexConstInvariant = 0;
     disableConstInvariant = 0;
     indices.clear();
     indicesConstInvariant.clear();
@@ -375,13 +378,21 @@ void DedupPass::runOnOperation() {
   callSites.clear();
   SymbolTableCollection symbolTable;
 
-  // Compute the structural hash for each arc definition.
+  // Compute the structural hash for each arc definition. The hash of an arc
+  // only depends on the arc itself, so the arcs can be hashed in parallel.
   SmallVector<ArcHash> arcHashes;
-  StructuralHasher hasher(&getContext());
   for (auto defineOp : getOperation().getOps<DefineOp>()) {
-    arcHashes.emplace_back(defineOp, hasher.hash(defineOp), arcHashes.size());
+    arcHashes.emplace_back(defineOp, StructuralHash{}, arcHashes.size());
     arcByName.insert({defineOp.getSymNameAttr(), defineOp});
   }
+  {
+    PhaseTimer timer(hashingTime);
+    mlir::parallelFor(&getContext(), 0, arcHashes.size(), [&](size_t idx) {
+      StructuralHasher hasher(&getContext());
+      arcHashes[idx].hash = hasher.hash(arcHashes[idx].defineOp);
+    });
+  }
+  PhaseTimer timer(mergingTime);
 
   // Collect the arc call sites.
   getOperation().walk([&](CallOpMutableInterface callOp) {
@@ -406,30 +417,53 @@ void DedupPass::runOnOperation() {
   });
 
   // Perform deduplications that do not require modification of the arc call
-  // sites. (No additional ports.)
+  // sites. (No additional ports.) Only arcs with the same hash can be merged,
+  // so the arcs in each run of identical hashes are compared in parallel to
+  // determine which arc each of them merges into. The merges themselves modify
+  // the IR and are applied afterwards.
   LLVM_DEBUG(llvm::dbgs() << "Check for exact merges (" << arcHashes.size()
                           << " arcs)\n");
-  StructuralEquivalence equiv(&getContext());
-  for (unsigned arcIdx = 0, arcEnd = arcHashes.size(); arcIdx != arcEnd;
-       ++arcIdx) {
-    auto [defineOp, hash, order] = arcHashes[arcIdx];
-    if (!defineOp)
-      continue;
-    for (unsigned otherIdx = arcIdx + 1; otherIdx != arcEnd; ++otherIdx) {
-      auto [otherDefineOp, otherHash, otherOrder] = arcHashes[otherIdx];
-      if (hash.hash != otherHash.hash)
-        break;
-      if (!otherDefineOp)
-        continue;
-      equiv.check(defineOp, otherDefineOp);
-      if (!equiv.match)
+  SmallVector<std::pair<unsigned, unsigned>> buckets;
+  for (unsigned arcIdx = 0, arcEnd = arcHashes.size(); arcIdx != arcEnd;) {
+    unsigned bucketEnd = arcIdx + 1;
+    while (bucketEnd != arcEnd &&
+           arcHashes[bucketEnd].hash.hash == arcHashes[arcIdx].hash.hash)
+      ++bucketEnd;
+    if (bucketEnd - arcIdx > 1)
+      buckets.push_back({arcIdx, bucketEnd});
+    arcIdx = bucketEnd;
+  }
+
+  constexpr unsigned notMerged = ~0U;
+  SmallVector<unsigned> mergedInto(arcHashes.size(), notMerged);
+  mlir::parallelForEach(&getContext(), buckets, [&](auto bucket) {
+    StructuralEquivalence equiv(&getContext());
+    for (unsigned arcIdx = bucket.first; arcIdx != bucket.second; ++arcIdx) {
+      if (mergedInto[arcIdx] != notMerged)
         continue;
-      LLVM_DEBUG(llvm::dbgs()
-                 << "- Merge " << defineOp.getSymNameAttr() << " <- "
-                 << otherDefineOp.getSymNameAttr() << "\n");
-      replaceArcWith(otherDefineOp, defineOp);
-      arcHashes[otherIdx].defineOp = {};
+      auto defineOp = arcHashes[arcIdx].defineOp;
+      for (unsigned otherIdx = arcIdx + 1; otherIdx != bucket.second;
+           ++otherIdx) {
+        if (mergedInto[otherIdx] != notMerged)
+          continue;
+        equiv.check(defineOp, arcHashes[otherIdx].defineOp);
+        if (equiv.match)
+          mergedInto[otherIdx] = arcIdx;
+      }
     }
+  });
+
+  for (unsigned otherIdx = 0, arcEnd = arcHashes.size(); otherIdx != arcEnd;
+       ++otherIdx) {
+    if (mergedInto[otherIdx] == notMerged)
+      continue;
+    auto defineOp = arcHashes[mergedInto[otherIdx]].defineOp;
+    auto otherDefineOp = arcHashes[otherIdx].defineOp;
+    LLVM_DEBUG(llvm::dbgs() << "- Merge " << defineOp.getSymNameAttr() << " <- "
+                            << otherDefineOp.getSymNameAttr() << "\n");
+    replaceArcWith(otherDefineOp, defineOp);
+    arcHashes[otherIdx].defineOp = {};
+    ++numExactMerges;
   }
 
   // The initial pass over the arcs has set the `defineOp` to null for every arc
@@ -457,6 +491,7 @@ void DedupPass::runOnOperation() {
     arcHashes.pop_back();
 
   // Perform deduplication of arcs that differ only in constant values.
+  StructuralEquivalence equiv(&getContext());
   LLVM_DEBUG(llvm::dbgs() << "Check for constant-agnostic merges ("
                           << arcHashes.size() << " arcs)\n");
   for (unsigned arcIdx = 0, arcEnd = arcHashes.size(); arcIdx != arcEnd;
@@ -706,6 +741,7 @@ void DedupPass::runOnOperation() {
       addCallSiteOperands(callSites[otherDefineOp], newOperands);
       replaceArcWith(otherDefineOp, defineOp);
       arcHashes[otherIdx].defineOp = {};
+      ++numConstMerges;
     }
   }
 }
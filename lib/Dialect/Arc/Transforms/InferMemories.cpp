@@ -12,6 +12,7 @@
 #include "circt/Support/Namespace.h"
 #include "circt/Support/SymCache.h"
 #include "mlir/IR/ImplicitLocOpBuilder.h"
+#include "llvm/ADT/bit.h"
 #include "llvm/Support/Debug.h"
 
 #define DEBUG_TYPE "arc-infer-memories"
@@ -27,6 +28,7 @@ struct InferMemoriesPass : public InferMemoriesBase<InferMemoriesPass> {
   SmallPtrSet<StringAttr, 2> schemaNames;
   DenseMap<StringAttr, DictionaryAttr> memoryParams;
 
+  using InferMemoriesBase::sparseThreshold;
   using InferMemoriesBase::tapPorts;
 };
 } // namespace
@@ -104,6 +106,20 @@ void InferMemoriesPass::runOnOperation() {
       return signalPassFailure();
     }
     auto memType = MemoryType::get(&getContext(), depth, wordType, addressTy);
+
+    // Large memories, and the ones explicitly marked as such, only allocate
+    // the pages of their storage that are actually written to. Memories that
+    // fit into a single page gain nothing from this.
+    uint64_t numBytes = uint64_t(depth) * memType.getStride();
+    bool sparse = instOp->hasAttr("arc.sparse") ||
+                  (sparseThreshold != 0 && numBytes >= sparseThreshold);
+    unsigned pageWords =
+        llvm::bit_floor(std::max(pageSize / memType.getStride(), 1U));
+    if (sparse && pageWords < depth) {
+      memType = MemoryType::get(&getContext(), depth, wordType, addressTy,
+                                pageWords);
+      ++numSparseMemories;
+    }
     auto memOp = builder.create<MemoryOp>(memType);
     if (!instOp.getInstanceName().empty())
       memOp->setAttr("name", instOp.getInstanceNameAttr());
@@ -318,9 +334,12 @@ void InferMemoriesPass::runOnOperation() {
 }
 
 std::unique_ptr<Pass>
-arc::createInferMemoriesPass(std::optional<bool> tapPorts) {
+arc::createInferMemoriesPass(std::optional<bool> tapPorts,
+                             std::optional<uint64_t> sparseThreshold) {
   auto pass = std::make_unique<InferMemoriesPass>();
   if (tapPorts)
     pass->tapPorts = *tapPorts;
+  if (sparseThreshold)
+    pass->sparseThreshold = *sparseThreshold;
   return pass;
 }
@@ -8,6 +8,7 @@
 
 #include "PassDetails.h"
 #include "mlir/Dialect/Func/IR/FuncOps.h"
+#include "mlir/IR/Matchers.h"
 #include "llvm/Support/Debug.h"
 
 #define DEBUG_TYPE "arc-lower-clocks-to-funcs"
@@ -35,11 +36,15 @@ struct LowerClocksToFuncsPass
                            OpBuilder &funcBuilder);
   LogicalResult isolateClock(Operation *clockOp, Value modelStorageArg,
                              Value clockStorageArg);
+  void createLaneLoop(func::FuncOp funcOp, unsigned lanes,
+                      StorageGetOp clockState);
 
   SymbolTable *symbolTable;
 
   Statistic numOpsCopied{this, "ops-copied", "Ops copied into clock trees"};
   Statistic numOpsMoved{this, "ops-moved", "Ops moved into clock trees"};
+  Statistic numLaneLoops{this, "lane-loops",
+                         "Clock functions evaluating multiple lanes"};
 };
 } // namespace
 
@@ -76,6 +81,28 @@ LogicalResult LowerClocksToFuncsPass::lowerClock(Operation *clockOp,
   LLVM_DEBUG(llvm::dbgs() << "- Lowering clock " << clockOp->getName() << "\n");
   assert((isa<ClockTreeOp, PassThroughOp>(clockOp)));
 
+  // In models with multiple lanes of state, every lane is clocked by its own
+  // copy of the clock input. Find the state the clock is read from, such that
+  // the lane loop can read it for each lane. Constant clocks are the same in
+  // all lanes.
+  auto modelOp = clockOp->getParentOfType<ModelOp>();
+  unsigned lanes = 1;
+  if (auto lanesAttr = modelOp->getAttrOfType<IntegerAttr>("lanes"))
+    lanes = lanesAttr.getValue().getZExtValue();
+  StorageGetOp clockState;
+  auto treeOp = dyn_cast<ClockTreeOp>(clockOp);
+  if (lanes > 1 && treeOp && !matchPattern(treeOp.getClock(), m_Constant())) {
+    if (auto readOp = treeOp.getClock().getDefiningOp<StateReadOp>())
+      clockState = readOp.getState().getDefiningOp<StorageGetOp>();
+    if (!clockState || clockState.getStorage() != modelStorageArg ||
+        clockState.getLane()) {
+      auto d = treeOp.emitError(
+          "clock of a model with multiple lanes must be a model input");
+      d.attachNote() << "each lane is clocked by its own copy of the input";
+      return failure();
+    }
+  }
+
   // Add a `StorageType` block argument to the clock's body block which we are
   // going to use to pass the storage pointer to the clock once it has been
   // pulled out into a separate function.
@@ -93,7 +120,7 @@ LogicalResult LowerClocksToFuncsPass::lowerClock(Operation *clockOp,
 
   // Pick a name for the clock function.
   SmallString<32> funcName;
-  funcName.append(clockOp->getParentOfType<ModelOp>().getName());
+  funcName.append(modelOp.getName());
   funcName.append(isa<PassThroughOp>(clockOp) ? "_passthrough" : "_clock");
   auto funcOp = funcBuilder.create<func::FuncOp>(
       clockOp->getLoc(), funcName,
@@ -111,9 +138,54 @@ LogicalResult LowerClocksToFuncsPass::lowerClock(Operation *clockOp,
   funcOp.getBody().takeBody(clockRegion);
   clockOp->erase();
 
+  // Models with multiple lanes of state evaluate the function for each lane.
+  if (lanes > 1)
+    createLaneLoop(funcOp, lanes, clockState);
+
   return success();
 }
 
+/// Wrap the body of a clock function in a loop over the lanes of the model
+/// state, and make all state and memory accesses refer to the current lane.
+/// The lanes of a state are adjacent in memory, which allows the loop to be
+/// vectorized. If a clock state is given, lanes whose copy of the clock is low
+/// are skipped.
+void LowerClocksToFuncsPass::createLaneLoop(func::FuncOp funcOp,
+                                            unsigned lanes,
+                                            StorageGetOp clockState) {
+  Block &body = funcOp.getBody().front();
+  auto *returnOp = body.getTerminator();
+  auto builder = OpBuilder::atBlockBegin(&body);
+  auto loc = funcOp.getLoc();
+  Value lowerBound = builder.create<arith::ConstantIndexOp>(loc, 0);
+  Value upperBound = builder.create<arith::ConstantIndexOp>(loc, lanes);
+  Value step = builder.create<arith::ConstantIndexOp>(loc, 1);
+  auto forOp = builder.create<scf::ForOp>(loc, lowerBound, upperBound, step);
+
+  Block *loopBody = forOp.getBody();
+  loopBody->getOperations().splice(loopBody->getTerminator()->getIterator(),
+                                   body.getOperations(),
+                                   std::next(forOp->getIterator()),
+                                   returnOp->getIterator());
+  if (clockState) {
+    builder.setInsertionPointToStart(loopBody);
+    auto getOp = builder.create<StorageGetOp>(
+        clockState.getLoc(), clockState.getType(), body.getArgument(0),
+        clockState.getOffsetAttr(), forOp.getInductionVar());
+    Value clock = builder.create<StateReadOp>(clockState.getLoc(), getOp);
+    auto ifOp = builder.create<scf::IfOp>(loc, clock, false);
+    ifOp.thenBlock()->getOperations().splice(
+        ifOp.thenBlock()->getTerminator()->getIterator(),
+        loopBody->getOperations(), std::next(ifOp->getIterator()),
+        loopBody->getTerminator()->getIterator());
+  }
+  forOp.walk([&](StorageGetOp getOp) {
+    if (!getOp.getType().isa<StorageType>())
+      getOp.getLaneMutable().assign(forOp.getInductionVar());
+  });
+  ++numLaneLoops;
+}
+
 /// Copy any external constants that the clock tree might be using into its
 /// body. Anything besides constants should no longer exist after a proper run
 /// of the pipeline.
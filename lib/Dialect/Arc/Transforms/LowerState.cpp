@@ -16,6 +16,7 @@
 #include "mlir/IR/IRMapping.h"
 #include "mlir/IR/ImplicitLocOpBuilder.h"
 #include "mlir/IR/SymbolTable.h"
+#include "llvm/ADT/IntEqClasses.h"
 #include "llvm/ADT/TypeSwitch.h"
 #include "llvm/Support/Debug.h"
 
@@ -26,6 +27,7 @@ using namespace arc;
 using namespace hw;
 using namespace mlir;
 using llvm::SmallDenseSet;
+using mlir::OpTrait::ConstantLike;
 
 //===----------------------------------------------------------------------===//
 // Data Structures
@@ -44,6 +46,13 @@ struct Statistics {
   Statistic matOpsCloned{parent, "mat-ops-cloned",
                          "Ops cloned during value materialization"};
   Statistic opsPruned{parent, "ops-pruned", "Ops removed as dead code"};
+  Statistic activityClusters{parent, "activity-clusters",
+                             "Clusters evaluated only on input changes"};
+  Statistic activityOps{parent, "activity-ops",
+                        "Ops guarded by activity checks"};
+  Statistic activityUntracked{
+      parent, "activity-untracked",
+      "Clusters always evaluated since they read memories"};
 };
 
 /// Lowering info associated with a single primary clock.
@@ -659,6 +668,260 @@ LogicalResult ModuleLowering::cleanup() {
   return success();
 }
 
+//===----------------------------------------------------------------------===//
+// Activity Tracking
+//===----------------------------------------------------------------------===//
+
+namespace {
+/// The number of operations nested in an operation, including the bodies of
+/// the arcs it calls, and whether any of them reads a value that is not
+/// captured by the activity checks.
+struct ActivityCost {
+  unsigned numOps = 0;
+  bool hasUntrackedInputs = false;
+};
+
+/// Guards clusters of independent logic in the clock trees and passthrough
+/// block of a model with a check whether any of the states they read changed
+/// since their last evaluation.
+struct ActivityTracking {
+  ActivityTracking(Value storageArg, SymbolTable &symtbl, Statistics &stats,
+                   unsigned minOps, bool counters)
+      : storageArg(storageArg), symtbl(symtbl), stats(stats), minOps(minOps),
+        counters(counters) {}
+
+  void trackBlock(Operation *treeOp);
+  void guardCluster(Operation *treeOp, ArrayRef<Operation *> clusterOps);
+  ActivityCost getCost(Operation *op);
+  Value allocCounter(Operation *treeOp, StringRef name);
+
+  Value storageArg;
+  SymbolTable &symtbl;
+  Statistics &stats;
+  unsigned minOps;
+  bool counters;
+  DenseMap<Operation *, ActivityCost> arcCosts;
+};
+} // namespace
+
+ActivityCost ActivityTracking::getCost(Operation *op) {
+  ActivityCost cost;
+  op->walk([&](Operation *nestedOp) {
+    ++cost.numOps;
+
+    // Memories are too large to keep a copy of, so clusters reading them are
+    // always evaluated. Clusters writing them are always evaluated too, since
+    // another clock tree may write the same address and a skipped write would
+    // then no longer be applied after it. The same goes for ops with unknown
+    // side effects.
+    if (isa<MemoryReadOp, MemoryReadPortOp, MemoryWriteOp>(nestedOp) ||
+        (!isa<StateReadOp, StateWriteOp, CallOpInterface>(nestedOp) &&
+         !nestedOp->hasTrait<OpTrait::HasRecursiveMemoryEffects>() &&
+         !isMemoryEffectFree(nestedOp)))
+      cost.hasUntrackedInputs = true;
+
+    auto callOp = dyn_cast<CallOpInterface>(nestedOp);
+    if (!callOp)
+      return;
+    auto callee = callOp.getCallableForCallee().dyn_cast<SymbolRefAttr>();
+    auto *defOp = callee ? symtbl.lookup(callee.getLeafReference()) : nullptr;
+    if (!defOp) {
+      cost.hasUntrackedInputs = true;
+      return;
+    }
+    auto it = arcCosts.find(defOp);
+    if (it == arcCosts.end()) {
+      // Guard against recursion while the callee is being visited.
+      arcCosts[defOp] = {};
+      auto calleeCost = getCost(defOp);
+      arcCosts[defOp] = calleeCost;
+      it = arcCosts.find(defOp);
+    }
+    cost.numOps += it->second.numOps;
+    cost.hasUntrackedInputs |= it->second.hasUntrackedInputs;
+  });
+  return cost;
+}
+
+/// Split the body of a clock tree or passthrough block into clusters of
+/// operations that neither use each other's values nor write the same state or
+/// memory, and guard each sufficiently large cluster with an activity check.
+void ActivityTracking::trackBlock(Operation *treeOp) {
+  Block &body = treeOp->getRegion(0).front();
+
+  // Constants and state reads are shared by many users, so they remain
+  // outside of the clusters and don't tie them together.
+  SmallVector<Operation *> ops;
+  DenseMap<Operation *, unsigned> opIndices;
+  for (auto &op : body) {
+    if (op.hasTrait<ConstantLike>() || isa<StateReadOp>(op))
+      continue;
+    opIndices[&op] = ops.size();
+    ops.push_back(&op);
+  }
+
+  llvm::IntEqClasses classes(ops.size());
+  DenseMap<Value, unsigned> writers;
+  for (unsigned index = 0, e = ops.size(); index < e; ++index) {
+    ops[index]->walk([&](Operation *nestedOp) {
+      Value written;
+      if (auto writeOp = dyn_cast<StateWriteOp>(nestedOp))
+        written = writeOp.getState();
+      else if (auto writeOp = dyn_cast<MemoryWriteOp>(nestedOp))
+        written = writeOp.getMemory();
+      if (written) {
+        auto it = writers.insert({written, index}).first;
+        classes.join(it->second, index);
+      }
+      for (auto operand : nestedOp->getOperands()) {
+        auto *defOp = operand.getDefiningOp();
+        if (!defOp)
+          continue;
+        defOp = body.findAncestorOpInBlock(*defOp);
+        if (!defOp)
+          continue;
+        auto it = opIndices.find(defOp);
+        if (it != opIndices.end())
+          classes.join(index, it->second);
+      }
+    });
+  }
+  classes.compress();
+
+  SmallVector<SmallVector<Operation *>> clusters(classes.getNumClasses());
+  for (unsigned index = 0, e = ops.size(); index < e; ++index)
+    clusters[classes[index]].push_back(ops[index]);
+  for (auto &clusterOps : clusters) {
+    ActivityCost cost;
+    for (auto *op : clusterOps) {
+      auto opCost = getCost(op);
+      cost.numOps += opCost.numOps;
+      cost.hasUntrackedInputs |= opCost.hasUntrackedInputs;
+    }
+    if (cost.numOps < minOps)
+      continue;
+    if (cost.hasUntrackedInputs) {
+      ++stats.activityUntracked;
+      continue;
+    }
+    guardCluster(treeOp, clusterOps);
+    ++stats.activityClusters;
+    stats.activityOps += cost.numOps;
+  }
+
+  // Remove the shared reads no longer used by any cluster.
+  for (auto &op : llvm::make_early_inc_range(body))
+    if (isa<StateReadOp>(op) && op.use_empty())
+      op.erase();
+}
+
+/// Allocate a named 64 bit counter for the activity statistics.
+Value ActivityTracking::allocCounter(Operation *treeOp, StringRef name) {
+  OpBuilder builder(treeOp);
+  auto counter = builder.create<AllocStateOp>(
+      treeOp->getLoc(), StateType::get(builder.getI64Type()), storageArg);
+  counter->setAttr("name", builder.getStringAttr(name));
+  return counter;
+}
+
+/// Move the operations of a cluster into an `scf.if` that only executes if one
+/// of the states read by the cluster changed since the last time it executed,
+/// or if it never executed before. The values seen by the last execution are
+/// kept in a shadow state for each of the states read.
+void ActivityTracking::guardCluster(Operation *treeOp,
+                                    ArrayRef<Operation *> clusterOps) {
+  // Collect the states read by the cluster, either within the cluster itself
+  // or through the shared reads in the enclosing block.
+  Block &body = treeOp->getRegion(0).front();
+  SetVector<Value> inputs;
+  for (auto *op : clusterOps) {
+    op->walk([&](Operation *nestedOp) {
+      if (auto readOp = dyn_cast<StateReadOp>(nestedOp))
+        inputs.insert(readOp.getState());
+      for (auto operand : nestedOp->getOperands())
+        if (auto readOp = operand.getDefiningOp<StateReadOp>())
+          if (readOp->getBlock() == &body)
+            inputs.insert(readOp.getState());
+    });
+  }
+
+  auto loc = clusterOps.back()->getLoc();
+  OpBuilder allocBuilder(treeOp);
+  ImplicitLocOpBuilder builder(loc, clusterOps.back());
+  builder.setInsertionPointAfter(clusterOps.back());
+  auto i1Type = builder.getI1Type();
+
+  // The cluster is dirty if it never ran, or if any of its inputs differ from
+  // the values it last saw.
+  auto validState = allocBuilder.create<AllocStateOp>(
+      loc, StateType::get(i1Type), storageArg);
+  Value trueValue = builder.create<hw::ConstantOp>(i1Type, 1);
+  SmallVector<Value> changes;
+  changes.push_back(builder.create<comb::XorOp>(
+      builder.create<StateReadOp>(validState), trueValue, true));
+  SmallVector<std::pair<Value, Value>> shadowUpdates;
+  DenseMap<Value, Value> inputValues;
+  for (auto input : inputs) {
+    auto shadow =
+        allocBuilder.create<AllocStateOp>(loc, input.getType(), storageArg);
+    Value current = builder.create<StateReadOp>(input);
+    Value previous = builder.create<StateReadOp>(shadow);
+    changes.push_back(builder.create<comb::ICmpOp>(comb::ICmpPredicate::ne,
+                                                   current, previous, true));
+    shadowUpdates.push_back({shadow, current});
+    inputValues[input] = current;
+  }
+  Value dirty = changes.size() == 1
+                    ? changes[0]
+                    : builder.create<comb::OrOp>(changes, true).getResult();
+
+  if (counters) {
+    auto checks = allocCounter(treeOp, "activity/checks");
+    Value one = builder.create<hw::ConstantOp>(builder.getI64Type(), 1);
+    builder.create<StateWriteOp>(
+        checks,
+        builder.create<comb::AddOp>(builder.create<StateReadOp>(checks), one,
+                                    true),
+        Value{});
+  }
+
+  auto ifOp = builder.create<scf::IfOp>(dirty, counters);
+  auto thenBuilder =
+      ImplicitLocOpBuilder::atBlockTerminator(loc, ifOp.thenBlock());
+  thenBuilder.create<StateWriteOp>(validState, trueValue, Value{});
+  for (auto [shadow, current] : shadowUpdates)
+    thenBuilder.create<StateWriteOp>(shadow, current, Value{});
+  for (auto *op : clusterOps)
+    op->moveBefore(ifOp.thenBlock()->getTerminator());
+
+  // Reads in the cluster observe the same values as the activity check, since
+  // all reads in a clock tree see the state before any of its writes.
+  for (auto *op : clusterOps) {
+    op->walk([&](Operation *nestedOp) {
+      for (auto &operand : nestedOp->getOpOperands())
+        if (auto readOp = operand.get().getDefiningOp<StateReadOp>())
+          if (auto value = inputValues.lookup(readOp.getState()))
+            operand.set(value);
+    });
+    op->walk([&](StateReadOp readOp) {
+      if (readOp.use_empty())
+        readOp.erase();
+    });
+  }
+
+  if (counters) {
+    auto skips = allocCounter(treeOp, "activity/skips");
+    auto elseBuilder =
+        ImplicitLocOpBuilder::atBlockTerminator(loc, ifOp.elseBlock());
+    Value one = elseBuilder.create<hw::ConstantOp>(builder.getI64Type(), 1);
+    elseBuilder.create<StateWriteOp>(
+        skips,
+        elseBuilder.create<comb::AddOp>(elseBuilder.create<StateReadOp>(skips),
+                                        one, true),
+        Value{});
+  }
+}
+
 //===----------------------------------------------------------------------===//
 // Pass Infrastructure
 //===----------------------------------------------------------------------===//
@@ -774,6 +1037,18 @@ LogicalResult LowerStatePass::runOnModule(HWModuleOp moduleOp,
   if (failed(lowering.cleanup()))
     return failure();
 
+  // Guard idle logic with activity checks.
+  if (activityTracking) {
+    ActivityTracking tracking(lowering.storageArg, symtbl, stats,
+                              activityMinOps, activityCounters);
+    SmallVector<Operation *> treeOps;
+    for (auto &op : *moduleOp.getBodyBlock())
+      if (isa<ClockTreeOp, PassThroughOp>(op))
+        treeOps.push_back(&op);
+    for (auto *treeOp : treeOps)
+      tracking.trackBlock(treeOp);
+  }
+
   // Replace the `HWModuleOp` with a `ModelOp`.
   moduleOp.getBodyBlock()->eraseArguments(
       [&](auto arg) { return arg != lowering.storageArg; });
@@ -786,6 +1061,13 @@ LogicalResult LowerStatePass::runOnModule(HWModuleOp moduleOp,
   return success();
 }
 
-std::unique_ptr<Pass> arc::createLowerStatePass() {
-  return std::make_unique<LowerStatePass>();
+std::unique_ptr<Pass>
+arc::createLowerStatePass(std::optional<bool> activityTracking,
+                          std::optional<bool> activityCounters) {
+  auto pass = std::make_unique<LowerStatePass>();
+  if (activityTracking)
+    pass->activityTracking = *activityTracking;
+  if (activityCounters)
+    pass->activityCounters = *activityCounters;
+  return pass;
 }
@@ -18,10 +18,6 @@ using namespace arc;
 using namespace hw;
 
 namespace {
-
-static constexpr int tableMinOpCount = 20;
-static constexpr int tableMaxSize = 32768; // bits
-
 struct MakeTablesPass : public MakeTablesBase<MakeTablesPass> {
   void runOnOperation() override;
   void runOnArc(DefineOp defineOp);
@@ -38,6 +34,21 @@ static inline uint32_t bitsGet(uint32_t x, uint32_t lb, uint32_t ub) {
   return (x >> lb) & bitsMask(ub - lb + 1);
 }
 
+/// Estimate the cost of evaluating an operation as the number of 64-bit words
+/// it operates on. Constants are materialized once and considered free.
+static unsigned getOpCost(Operation *op) {
+  if (op->hasTrait<OpTrait::ConstantLike>())
+    return 0;
+  unsigned width = 0;
+  auto addType = [&](Type type) {
+    if (auto intType = type.dyn_cast<IntegerType>())
+      width = std::max(width, intType.getWidth());
+  };
+  llvm::for_each(op->getOperandTypes(), addType);
+  llvm::for_each(op->getResultTypes(), addType);
+  return std::max<unsigned>(1, llvm::divideCeil(width, 64));
+}
+
 void MakeTablesPass::runOnOperation() {
   auto module = getOperation();
   for (auto op : module.getOps<DefineOp>())
@@ -56,11 +67,13 @@ void MakeTablesPass::runOnArc(DefineOp defineOp) {
   if (numInputBits == 0)
     return;
 
-  // Count the number of non-constant operations in the block.
+  // Estimate the cost of the logic in the block.
   unsigned numOps = 0;
-  for (auto &op : defineOp.getBodyBlock().without_terminator())
-    if (!op.hasTrait<OpTrait::ConstantLike>())
-      ++numOps;
+  unsigned logicCost = 0;
+  for (auto &op : defineOp.getBodyBlock().without_terminator()) {
+    ++numOps;
+    logicCost += getOpCost(&op);
+  }
 
   // Determine the number of output bits.
   unsigned numOutputBits = 0;
@@ -78,46 +91,49 @@ void MakeTablesPass::runOnArc(DefineOp defineOp) {
                           << "`\n");
   LLVM_DEBUG(llvm::dbgs() << "- " << numInputBits << " input bits, "
                           << numOutputBits << " output bits, " << numOps
-                          << " ops\n");
+                          << " ops of cost " << logicCost << "\n");
 
   // Check whether the table dimensions are within bounds.
   if (numInputBits >= 31) {
     LLVM_DEBUG(llvm::dbgs() << "- Skip; too many input bits\n");
     return;
   }
-  if (numOps < tableMinOpCount) {
-    LLVM_DEBUG(llvm::dbgs() << "- Skip; not enough ops\n");
+  if (logicCost < minCost) {
+    LLVM_DEBUG(llvm::dbgs() << "- Skip; logic too cheap\n");
     return;
   }
 
   unsigned numTableEntries = 1U << numInputBits;
-  if (numTableEntries > tableMaxSize / numOutputBits) {
+  if (numTableEntries > maxTableBits / numOutputBits) {
     LLVM_DEBUG(llvm::dbgs() << "- Skip; table too large\n");
     return;
   }
-  LLVM_DEBUG(llvm::dbgs() << "- Creating table of "
-                          << numTableEntries * numOutputBits << " bits\n");
+  unsigned numTableBits = numTableEntries * numOutputBits;
+  bool isInline = numTableBits <= inlineTableBits;
+
+  // A lookup concatenates the inputs into an index and either loads the entry
+  // or shifts it out of an integer, and then extracts the individual outputs.
+  unsigned numOutputs = outputOp->getNumOperands();
+  unsigned tableCost = (isInline ? 4 : 2) + (numOutputs > 1 ? numOutputs : 0);
+  if (logicCost <= tableCost) {
+    LLVM_DEBUG(llvm::dbgs() << "- Skip; table lookup not cheaper\n");
+    return;
+  }
+  LLVM_DEBUG(llvm::dbgs() << "- Creating " << (isInline ? "inline " : "")
+                          << "table of " << numTableBits << " bits\n");
 
-  // Actually build the table.
   SmallVector<Operation *, 64> tabularizedOps;
   for (auto &op : defineOp.getBodyBlock().without_terminator())
     tabularizedOps.push_back(&op);
 
-  // Concatenate the inputs into a single index value.
+  // Evaluate the arc for every input value. All outputs are packed into a
+  // single table entry, with the first output in the lowest bits.
   auto builder = ImplicitLocOpBuilder::atBlockBegin(defineOp.getLoc(),
                                                     &defineOp.getBodyBlock());
-  SmallVector<Value> inputsToConcat(defineOp.getArguments());
-  std::reverse(inputsToConcat.begin(), inputsToConcat.end());
-  auto concatInputs = inputsToConcat.size() > 1
-                          ? builder.create<comb::ConcatOp>(inputsToConcat)
-                          : inputsToConcat[0];
-
-  // Compute a lookup table for every output.
-  SmallVector<SmallVector<Attribute, 0>> tables;
+  SmallVector<APInt> entries(numTableEntries);
   DenseMap<Value, Attribute> values;
-  tables.resize(outputOp->getNumOperands());
 
-  for (int input = (1U << numInputBits) - 1; input >= 0; input--) {
+  for (unsigned input = 0; input < numTableEntries; ++input) {
     // Assign the input values.
     values.clear();
     unsigned bits = 0;
@@ -150,21 +166,68 @@ void MakeTablesPass::runOnArc(DefineOp defineOp) {
       }
     }
 
-    // Add the evaluated values to the output tables.
-    for (auto [table, outputOperand] :
-         llvm::zip(tables, outputOp->getOpOperands())) {
-      table.push_back(values[outputOperand.get()].dyn_cast<Attribute>());
+    // Pack the evaluated outputs into the table entry.
+    APInt entry(numOutputBits, 0);
+    unsigned offset = 0;
+    for (auto output : outputOp->getOperands()) {
+      auto attr = values[output].dyn_cast_or_null<IntegerAttr>();
+      if (!attr) {
+        LLVM_DEBUG(llvm::dbgs() << "- Skip; output did not fold to integer\n");
+        return;
+      }
+      entry.insertBits(attr.getValue(), offset);
+      offset += attr.getValue().getBitWidth();
     }
+    entries[input] = std::move(entry);
   }
 
-  // Create the table lookup ops.
-  for (auto [table, outputOperand] :
-       llvm::zip(tables, outputOp->getOpOperands())) {
+  // Concatenate the inputs into a single index value.
+  SmallVector<Value> inputsToConcat(defineOp.getArguments());
+  std::reverse(inputsToConcat.begin(), inputsToConcat.end());
+  auto concatInputs = inputsToConcat.size() > 1
+                          ? builder.create<comb::ConcatOp>(inputsToConcat)
+                          : inputsToConcat[0];
+
+  // Look up the table entry.
+  Value entry;
+  if (isInline) {
+    APInt tableValue(numTableBits, 0);
+    for (auto [input, inputEntry] : llvm::enumerate(entries))
+      tableValue.insertBits(inputEntry, input * numOutputBits);
+    auto table = builder.create<hw::ConstantOp>(tableValue);
+    auto zeros = builder.create<hw::ConstantOp>(
+        builder.getIntegerType(numTableBits - numInputBits), 0);
+    Value offset = builder.create<comb::ConcatOp>(zeros, concatInputs);
+    auto stride = builder.create<hw::ConstantOp>(offset.getType(),
+                                                 numOutputBits);
+    offset = builder.create<comb::MulOp>(offset, stride);
+    auto shifted = builder.create<comb::ShrUOp>(table, offset);
+    entry = builder.create<comb::ExtractOp>(shifted, 0, numOutputBits);
+    ++numInlineTables;
+  } else {
+    // Arrays list their elements starting at the highest index.
+    auto entryType = builder.getIntegerType(numOutputBits);
+    SmallVector<Attribute> table;
+    for (auto &inputEntry : llvm::reverse(entries))
+      table.push_back(builder.getIntegerAttr(entryType, inputEntry));
     auto array = builder.create<hw::AggregateConstantOp>(
-        ArrayType::get(outputOperand.get().getType(), numTableEntries),
+        ArrayType::get(entryType, numTableEntries),
         builder.getArrayAttr(table));
-    outputOperand.set(builder.create<hw::ArrayGetOp>(array, concatInputs));
+    entry = builder.create<hw::ArrayGetOp>(array, concatInputs);
+  }
+
+  // Extract the individual outputs from the entry.
+  unsigned offset = 0;
+  for (auto &outputOperand : outputOp->getOpOperands()) {
+    auto width = outputOperand.get().getType().cast<IntegerType>().getWidth();
+    Value output = entry;
+    if (width != numOutputBits)
+      output = builder.create<comb::ExtractOp>(entry, offset, width);
+    outputOperand.set(output);
+    offset += width;
   }
+  ++numTables;
+  numOpsTabulated += numOps;
 
   for (auto *op : tabularizedOps) {
     op->dropAllUses();
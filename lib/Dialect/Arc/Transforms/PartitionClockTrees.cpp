@@ -0,0 +1,215 @@
+//===- PartitionClockTrees.cpp --------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetails.h"
+#include "circt/Dialect/Arc/ArcOps.h"
+#include "mlir/IR/SymbolTable.h"
+#include "llvm/ADT/IntEqClasses.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/Support/Debug.h"
+
+#define DEBUG_TYPE "arc-partition-clock-trees"
+
+using namespace mlir;
+using namespace circt;
+using namespace arc;
+using mlir::OpTrait::ConstantLike;
+
+//===----------------------------------------------------------------------===//
+// Pass Implementation
+//===----------------------------------------------------------------------===//
+
+namespace {
+struct PartitionClockTreesPass
+    : public PartitionClockTreesBase<PartitionClockTreesPass> {
+  void runOnOperation() override;
+  void partition(ClockTreeOp treeOp);
+  unsigned getWeight(Operation *op);
+
+  SymbolTable *symbolTable;
+  DenseMap<Operation *, unsigned> calleeWeights;
+};
+} // namespace
+
+void PartitionClockTreesPass::runOnOperation() {
+  if (numTasks < 2)
+    return markAllAnalysesPreserved();
+  symbolTable = &getAnalysis<SymbolTable>();
+  calleeWeights.clear();
+
+  SmallVector<ClockTreeOp> treeOps;
+  getOperation().walk([&](ClockTreeOp treeOp) { treeOps.push_back(treeOp); });
+  for (auto treeOp : treeOps)
+    partition(treeOp);
+}
+
+/// Estimate the cost of evaluating an operation as the number of operations it
+/// contains, including the body of the arcs it calls.
+unsigned PartitionClockTreesPass::getWeight(Operation *op) {
+  unsigned weight = 0;
+  op->walk([&](Operation *nestedOp) {
+    ++weight;
+    auto callOp = dyn_cast<CallOpInterface>(nestedOp);
+    if (!callOp)
+      return;
+    auto callee = callOp.getCallableForCallee().dyn_cast<SymbolRefAttr>();
+    if (!callee)
+      return;
+    auto *defOp = symbolTable->lookup(callee.getLeafReference());
+    if (!defOp)
+      return;
+    auto it = calleeWeights.find(defOp);
+    if (it == calleeWeights.end()) {
+      // Guard against recursion while the callee is being visited.
+      calleeWeights[defOp] = 0;
+      unsigned calleeWeight = getWeight(defOp);
+      calleeWeights[defOp] = calleeWeight;
+      it = calleeWeights.find(defOp);
+    }
+    weight += it->second;
+  });
+  return weight;
+}
+
+void PartitionClockTreesPass::partition(ClockTreeOp treeOp) {
+  LLVM_DEBUG(llvm::dbgs() << "Partitioning clock tree at " << treeOp.getLoc()
+                          << "\n");
+  Block &body = treeOp.getBodyBlock();
+
+  // Number the operations in the clock tree body. Constants are duplicated into
+  // every task that uses them, so they don't tie the tasks together.
+  SmallVector<Operation *> ops;
+  DenseMap<Operation *, unsigned> opIndices;
+  for (auto &op : body) {
+    if (op.hasTrait<ConstantLike>())
+      continue;
+    opIndices[&op] = ops.size();
+    ops.push_back(&op);
+  }
+  if (ops.size() < 2)
+    return;
+
+  // Join operations that use each other's values, and collect the states and
+  // memories each operation accesses. Nested operations count as accesses of
+  // the top-level operation that contains them.
+  llvm::IntEqClasses classes(ops.size());
+  llvm::MapVector<Value, SmallVector<unsigned, 2>> accesses;
+  DenseSet<Value> writtenStates;
+  for (unsigned index = 0, e = ops.size(); index < e; ++index) {
+    ops[index]->walk([&](Operation *nestedOp) {
+      for (auto operand : nestedOp->getOperands()) {
+        if (operand.getType().isa<StateType, MemoryType>()) {
+          accesses[operand].push_back(index);
+          if (!isa<StateReadOp, MemoryReadOp>(nestedOp))
+            writtenStates.insert(operand);
+          continue;
+        }
+        auto *defOp = operand.getDefiningOp();
+        if (!defOp)
+          continue;
+        defOp = body.findAncestorOpInBlock(*defOp);
+        if (!defOp)
+          continue;
+        auto it = opIndices.find(defOp);
+        if (it != opIndices.end())
+          classes.join(index, it->second);
+      }
+    });
+  }
+
+  // Every state or memory written in the clock tree binds all of its accessors
+  // to the same task, since they rely on the order of the accesses.
+  for (auto &[state, indices] : accesses)
+    if (writtenStates.contains(state))
+      for (auto index : indices)
+        classes.join(indices.front(), index);
+  classes.compress();
+  if (classes.getNumClasses() < 2)
+    return;
+
+  // Each class is a component of the clock tree that can be evaluated
+  // independently of the others.
+  SmallVector<unsigned> componentWeights(classes.getNumClasses(), 0);
+  for (unsigned index = 0, e = ops.size(); index < e; ++index)
+    componentWeights[classes[index]] += getWeight(ops[index]);
+
+  // Distribute the components across the tasks, assigning the heaviest ones
+  // first to the task with the least amount of work.
+  unsigned tasksUsed = std::min<unsigned>(numTasks, componentWeights.size());
+  SmallVector<unsigned> taskWeights(tasksUsed, 0);
+  SmallVector<unsigned> componentTasks(componentWeights.size(), 0);
+  SmallVector<unsigned> order;
+  for (unsigned index = 0, e = componentWeights.size(); index < e; ++index)
+    order.push_back(index);
+  llvm::stable_sort(order, [&](unsigned a, unsigned b) {
+    return componentWeights[a] > componentWeights[b];
+  });
+  for (auto index : order) {
+    auto *lightest = llvm::min_element(taskWeights);
+    *lightest += componentWeights[index];
+    componentTasks[index] = lightest - taskWeights.begin();
+  }
+  LLVM_DEBUG({
+    for (unsigned task = 0; task < tasksUsed; ++task)
+      llvm::dbgs() << "- Task " << task << " has weight " << taskWeights[task]
+                   << "\n";
+  });
+
+  // Create a clock tree of the same clock for every additional task, and move
+  // the operations of its components over in their original order.
+  SmallVector<ClockTreeOp> taskOps;
+  taskOps.push_back(treeOp);
+  OpBuilder builder(treeOp);
+  builder.setInsertionPointAfter(treeOp);
+  for (unsigned task = 1; task < tasksUsed; ++task) {
+    auto taskOp = builder.create<ClockTreeOp>(treeOp.getLoc(),
+                                              treeOp.getClock());
+    taskOp.getBody().emplaceBlock();
+    builder.setInsertionPointAfter(taskOp);
+    taskOps.push_back(taskOp);
+    ++numTasksCreated;
+  }
+  for (unsigned index = 0, e = ops.size(); index < e; ++index) {
+    unsigned task = componentTasks[classes[index]];
+    if (task != 0)
+      ops[index]->moveBefore(&taskOps[task].getBodyBlock(),
+                             taskOps[task].getBodyBlock().end());
+  }
+
+  // Copy the constants used by each new task into its body.
+  for (auto taskOp : llvm::drop_begin(taskOps)) {
+    auto *taskBlock = &taskOp.getBodyBlock();
+    OpBuilder constBuilder = OpBuilder::atBlockBegin(taskBlock);
+    DenseMap<Operation *, Operation *> copiedConsts;
+    taskOp.walk([&](Operation *op) {
+      for (auto &operand : op->getOpOperands()) {
+        auto *defOp = operand.get().getDefiningOp();
+        if (!defOp || defOp->getBlock() != &body)
+          continue;
+        auto &copy = copiedConsts[defOp];
+        if (!copy)
+          copy = constBuilder.clone(*defOp);
+        operand.set(copy->getResult(
+            operand.get().cast<OpResult>().getResultNumber()));
+      }
+    });
+  }
+
+  // Remove the constants no longer used in the original tree.
+  for (auto &op : llvm::make_early_inc_range(body))
+    if (op.hasTrait<ConstantLike>() && op.use_empty())
+      op.erase();
+}
+
+std::unique_ptr<Pass>
+arc::createPartitionClockTreesPass(std::optional<unsigned> numTasks) {
+  auto pass = std::make_unique<PartitionClockTreesPass>();
+  if (numTasks)
+    pass->numTasks = *numTasks;
+  return pass;
+}
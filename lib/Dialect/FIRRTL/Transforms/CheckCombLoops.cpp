@@ -8,7 +8,10 @@
 //
 // This file implements the FIRRTL combinational cycles detection pass. The
 // algorithm handles aggregates and sub-index/field/access ops.
-// 1. Traverse each module in the Instance Graph bottom up.
+// 1. Traverse each module in the Instance Graph bottom up. Modules that do not
+//    instantiate each other are processed in parallel. The combinational
+//    paths between the ports of a module are summarized, and the summary is
+//    used at every instance of the module.
 // 2. Preprocess step: Gather all the Value which serve as the root for the
 //    DFS traversal. The input arguments and wire ops and Instance results
 //    are the roots.
@@ -33,6 +36,7 @@
 #include "circt/Dialect/FIRRTL/FIRRTLUtils.h"
 #include "circt/Dialect/FIRRTL/FIRRTLVisitors.h"
 #include "circt/Dialect/FIRRTL/Passes.h"
+#include "mlir/IR/Threading.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DepthFirstIterator.h"
 #include "llvm/ADT/PostOrderIterator.h"
@@ -47,6 +51,10 @@ using namespace firrtl;
 
 using SetOfFieldRefs = DenseSet<FieldRef>;
 
+/// The combinational paths between the ports of a module, mapping each input
+/// port field to the output port fields it reaches.
+using PortPaths = DenseMap<FieldRef, SetOfFieldRefs>;
+
 /// A value is in VisitingSet if its subtree is still being traversed. That is,
 /// all its children have not yet been visited. If any Value is visited while
 /// its still in the `VisitingSet`, that implies a back edge and a cycle.
@@ -96,8 +104,10 @@ class DiscoverLoops {
 
 public:
   DiscoverLoops(FModuleOp module, InstanceGraph &instanceGraph,
-                DenseMap<FieldRef, SetOfFieldRefs> &portPaths)
-      : module(module), instanceGraph(instanceGraph), portPaths(portPaths) {}
+                DenseMap<Operation *, PortPaths> &modulePortPaths)
+      : module(module), instanceGraph(instanceGraph),
+        modulePortPaths(modulePortPaths),
+        portPaths(modulePortPaths.find(module.getOperation())->second) {}
 
   LogicalResult processModule() {
     LLVM_DEBUG(llvm::dbgs() << "\n processing module :" << module.getName());
@@ -214,8 +224,10 @@ public:
             // If the childVal is a sub, then check if it aliases with any of
             // the predecessors (the visiting set).
             if (visiting.contains(childVal)) {
-              // Comb Cycle Detected !!
-              reportLoopFound(childVal, visiting);
+              // Comb Cycle Detected !! Remember it, such that it can be
+              // reported with `reportLoop`.
+              loopVal = childVal;
+              loopVisiting = std::move(visiting);
               return failure();
             }
           }
@@ -380,8 +392,11 @@ public:
       if (!refMod)
         return;
       FieldRef modArg(refMod.getArgument(portNum), ref.getFieldID());
-      auto pathIter = portPaths.find(modArg);
-      if (pathIter == portPaths.end())
+      auto refModPaths = modulePortPaths.find(refMod.getOperation());
+      if (refModPaths == modulePortPaths.end())
+        return;
+      auto pathIter = refModPaths->second.find(modArg);
+      if (pathIter == refModPaths->second.end())
         return;
       for (auto modOutPort : pathIter->second) {
         auto outPortNum =
@@ -410,6 +425,9 @@ public:
     }
   }
 
+  /// Report the combinational cycle found by `processModule`.
+  void reportLoop() { reportLoopFound(loopVal, loopVisiting); }
+
   void reportLoopFound(Value childVal, VisitingSet visiting) {
     // TODO: Work harder to provide best information possible to user,
     // especially across instances or when we trace through aliasing values.
@@ -545,9 +563,16 @@ public:
   DenseMap<Value, DenseSet<Value>> aliasingValuesMap;
 
   DenseMap<FieldRef, DenseSet<Value>> fieldToVals;
-  /// Comb paths that exist between module ports. This is maintained across
-  /// modules.
-  DenseMap<FieldRef, SetOfFieldRefs> &portPaths;
+  /// Comb paths that exist between the ports of every module. Only the entries
+  /// of modules instantiated by this module are read.
+  const DenseMap<Operation *, PortPaths> &modulePortPaths;
+  /// Comb paths that exist between the ports of this module.
+  PortPaths &portPaths;
+
+  /// The value closing a combinational cycle, and the values visited on the
+  /// way to it, if one was found.
+  Value loopVal;
+  VisitingSet loopVisiting;
 };
 
 /// This pass constructs a local graph for each module to detect combinational
@@ -558,18 +583,68 @@ class CheckCombLoopsPass : public CheckCombLoopsBase<CheckCombLoopsPass> {
 public:
   void runOnOperation() override {
     auto &instanceGraph = getAnalysis<InstanceGraph>();
-    DenseMap<FieldRef, SetOfFieldRefs> portPaths;
-    // Traverse modules in a post order to make sure the combinational paths
-    // between IOs of a module have been detected and recorded in `portPaths`
-    // before we handle its parent modules.
+
+    // Group the modules into levels, such that a module only instantiates
+    // modules of lower levels. Each level lists its modules in post-order.
+    SmallVector<FModuleOp> modules;
+    DenseMap<Operation *, unsigned> moduleLevels;
+    SmallVector<SmallVector<unsigned>> levels;
     for (auto *igNode : llvm::post_order<InstanceGraph *>(&instanceGraph)) {
-      if (auto module = dyn_cast<FModuleOp>(*igNode->getModule())) {
-        DiscoverLoops rdf(module, instanceGraph, portPaths);
-        if (rdf.processModule().failed()) {
-          return signalPassFailure();
+      unsigned level = 0;
+      for (auto *record : *igNode) {
+        auto *child = record->getTarget()->getModule().getOperation();
+        auto it = moduleLevels.find(child);
+        if (it != moduleLevels.end())
+          level = std::max(level, it->second + 1);
+      }
+      moduleLevels[igNode->getModule().getOperation()] = level;
+      auto module = dyn_cast<FModuleOp>(*igNode->getModule());
+      if (!module)
+        continue;
+      if (level >= levels.size())
+        levels.resize(level + 1);
+      levels[level].push_back(modules.size());
+      modules.push_back(module);
+    }
+
+    // Create the port path summaries of all modules up front, such that the
+    // modules processed in parallel only modify their own entry.
+    DenseMap<Operation *, PortPaths> modulePortPaths;
+    for (auto module : modules)
+      modulePortPaths[module];
+
+    // Process the modules one level at a time to make sure the combinational
+    // paths between IOs of a module have been detected and recorded in
+    // `modulePortPaths` before we handle its parent modules. The modules of a
+    // level only depend on the summaries of lower levels, and are processed in
+    // parallel. Like a serial walk in post-order, only the loop of the first
+    // failing module in post-order is reported. All modules before it have
+    // succeeded, so its summaries and diagnostic are the same as in a serial
+    // walk. Modules after the first failure found so far can be skipped.
+    unsigned firstFailure = modules.size();
+    std::unique_ptr<DiscoverLoops> firstFailed;
+    SmallVector<std::unique_ptr<DiscoverLoops>> failedModules(modules.size());
+    for (auto &level : levels) {
+      mlir::parallelForEach(&getContext(), level, [&](unsigned index) {
+        if (index > firstFailure)
+          return;
+        auto rdf = std::make_unique<DiscoverLoops>(
+            modules[index], instanceGraph, modulePortPaths);
+        if (rdf->processModule().failed())
+          failedModules[index] = std::move(rdf);
+      });
+      for (auto index : level) {
+        if (index < firstFailure && failedModules[index]) {
+          firstFailure = index;
+          firstFailed = std::move(failedModules[index]);
         }
+        failedModules[index].reset();
       }
     }
+    if (firstFailed) {
+      firstFailed->reportLoop();
+      return signalPassFailure();
+    }
     markAllAnalysesPreserved();
   }
 };
@@ -24,6 +24,7 @@
 #include "circt/Support/LLVM.h"
 #include "mlir/IR/IRMapping.h"
 #include "mlir/IR/ImplicitLocOpBuilder.h"
+#include "mlir/IR/Threading.h"
 #include "mlir/Support/LogicalResult.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DenseMapInfo.h"
@@ -59,7 +60,14 @@ llvm::raw_ostream &printHash(llvm::raw_ostream &stream, std::string data) {
 }
 
 struct StructuralHasher {
-  explicit StructuralHasher(MLIRContext *context) {
+  /// Create a hasher. If `moduleLeads` is given, instances are hashed as if
+  /// they referred to the module their target is deduplicated into, which
+  /// allows a module to be hashed before its instances have been updated.
+  explicit StructuralHasher(
+      MLIRContext *context,
+      const DenseMap<Attribute, Attribute> *moduleLeads = nullptr)
+      : moduleLeads(moduleLeads) {
+    moduleNameAttr = StringAttr::get(context, "moduleName");
     portTypesAttr = StringAttr::get(context, "portTypes");
     nonessentialAttributes.insert(StringAttr::get(context, "annotations"));
     nonessentialAttributes.insert(StringAttr::get(context, "name"));
@@ -141,6 +149,10 @@ private:
           update(type);
         continue;
       }
+      // Hash instantiated modules by their deduplication lead.
+      if (name == moduleNameAttr && moduleLeads)
+        if (auto lead = moduleLeads->lookup(value))
+          value = lead;
       // Hash the interned pointer.
       update(name.getAsOpaquePointer());
       update(value.getAsOpaquePointer());
@@ -187,6 +199,10 @@ private:
   DenseSet<Attribute> nonessentialAttributes;
   // This is a cached "portTypes" string attr.
   StringAttr portTypesAttr;
+  // This is a cached "moduleName" string attr.
+  StringAttr moduleNameAttr;
+  // The module each deduplicated module is merged into, if known in advance.
+  const DenseMap<Attribute, Attribute> *moduleLeads;
 
   // This is the actual running hash calculation. This is a stateful element
   // that should be reinitialized after each hash is produced.
@@ -1269,7 +1285,6 @@ class DedupPass : public DedupBase<DedupPass> {
     auto *nlaTable = &getAnalysis<NLATable>();
     SymbolTable symbolTable(circuit);
     Deduper deduper(instanceGraph, symbolTable, nlaTable, circuit);
-    StructuralHasher hasher(&getContext());
     Equivalence equiv(context, instanceGraph);
     auto anythingChanged = false;
 
@@ -1293,10 +1308,89 @@ class DedupPass : public DedupBase<DedupPass> {
           return cast<FModuleLike>(*node->getModule());
         }));
 
-    for (auto module : modules) {
+    // Modules annotated with NoDedup or with input RefType ports are not
+    // considered for deduplication.
+    auto canDedup = [&](FModuleLike module) {
+      if (AnnotationSet(module).hasAnnotation(noDedupClass))
+        return false;
+      return llvm::none_of(module.getPorts(), [&](PortInfo port) {
+        return isa<RefType>(port.type) && port.isInput();
+      });
+    };
+
+    // Compute a cheap signature of every candidate module. Structurally
+    // equivalent modules have the same kind, number of ports, and number of
+    // operations, so a module whose signature is unique cannot be deduplicated
+    // with any other module and does not need to be hashed.
+    using Signature = std::tuple<const void *, size_t, size_t>;
+    SmallVector<std::optional<Signature>, 0> signatures(modules.size());
+    mlir::parallelFor(context, 0, modules.size(), [&](size_t index) {
+      auto module = modules[index];
+      if (!canDedup(module))
+        return;
+      size_t numOps = 0;
+      module->walk([&](Operation *) { ++numOps; });
+      signatures[index] = Signature(module->getName().getAsOpaquePointer(),
+                                    module.getNumPorts(), numOps);
+    });
+    DenseMap<Signature, unsigned> signatureCounts;
+    for (auto &signature : signatures)
+      if (signature)
+        ++signatureCounts[*signature];
+
+    // Group the modules into levels, such that a module only instantiates
+    // modules of lower levels. Each level lists its modules in post-order.
+    DenseMap<Operation *, unsigned> moduleLevels;
+    SmallVector<SmallVector<unsigned>> levels;
+    for (auto [index, module] : llvm::enumerate(modules)) {
+      unsigned level = 0;
+      for (auto *record : *instanceGraph.lookup(module.getModuleNameAttr())) {
+        auto *child = record->getTarget()->getModule().getOperation();
+        auto it = moduleLevels.find(child);
+        if (it != moduleLevels.end())
+          level = std::max(level, it->second + 1);
+      }
+      moduleLevels[module] = level;
+      if (level >= levels.size())
+        levels.resize(level + 1);
+      levels[level].push_back(index);
+    }
+
+    // Hash the modules one level at a time. The hash of a module depends on
+    // the modules its instances are deduplicated into, which are all on lower
+    // levels, but not on any other module of its level. This allows all
+    // modules of a level to be hashed in parallel. Instead of updating the
+    // instances, the hasher looks up the module each instantiated module will
+    // be merged into, which is the first module with the same hash in
+    // post-order.
+    SmallVector<std::optional<std::array<uint8_t, 32>>, 0> hashes(
+        modules.size());
+    DenseMap<Attribute, Attribute> moduleLeads;
+    llvm::DenseMap<std::array<uint8_t, 32>, Attribute, SHA256HashDenseMapInfo>
+        leadsByHash;
+    for (auto &level : levels) {
+      mlir::parallelForEach(context, level, [&](unsigned index) {
+        auto &signature = signatures[index];
+        if (!signature || signatureCounts.lookup(*signature) < 2)
+          return;
+        StructuralHasher hasher(context, &moduleLeads);
+        hashes[index] = hasher.hash(modules[index]);
+      });
+      for (auto index : level) {
+        if (!hashes[index])
+          continue;
+        auto name = FlatSymbolRefAttr::get(modules[index].getModuleNameAttr());
+        auto [it, inserted] = leadsByHash.insert({*hashes[index], name});
+        if (!inserted)
+          moduleLeads[name] = it->second;
+      }
+    }
+
+    // Deduplicate the modules in post-order, such that the instances of a
+    // module have been updated by the time it is merged.
+    for (auto [index, module] : llvm::enumerate(modules)) {
       auto moduleName = module.getModuleNameAttr();
-      // If the module is marked with NoDedup, just skip it.
-      if (AnnotationSet(module).hasAnnotation(noDedupClass)) {
+      if (!signatures[index]) {
         // We record it in the dedup map to help detect errors when the user
         // marks the module as both NoDedup and MustDedup. We do not record this
         // module in the hasher to make sure no other module dedups "into" this
@@ -1304,15 +1398,14 @@ class DedupPass : public DedupBase<DedupPass> {
         dedupMap[moduleName] = moduleName;
         continue;
       }
-      // If the module has input RefType ports, also skip it.
-      if (llvm::any_of(module.getPorts(), [&](PortInfo port) {
-            return isa<RefType>(port.type) && port.isInput();
-          })) {
+      if (!hashes[index]) {
+        // The module is unlike any other and forms its own dedup group.
+        ++uniqueModules;
+        deduper.record(module);
         dedupMap[moduleName] = moduleName;
         continue;
       }
-      // Calculate the hash of the module.
-      auto h = hasher.hash(module);
+      auto h = *hashes[index];
       // Check if there a module with the same hash.
       auto it = moduleHashes.find(h);
       if (it != moduleHashes.end()) {
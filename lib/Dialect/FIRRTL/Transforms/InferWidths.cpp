@@ -17,8 +17,11 @@
 #include "circt/Dialect/FIRRTL/FIRRTLVisitors.h"
 #include "circt/Dialect/FIRRTL/Passes.h"
 #include "circt/Support/FieldRef.h"
+#include "circt/Support/PhaseTimer.h"
 #include "mlir/IR/ImplicitLocOpBuilder.h"
+#include "mlir/IR/Threading.h"
 #include "llvm/ADT/APSInt.h"
+#include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/GraphTraits.h"
 #include "llvm/ADT/Hashing.h"
@@ -137,6 +140,10 @@ struct VarExpr : public ExprBase<VarExpr, Expr::Kind::Var> {
   /// The upper bound this variable is supposed to be smaller than or equal to.
   Expr *upperBound = nullptr;
   std::optional<int32_t> upperBoundSolution;
+
+  /// The strongly connected component of the constraint graph this variable
+  /// is part of. Assigned by the solver before it checks for cycles.
+  unsigned component = 0;
 };
 
 /// A derived width.
@@ -327,6 +334,10 @@ public:
     interned.insert(Slot(heap_value));
     return std::make_pair(heap_value, true);
   }
+
+  /// Release the table used to find existing objects. The allocated objects
+  /// remain valid, but are no longer deduplicated against later allocations.
+  void releaseInternTable() { interned = {}; }
 };
 
 /// A simple bump allocator. The allocated objects must not have a destructor.
@@ -670,6 +681,14 @@ private:
 
   void emitUninferredWidthError(VarExpr *var);
 
+  void computeComponents();
+
+  /// The component of the variable whose constraint `checkCycles` is currently
+  /// visiting, and the inequalities of variables outside of the component that
+  /// is being checked.
+  unsigned currentComponent = 0;
+  DenseMap<VarExpr *, LinIneq> externalIneqs;
+
   LinIneq checkCycles(VarExpr *var, Expr *expr,
                       SmallPtrSetImpl<Expr *> &seenVars,
                       InFlightDiagnostic *reportInto = nullptr,
@@ -697,6 +716,106 @@ inline llvm::raw_ostream &operator<<(llvm::raw_ostream &os, const LinIneq &l) {
 }
 #endif
 
+/// Number the strongly connected components of the graph formed by the
+/// variables and the variables their constraints refer to. A variable cannot
+/// reach any other variable in its constraint without going through the
+/// variables of its own component first.
+void ConstraintSolver::computeComponents() {
+  // Temporarily use the component field to number the variables.
+  SmallVector<VarExpr *> varExprs;
+  for (auto *expr : exprs) {
+    if (auto *var = dyn_cast<VarExpr>(expr)) {
+      var->component = varExprs.size();
+      varExprs.push_back(var);
+    }
+  }
+
+  // Collect the variables a constraint refers to, without looking through
+  // them into their own constraints.
+  auto collectSuccessors = [](VarExpr *var, SmallVectorImpl<unsigned> &succs) {
+    if (!var->constraint)
+      return;
+    SmallVector<Expr *, 8> worklist({var->constraint});
+    SmallPtrSet<Expr *, 8> visited;
+    while (!worklist.empty()) {
+      auto *expr = worklist.pop_back_val();
+      if (!visited.insert(expr).second)
+        continue;
+      TypeSwitch<Expr *>(expr)
+          .Case<VarExpr>([&](auto *expr) { succs.push_back(expr->component); })
+          .Case<IdExpr, PowExpr>(
+              [&](auto *expr) { worklist.push_back(expr->arg); })
+          .Case<AddExpr, MaxExpr, MinExpr>([&](auto *expr) {
+            worklist.push_back(expr->lhs());
+            worklist.push_back(expr->rhs());
+          });
+    }
+  };
+
+  // Find the components with an iterative version of Tarjan's algorithm, since
+  // the constraint chains can get very long.
+  struct Frame {
+    unsigned node;
+    unsigned nextSucc = 0;
+    SmallVector<unsigned, 4> succs;
+  };
+  const unsigned unvisited = ~0U;
+  SmallVector<unsigned> indices(varExprs.size(), unvisited);
+  SmallVector<unsigned> lowLinks(varExprs.size(), 0);
+  SmallVector<unsigned> components(varExprs.size(), 0);
+  llvm::BitVector onStack(varExprs.size());
+  SmallVector<unsigned> stack;
+  SmallVector<Frame> dfsStack;
+  unsigned nextIndex = 0;
+  unsigned numComponents = 0;
+
+  auto visit = [&](unsigned node) {
+    indices[node] = lowLinks[node] = nextIndex++;
+    stack.push_back(node);
+    onStack.set(node);
+    auto &frame = dfsStack.emplace_back();
+    frame.node = node;
+    collectSuccessors(varExprs[node], frame.succs);
+  };
+
+  for (unsigned root = 0, e = varExprs.size(); root != e; ++root) {
+    if (indices[root] != unvisited)
+      continue;
+    visit(root);
+    while (!dfsStack.empty()) {
+      auto &frame = dfsStack.back();
+      if (frame.nextSucc < frame.succs.size()) {
+        unsigned succ = frame.succs[frame.nextSucc++];
+        if (indices[succ] == unvisited)
+          visit(succ);
+        else if (onStack.test(succ))
+          lowLinks[frame.node] = std::min(lowLinks[frame.node], indices[succ]);
+        continue;
+      }
+      unsigned node = frame.node;
+      dfsStack.pop_back();
+      if (!dfsStack.empty()) {
+        unsigned parent = dfsStack.back().node;
+        lowLinks[parent] = std::min(lowLinks[parent], lowLinks[node]);
+      }
+      if (lowLinks[node] != indices[node])
+        continue;
+      unsigned member;
+      do {
+        member = stack.pop_back_val();
+        onStack.reset(member);
+        components[member] = numComponents;
+      } while (member != node);
+      ++numComponents;
+    }
+  }
+
+  for (auto [var, component] : llvm::zip(varExprs, components))
+    var->component = component;
+  LLVM_DEBUG(llvm::dbgs() << "Found " << numComponents << " components in "
+                          << varExprs.size() << " variables\n");
+}
+
 /// Compute the canonicalized linear inequality expression starting at `expr`,
 /// for the `var` as the left hand side `x` of the inequality. `seenVars` is
 /// used as a recursion breaker. Occurrences of `var` itself within the
@@ -717,6 +836,18 @@ LinIneq ConstraintSolver::checkCycles(VarExpr *var, Expr *expr,
           .Case<VarExpr>([&](auto *expr) {
             if (expr == var)
               return LinIneq(1, 0); // x >= 1*x + 0
+            // A variable outside the component of the variable that led here
+            // cannot lead back to `var` or any other variable in `seenVars`.
+            // Its inequality is the same no matter how it was reached, so it
+            // only has to be computed once. Skip this when reporting, such
+            // that all the notes are attached to the diagnostic.
+            bool isExternal =
+                !reportInto && expr->component != currentComponent;
+            if (isExternal) {
+              auto it = externalIneqs.find(expr);
+              if (it != externalIneqs.end())
+                return it->second;
+            }
             if (!seenVars.insert(expr).second)
               // Count recursions in other variables as 0. This is sane
               // since the cycle is either breakable, in which case the
@@ -727,9 +858,14 @@ LinIneq ConstraintSolver::checkCycles(VarExpr *var, Expr *expr,
             if (!expr->constraint)
               // Count unconstrained variables as `x >= 0`.
               return LinIneq(0);
+            auto outerComponent = currentComponent;
+            currentComponent = expr->component;
             auto l = checkCycles(var, expr->constraint, seenVars, reportInto,
                                  indent + 1);
+            currentComponent = outerComponent;
             seenVars.erase(expr);
+            if (isExternal)
+              externalIneqs.insert({expr, l});
             return l;
           })
           .Case<IdExpr>([&](auto *expr) {
@@ -796,6 +932,12 @@ LinIneq ConstraintSolver::checkCycles(VarExpr *var, Expr *expr,
 
 using ExprSolution = std::pair<std::optional<int32_t>, bool>;
 
+/// An expression on the worklist of `solveExpr`.
+struct SolveFrame {
+  Expr *expr;
+  unsigned indent;
+};
+
 static ExprSolution
 computeUnary(ExprSolution arg, llvm::function_ref<int32_t(int32_t)> operation) {
   if (arg.first)
@@ -821,21 +963,15 @@ computeBinary(ExprSolution lhs, ExprSolution rhs,
 /// and a boolean indicating whether a recursion was detected. This may be used
 /// to memoize the result of expressions in case they were not involved in a
 /// cycle (which may alter their value from the perspective of a variable).
+/// `worklist` is scratch space that is reused across calls, such that its
+/// storage only has to grow once.
 static ExprSolution solveExpr(Expr *expr, SmallPtrSetImpl<Expr *> &seenVars,
-                              unsigned defaultWorklistSize) {
-
-  struct Frame {
-    Expr *expr;
-    unsigned indent;
-  };
-
+                              std::vector<SolveFrame> &worklist) {
   // indent only used for debug logs.
   unsigned indent = 1;
-  std::vector<Frame> worklist({{expr, indent}});
+  worklist.clear();
+  worklist.push_back({expr, indent});
   llvm::DenseMap<Expr *, ExprSolution> solvedExprs;
-  // Reserving the vector size, to avoid frequent reallocs. The worklist can be
-  // quite large.
-  worklist.reserve(defaultWorklistSize);
 
   while (!worklist.empty()) {
     auto &frame = worklist.back();
@@ -974,6 +1110,19 @@ LogicalResult ConstraintSolver::solve() {
     dumpConstraints(llvm::dbgs());
   });
 
+  // No new expressions are created from here on, so the tables used to
+  // deduplicate them can go.
+  knowns.releaseInternTable();
+  ids.releaseInternTable();
+  uns.releaseInternTable();
+  bins.releaseInternTable();
+
+  // Group the variables into strongly connected components. Variables outside
+  // of a variable's own component cannot be part of a cycle through it, which
+  // allows the cycle check to visit each of them only once.
+  computeComponents();
+  externalIneqs.clear();
+
   // Ensure that there are no adverse cycles around.
   LLVM_DEBUG(
       llvm::dbgs() << "\n===----- Checking for unbreakable loops -----===\n\n");
@@ -992,6 +1141,7 @@ LogicalResult ConstraintSolver::solve() {
     // us to easily determine if any recursion leads to an unsatisfiable
     // constraint. The `seenVars` set acts as a recursion breaker.
     seenVars.insert(var);
+    currentComponent = var->component;
     auto ineq = checkCycles(var, var->constraint, seenVars);
     seenVars.clear();
 
@@ -1024,6 +1174,7 @@ LogicalResult ConstraintSolver::solve() {
 
       // Re-run the cycle checking, but this time reporting into the diagnostic.
       seenVars.insert(var);
+      currentComponent = var->component;
       checkCycles(var, var->constraint, seenVars, &diag);
       seenVars.clear();
     }
@@ -1036,7 +1187,7 @@ LogicalResult ConstraintSolver::solve() {
 
   // Iterate over the constraint variables and solve each.
   LLVM_DEBUG(llvm::dbgs() << "\n===----- Solving constraints -----===\n\n");
-  unsigned defaultWorklistSize = exprs.size() / 2;
+  std::vector<SolveFrame> worklist;
   for (auto *expr : exprs) {
     // Only work on variables.
     auto *var = dyn_cast<VarExpr>(expr);
@@ -1055,11 +1206,11 @@ LogicalResult ConstraintSolver::solve() {
     LLVM_DEBUG(llvm::dbgs()
                << "- Solving " << *var << " >= " << *var->constraint << "\n");
     seenVars.insert(var);
-    auto solution = solveExpr(var->constraint, seenVars, defaultWorklistSize);
+    auto solution = solveExpr(var->constraint, seenVars, worklist);
     // Compute the upperBound if there is one and haven't already.
     if (var->upperBound && !var->upperBoundSolution)
       var->upperBoundSolution =
-          solveExpr(var->upperBound, seenVars, defaultWorklistSize).first;
+          solveExpr(var->upperBound, seenVars, worklist).first;
     seenVars.clear();
 
     // Constrain variables >= 0.
@@ -1256,12 +1407,29 @@ static bool hasUninferredWidth(Type type) {
       .Default([](auto) { return false; });
 }
 
+/// Check if a module contains *any* uninferred widths, in its ports or in the
+/// results of its operations.
+static bool hasUninferredWidth(FModuleOp module) {
+  for (auto arg : module.getArguments())
+    if (hasUninferredWidth(arg.getType()))
+      return true;
+  auto result = module.walk([&](Operation *op) {
+    for (auto type : op->getResultTypes())
+      if (hasUninferredWidth(type))
+        return WalkResult::interrupt();
+    return WalkResult::advance();
+  });
+  return result.wasInterrupted();
+}
+
 LogicalResult InferenceMapping::map(CircuitOp op) {
   LLVM_DEBUG(llvm::dbgs()
              << "\n===----- Mapping ops to constraint exprs -----===\n\n");
 
   // Ensure we have constraint variables established for all module ports.
+  SmallVector<FModuleOp> modules;
   op.walk<WalkOrder::PostOrder>([&](FModuleOp module) {
+    modules.push_back(module);
     for (auto arg : module.getArguments()) {
       solver.setCurrentContextInfo(FieldRef(arg, 0));
       declareVars(arg, module.getLoc());
@@ -1269,28 +1437,24 @@ LogicalResult InferenceMapping::map(CircuitOp op) {
     return WalkResult::skip(); // no need to look inside the module
   });
 
-  // Go through the module bodies and populate the constraint problem.
-  auto result = op.walk<WalkOrder::PostOrder>([&](FModuleOp module) {
-    // Check if the module contains *any* uninferred widths. This allows us to
-    // do an early skip if the module is already fully inferred.
-    bool anyUninferred = false;
-    for (auto arg : module.getArguments()) {
-      anyUninferred |= hasUninferredWidth(arg.getType());
-      if (anyUninferred)
-        break;
-    }
-    module.walk([&](Operation *op) {
-      for (auto type : op->getResultTypes())
-        anyUninferred |= hasUninferredWidth(type);
-      if (anyUninferred)
-        return WalkResult::interrupt();
-      return WalkResult::advance();
-    });
-    if (!anyUninferred) {
+  // Check which modules contain *any* uninferred widths. This allows us to do
+  // an early skip if a module is already fully inferred. The check only looks
+  // at types, so all modules can be checked in parallel.
+  SmallVector<bool> anyUninferred(modules.size(), false);
+  mlir::parallelFor(op.getContext(), 0, modules.size(), [&](size_t index) {
+    anyUninferred[index] = hasUninferredWidth(modules[index]);
+  });
+
+  // Go through the module bodies and populate the constraint problem. This is
+  // done sequentially, since connections to instances constrain the ports of
+  // other modules, and the order in which the variables are created determines
+  // the order in which the solver visits them.
+  for (auto [module, uninferred] : llvm::zip(modules, anyUninferred)) {
+    if (!uninferred) {
       LLVM_DEBUG(llvm::dbgs() << "Skipping fully-inferred module '"
                               << module.getName() << "'\n");
       skippedModules.insert(module);
-      return WalkResult::skip();
+      continue;
     }
     allModulesSkipped = false;
 
@@ -1299,10 +1463,9 @@ LogicalResult InferenceMapping::map(CircuitOp op) {
     auto result = module.getBodyBlock()->walk(
         [&](Operation *op) { return WalkResult(mapOperation(op)); });
     if (result.wasInterrupted())
-      return WalkResult::interrupt();
-    return WalkResult::skip(); // walk above already visited module body
-  });
-  return failure(result.wasInterrupted());
+      return failure();
+  }
+  return success();
 }
 
 LogicalResult InferenceMapping::mapOperation(Operation *op) {
@@ -2301,7 +2464,12 @@ void InferWidthsPass::runOnOperation() {
   ConstraintSolver solver;
   SymbolTable symtbl(getOperation());
   InferenceMapping mapping(solver, symtbl);
-  if (failed(mapping.map(getOperation()))) {
+  LogicalResult mapResult = failure();
+  {
+    PhaseTimer timer(mapTime);
+    mapResult = mapping.map(getOperation());
+  }
+  if (failed(mapResult)) {
     signalPassFailure();
     return;
   }
@@ -2311,12 +2479,18 @@ void InferWidthsPass::runOnOperation() {
   }
 
   // Solve the constraints.
-  if (failed(solver.solve())) {
+  LogicalResult solveResult = failure();
+  {
+    PhaseTimer timer(solveTime);
+    solveResult = solver.solve();
+  }
+  if (failed(solveResult)) {
     signalPassFailure();
     return;
   }
 
   // Update the types with the inferred widths.
+  PhaseTimer timer(updateTime);
   if (failed(InferenceTypeUpdate(mapping).update(getOperation())))
     signalPassFailure();
 }
@@ -0,0 +1,476 @@
+//===- BinaryTrace.cpp - Binary simulation trace --------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the writer of the binary trace format of the llhd-sim
+// tool, and its conversion to VCD.
+//
+//===----------------------------------------------------------------------===//
+
+#include "circt/Dialect/LLHD/Simulator/BinaryTrace.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Compression.h"
+#include "llvm/Support/LEB128.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+using namespace circt::llhd::sim;
+
+static constexpr StringLiteral traceMagic = "LLHDTRC2";
+
+/// The size above which the block being encoded is handed to the writer.
+static constexpr size_t blockSize = 1 << 16;
+
+namespace {
+/// The kind of a block.
+enum BlockKind : uint8_t { RawBlock = 0, ZlibBlock = 1, EndBlock = 0xff };
+
+/// The kind of a record in the block data.
+enum RecordKind : uint8_t { TimeRecord = 0, ChangeRecord = 1 };
+} // namespace
+
+static void appendULEB128(std::vector<uint8_t> &buffer, uint64_t value) {
+  uint8_t bytes[16];
+  unsigned size = encodeULEB128(value, bytes);
+  buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+static void writeULEB128(raw_ostream &out, uint64_t value) {
+  encodeULEB128(value, out);
+}
+
+/// Map signed differences to unsigned integers with small magnitudes.
+static uint64_t zigZagEncode(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^ (value >> 63);
+}
+
+static int64_t zigZagDecode(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+//===----------------------------------------------------------------------===//
+// BinaryTraceWriter
+//===----------------------------------------------------------------------===//
+
+BinaryTraceWriter::BinaryTraceWriter(raw_ostream &out, const State &state)
+    : out(out) {
+  // Write the signal table.
+  out << traceMagic;
+  writeULEB128(out, state.signals.size());
+  for (const auto &sig : state.signals) {
+    writeULEB128(out, sig.getSize());
+    writeULEB128(out, sig.getBitWidth());
+    writeULEB128(out, sig.getElementSize());
+    for (auto element : llvm::enumerate(sig.getElements())) {
+      writeULEB128(out, element.value().first);
+      writeULEB128(out, element.value().second);
+      writeULEB128(out, sig.getElementBitWidth(element.index()));
+    }
+
+    // Add one path for each connected instance.
+    SmallVector<std::string, 2> paths;
+    for (auto inst : sig.getTriggeredInstanceIndices())
+      paths.push_back(state.instances[inst].path + "/" + sig.getName());
+    llvm::sort(paths);
+    paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+    writeULEB128(out, paths.size());
+    for (auto &path : paths) {
+      writeULEB128(out, path.size());
+      out << path;
+    }
+  }
+
+  block.reserve(blockSize * 2);
+  writer = std::thread([this] { writeBlocks(); });
+}
+
+BinaryTraceWriter::~BinaryTraceWriter() {
+  pushBlock();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+  }
+  cond.notify_one();
+  writer.join();
+
+  out << static_cast<char>(EndBlock);
+  out.flush();
+}
+
+void BinaryTraceWriter::addChange(Time time, unsigned sigIndex,
+                                  const uint8_t *value, uint64_t size) {
+  // Start a new time step if needed.
+  if (!hasTime || !(time == lastTime)) {
+    assert((!hasTime || !(time < lastTime)) && "trace time going backwards");
+    block.push_back(TimeRecord);
+    appendULEB128(block, time.getTime() - (hasTime ? lastTime.getTime() : 0));
+    appendULEB128(block, time.getDelta());
+    appendULEB128(block, time.getEps());
+    lastTime = time;
+    lastIndex = 0;
+    hasTime = true;
+  }
+
+  block.push_back(ChangeRecord);
+  appendULEB128(block, zigZagEncode(static_cast<int64_t>(sigIndex) -
+                                    static_cast<int64_t>(lastIndex)));
+  block.insert(block.end(), value, value + size);
+  lastIndex = sigIndex;
+
+  if (block.size() >= blockSize)
+    pushBlock();
+}
+
+void BinaryTraceWriter::pushBlock() {
+  if (block.empty())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.push_back(std::move(block));
+  }
+  cond.notify_one();
+  block = std::vector<uint8_t>();
+  block.reserve(blockSize * 2);
+}
+
+void BinaryTraceWriter::writeBlocks() {
+  SmallVector<uint8_t, 0> compressed;
+  while (true) {
+    std::vector<uint8_t> data;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [&] { return done || !pending.empty(); });
+      if (pending.empty())
+        return;
+      data = std::move(pending.front());
+      pending.pop_front();
+    }
+
+    // Store the block uncompressed if compression is unavailable or does not
+    // pay off.
+    ArrayRef<uint8_t> stored = data;
+    BlockKind kind = RawBlock;
+    if (compression::zlib::isAvailable()) {
+      compressed.clear();
+      compression::zlib::compress(data, compressed,
+                                  compression::zlib::BestSpeedCompression);
+      if (compressed.size() < data.size()) {
+        stored = compressed;
+        kind = ZlibBlock;
+      }
+    }
+
+    out << static_cast<char>(kind);
+    writeULEB128(out, data.size());
+    writeULEB128(out, stored.size());
+    out << toStringRef(stored);
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// VCD conversion
+//===----------------------------------------------------------------------===//
+
+namespace {
+/// A cursor over a buffer of the binary trace.
+struct Reader {
+  Reader(ArrayRef<uint8_t> data) : data(data) {}
+
+  bool atEnd() const { return pos >= data.size(); }
+
+  Error readULEB128(uint64_t &value) {
+    unsigned size;
+    const char *error = nullptr;
+    value = decodeULEB128(data.data() + pos, &size, data.data() + data.size(),
+                          &error);
+    if (error)
+      return createStringError(inconvertibleErrorCode(),
+                               "malformed trace: %s", error);
+    pos += size;
+    return Error::success();
+  }
+
+  Error readBytes(uint64_t size, ArrayRef<uint8_t> &bytes) {
+    if (size > data.size() - pos)
+      return createStringError(inconvertibleErrorCode(),
+                               "malformed trace: unexpected end of data");
+    bytes = data.slice(pos, size);
+    pos += size;
+    return Error::success();
+  }
+
+  ArrayRef<uint8_t> data;
+  size_t pos = 0;
+};
+
+/// A VCD variable, which is either a full signal or one of its elements.
+struct Variable {
+  unsigned sigIndex;
+  unsigned offset;
+  unsigned size;
+  uint64_t width;
+  std::string id;
+};
+
+/// The signal table of a binary trace.
+struct TraceSignal {
+  /// An element of a structured signal.
+  struct Element {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t width;
+  };
+
+  uint64_t size;
+  uint64_t width;
+  SmallVector<Element> elements;
+  SmallVector<std::string, 2> paths;
+};
+} // namespace
+
+/// Return the VCD identifier code of the given variable index.
+static std::string getVCDIdentifier(unsigned index) {
+  std::string id;
+  do {
+    id.push_back('!' + index % 94);
+    index /= 94;
+  } while (index > 0);
+  return id;
+}
+
+/// Dump the value of a variable in VCD binary format. Only the low bits up to
+/// the width of the variable are dumped.
+static void dumpVCDValue(raw_ostream &out, const Variable &var,
+                         ArrayRef<uint8_t> value) {
+  out << 'b';
+  for (uint64_t i = var.width; i > 0; --i) {
+    uint8_t byte = value[var.offset + (i - 1) / 8];
+    out << ((byte >> ((i - 1) % 8)) & 1 ? '1' : '0');
+  }
+  out << ' ' << var.id << '\n';
+}
+
+Error circt::llhd::sim::convertBinaryTraceToVCD(StringRef trace,
+                                                raw_ostream &out) {
+  if (!trace.startswith(traceMagic))
+    return createStringError(inconvertibleErrorCode(),
+                             "input is not an llhd-sim binary trace");
+  Reader header(arrayRefFromStringRef(trace.drop_front(traceMagic.size())));
+
+  // Read the signal table.
+  uint64_t numSignals;
+  if (auto err = header.readULEB128(numSignals))
+    return err;
+  std::vector<TraceSignal> signals(numSignals);
+  for (auto &sig : signals) {
+    uint64_t numElements, numPaths;
+    if (auto err = header.readULEB128(sig.size))
+      return err;
+    if (auto err = header.readULEB128(sig.width))
+      return err;
+    if (sig.width > sig.size * 8)
+      return createStringError(inconvertibleErrorCode(),
+                               "malformed trace: signal wider than its size");
+    if (auto err = header.readULEB128(numElements))
+      return err;
+    for (uint64_t i = 0; i < numElements; ++i) {
+      TraceSignal::Element element;
+      if (auto err = header.readULEB128(element.offset))
+        return err;
+      if (auto err = header.readULEB128(element.size))
+        return err;
+      if (auto err = header.readULEB128(element.width))
+        return err;
+      if (element.offset + element.size > sig.size ||
+          element.width > element.size * 8)
+        return createStringError(inconvertibleErrorCode(),
+                                 "malformed trace: element out of bounds");
+      sig.elements.push_back(element);
+    }
+    if (auto err = header.readULEB128(numPaths))
+      return err;
+    for (uint64_t i = 0; i < numPaths; ++i) {
+      uint64_t length;
+      ArrayRef<uint8_t> path;
+      if (auto err = header.readULEB128(length))
+        return err;
+      if (auto err = header.readBytes(length, path))
+        return err;
+      sig.paths.push_back(toStringRef(path).str());
+    }
+  }
+
+  // Create one variable for each signal, or for each element of structured
+  // signals. All the paths of a signal share the same variables.
+  std::vector<Variable> variables;
+  std::vector<SmallVector<unsigned, 1>> signalVariables(numSignals);
+  // The variable declarations, as hierarchical path and variable index.
+  std::vector<std::pair<std::string, unsigned>> declarations;
+  for (unsigned sigIndex = 0; sigIndex < numSignals; ++sigIndex) {
+    auto &sig = signals[sigIndex];
+    auto addVariable = [&](unsigned offset, unsigned size, uint64_t width,
+                           int elem) {
+      unsigned varIndex = variables.size();
+      variables.push_back(
+          {sigIndex, offset, size, width, getVCDIdentifier(varIndex)});
+      signalVariables[sigIndex].push_back(varIndex);
+      for (auto &path : sig.paths)
+        declarations.push_back(
+            {elem < 0 ? path : path + "[" + std::to_string(elem) + "]",
+             varIndex});
+    };
+    if (sig.elements.empty())
+      addVariable(0, sig.size, sig.width, -1);
+    for (auto element : llvm::enumerate(sig.elements))
+      addVariable(element.value().offset, element.value().size,
+                  element.value().width, element.index());
+  }
+  llvm::sort(declarations);
+
+  // Emit the VCD header, with one scope per hierarchy level.
+  out << "$timescale 1ps $end\n";
+  SmallVector<StringRef> scopes;
+  for (auto &[path, varIndex] : declarations) {
+    SmallVector<StringRef> components;
+    StringRef(path).split(components, '/');
+    auto name = components.pop_back_val();
+
+    // Close the scopes not shared with the previous variable and open the new
+    // ones.
+    unsigned common = 0;
+    while (common < scopes.size() && common < components.size() &&
+           scopes[common] == components[common])
+      ++common;
+    for (unsigned i = scopes.size(); i > common; --i)
+      out << "$upscope $end\n";
+    scopes.resize(common);
+    for (unsigned i = common, e = components.size(); i < e; ++i) {
+      out << "$scope module " << components[i] << " $end\n";
+      scopes.push_back(components[i]);
+    }
+
+    auto &var = variables[varIndex];
+    out << "$var wire " << var.width << " " << var.id << " " << name
+        << " $end\n";
+  }
+  for (unsigned i = 0, e = scopes.size(); i < e; ++i)
+    out << "$upscope $end\n";
+  out << "$enddefinitions $end\n";
+
+  // Decode the blocks into a single record stream.
+  std::vector<uint8_t> records;
+  while (true) {
+    ArrayRef<uint8_t> kind;
+    if (auto err = header.readBytes(1, kind))
+      return err;
+    if (kind[0] == EndBlock)
+      break;
+
+    uint64_t rawSize, storedSize;
+    ArrayRef<uint8_t> stored;
+    if (auto err = header.readULEB128(rawSize))
+      return err;
+    if (auto err = header.readULEB128(storedSize))
+      return err;
+    if (auto err = header.readBytes(storedSize, stored))
+      return err;
+
+    if (kind[0] == RawBlock) {
+      records.insert(records.end(), stored.begin(), stored.end());
+    } else if (kind[0] == ZlibBlock) {
+      if (!compression::zlib::isAvailable())
+        return createStringError(inconvertibleErrorCode(),
+                                 "trace is compressed but zlib is unavailable");
+      SmallVector<uint8_t, 0> data;
+      if (auto err = compression::zlib::decompress(stored, data, rawSize))
+        return err;
+      records.insert(records.end(), data.begin(), data.end());
+    } else {
+      return createStringError(inconvertibleErrorCode(),
+                               "malformed trace: unknown block kind");
+    }
+  }
+
+  // Replay the changes. The values are only dumped once all the delta and
+  // epsilon steps of a real time step have been applied.
+  std::vector<std::vector<uint8_t>> values(numSignals), dumped(numSignals);
+  for (unsigned sigIndex = 0; sigIndex < numSignals; ++sigIndex)
+    values[sigIndex].resize(signals[sigIndex].size);
+  SmallVector<unsigned> dirty;
+  std::vector<bool> isDirty(numSignals, false);
+  uint64_t time = 0;
+  bool hasTime = false;
+
+  auto dumpChanges = [&]() {
+    if (dirty.empty())
+      return;
+    out << '#' << time << '\n';
+    llvm::sort(dirty);
+    for (auto sigIndex : dirty) {
+      isDirty[sigIndex] = false;
+      for (auto varIndex : signalVariables[sigIndex]) {
+        auto &var = variables[varIndex];
+        ArrayRef<uint8_t> current = values[sigIndex], last = dumped[sigIndex];
+        if (!last.empty() && last.slice(var.offset, var.size) ==
+                                 current.slice(var.offset, var.size))
+          continue;
+        dumpVCDValue(out, var, values[sigIndex]);
+      }
+      dumped[sigIndex] = values[sigIndex];
+    }
+    dirty.clear();
+  };
+
+  Reader reader(records);
+  uint64_t lastIndex = 0;
+  while (!reader.atEnd()) {
+    ArrayRef<uint8_t> kind;
+    if (auto err = reader.readBytes(1, kind))
+      return err;
+
+    if (kind[0] == TimeRecord) {
+      uint64_t timeIncrement, delta, eps;
+      if (auto err = reader.readULEB128(timeIncrement))
+        return err;
+      if (auto err = reader.readULEB128(delta))
+        return err;
+      if (auto err = reader.readULEB128(eps))
+        return err;
+      if (hasTime && timeIncrement > 0)
+        dumpChanges();
+      time += timeIncrement;
+      hasTime = true;
+      lastIndex = 0;
+      continue;
+    }
+
+    if (kind[0] != ChangeRecord || !hasTime)
+      return createStringError(inconvertibleErrorCode(),
+                               "malformed trace: unexpected record");
+    uint64_t encodedIndex;
+    if (auto err = reader.readULEB128(encodedIndex))
+      return err;
+    uint64_t sigIndex = lastIndex + zigZagDecode(encodedIndex);
+    if (sigIndex >= numSignals)
+      return createStringError(inconvertibleErrorCode(),
+                               "malformed trace: unknown signal");
+    ArrayRef<uint8_t> value;
+    if (auto err = reader.readBytes(signals[sigIndex].size, value))
+      return err;
+    llvm::copy(value, values[sigIndex].begin());
+    if (!isDirty[sigIndex]) {
+      isDirty[sigIndex] = true;
+      dirty.push_back(sigIndex);
+    }
+    lastIndex = sigIndex;
+  }
+  dumpChanges();
+
+  return Error::success();
+}
@@ -0,0 +1,356 @@
+//===- Checkpoint.cpp - Simulation state checkpoints ----------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the writing and restoring of simulation state
+// checkpoints of the llhd-sim tool.
+//
+//===----------------------------------------------------------------------===//
+
+#include "circt/Dialect/LLHD/Simulator/Checkpoint.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/LEB128.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstddef>
+
+using namespace llvm;
+using namespace circt::llhd::sim;
+
+static constexpr StringLiteral checkpointMagic = "LLHDCKP2";
+
+/// The offset of the persisted values in the process state allocation.
+static constexpr size_t persistenceOffset = offsetof(ProcState, resumeState);
+
+//===----------------------------------------------------------------------===//
+// Writing
+//===----------------------------------------------------------------------===//
+
+static void writeULEB128(raw_ostream &out, uint64_t value) {
+  encodeULEB128(value, out);
+}
+
+static void writeTime(raw_ostream &out, Time time) {
+  writeULEB128(out, time.getTime());
+  writeULEB128(out, time.getDelta());
+  writeULEB128(out, time.getEps());
+}
+
+static void writeBytes(raw_ostream &out, const uint8_t *bytes, uint64_t size) {
+  writeULEB128(out, size);
+  out.write(reinterpret_cast<const char *>(bytes), size);
+}
+
+/// Write the signal pointer held by the persisted signal struct at the given
+/// offset in the state of a process, as the index of the signal and the byte
+/// offset into its value. The struct of a value the process has not persisted
+/// yet holds no signal pointer, which is written as an out of range index.
+static void writeSignalSlot(raw_ostream &out, const State &state,
+                            const Instance &inst, uint64_t slot) {
+  SignalDetail detail;
+  std::memcpy(&detail, reinterpret_cast<const uint8_t *>(inst.procState) + slot,
+              sizeof(detail));
+  uint64_t index = state.signals.size(), offset = 0;
+  if (detail.globalIndex < state.signals.size()) {
+    const auto &sig = state.signals[detail.globalIndex];
+    auto addr = reinterpret_cast<uintptr_t>(detail.value);
+    auto base = reinterpret_cast<uintptr_t>(sig.getValue());
+    // LLHDToLLVM allocates twice the size of each signal, such that shifted
+    // pointers stay within the allocation.
+    if (addr >= base && addr - base < 2 * sig.getSize()) {
+      index = detail.globalIndex;
+      offset = addr - base;
+    }
+  }
+  writeULEB128(out, index);
+  writeULEB128(out, offset);
+}
+
+void circt::llhd::sim::writeCheckpoint(const State &state, StringRef designHash,
+                                       raw_ostream &out) {
+  out << checkpointMagic;
+  writeBytes(out, designHash.bytes_begin(), designHash.size());
+  writeTime(out, state.time);
+
+  writeULEB128(out, state.signals.size());
+  for (const auto &sig : state.signals)
+    writeBytes(out, sig.getValue(), sig.getSize());
+
+  writeULEB128(out, state.instances.size());
+  for (const auto &inst : state.instances) {
+    writeULEB128(out, inst.name.size());
+    out << inst.name;
+    writeTime(out, inst.expectedWakeup);
+    if (inst.isEntity) {
+      writeBytes(out, inst.entityState, inst.entityStateSize);
+      continue;
+    }
+    writeULEB128(out, inst.procState->resume);
+    writeBytes(out, reinterpret_cast<const uint8_t *>(inst.procState->senses),
+               inst.nArgs);
+    writeBytes(out,
+               reinterpret_cast<const uint8_t *>(inst.procState) +
+                   persistenceOffset,
+               inst.procStateSize - persistenceOffset);
+    writeULEB128(out, inst.procSignalSlots.size());
+    for (auto slot : inst.procSignalSlots)
+      writeSignalSlot(out, state, inst, slot);
+  }
+
+  auto slots = state.queue.getPendingSlots();
+  writeULEB128(out, slots.size());
+  SmallVector<uint8_t, 16> value;
+  for (const auto *slot : slots) {
+    writeTime(out, slot->time);
+    writeULEB128(out, slot->changesSize);
+    for (size_t i = 0, e = slot->changesSize; i < e; ++i) {
+      const auto &drive = slot->buffers[slot->changes[i].second];
+      writeULEB128(out, slot->changes[i].first);
+      writeULEB128(out, drive.bitOffset);
+      writeULEB128(out, drive.width);
+      value.assign(divideCeil(drive.width, 8), 0);
+      if (drive.isWord())
+        std::memcpy(value.data(), &drive.word, value.size());
+      else
+        StoreIntToMemory(drive.wide, value.data(), value.size());
+      writeBytes(out, value.data(), value.size());
+    }
+    writeULEB128(out, slot->scheduled.size());
+    for (auto inst : slot->scheduled)
+      writeULEB128(out, inst);
+  }
+  out.flush();
+}
+
+//===----------------------------------------------------------------------===//
+// Restoring
+//===----------------------------------------------------------------------===//
+
+static Error makeError(const Twine &message) {
+  return createStringError(inconvertibleErrorCode(),
+                           "malformed checkpoint: " + message);
+}
+
+static Error makeMismatchError() {
+  return createStringError(inconvertibleErrorCode(),
+                           "the checkpoint was taken from a different design");
+}
+
+namespace {
+/// A cursor over a checkpoint.
+struct Reader {
+  Reader(ArrayRef<uint8_t> data) : data(data) {}
+
+  Error readULEB128(uint64_t &value) {
+    unsigned size;
+    const char *error = nullptr;
+    value = decodeULEB128(data.data() + pos, &size, data.data() + data.size(),
+                          &error);
+    if (error)
+      return makeError(error);
+    pos += size;
+    return Error::success();
+  }
+
+  Error readTime(Time &time) {
+    uint64_t real, delta, eps;
+    if (auto err = readULEB128(real))
+      return err;
+    if (auto err = readULEB128(delta))
+      return err;
+    if (auto err = readULEB128(eps))
+      return err;
+    time = Time(real, delta, eps);
+    return Error::success();
+  }
+
+  /// Read a size-prefixed sequence of bytes, which must have the expected size.
+  Error readBytes(uint64_t expectedSize, ArrayRef<uint8_t> &bytes,
+                  const Twine &what) {
+    uint64_t size;
+    if (auto err = readULEB128(size))
+      return err;
+    if (size != expectedSize)
+      return makeError("size mismatch of " + what);
+    if (size > data.size() - pos)
+      return makeError("unexpected end of data");
+    bytes = data.slice(pos, size);
+    pos += size;
+    return Error::success();
+  }
+
+  /// Read a size-prefixed string of any size.
+  Error readString(StringRef &str) {
+    uint64_t size;
+    if (auto err = readULEB128(size))
+      return err;
+    if (size > data.size() - pos)
+      return makeError("unexpected end of data");
+    str = toStringRef(data.slice(pos, size));
+    pos += size;
+    return Error::success();
+  }
+
+  ArrayRef<uint8_t> data;
+  size_t pos = 0;
+};
+} // namespace
+
+/// Restore the signal pointer of the persisted signal struct at the given
+/// offset in the state of a process.
+static Error restoreSignalSlot(Reader &reader, State &state, Instance &inst,
+                               uint64_t slot) {
+  uint64_t index, offset;
+  if (auto err = reader.readULEB128(index))
+    return err;
+  if (auto err = reader.readULEB128(offset))
+    return err;
+  // The process had not persisted the value yet.
+  if (index == state.signals.size())
+    return Error::success();
+  if (index > state.signals.size() ||
+      offset >= 2 * state.signals[index].getSize())
+    return makeError("invalid signal pointer");
+  uint8_t *value = state.signals[index].getValue() + offset;
+  std::memcpy(reinterpret_cast<uint8_t *>(inst.procState) + slot +
+                  offsetof(SignalDetail, value),
+              &value, sizeof(value));
+  return Error::success();
+}
+
+Error circt::llhd::sim::restoreCheckpoint(State &state, StringRef checkpoint,
+                                          StringRef designHash) {
+  if (!checkpoint.startswith(checkpointMagic))
+    return makeError("invalid magic");
+  if (!state.queue.empty())
+    return createStringError(inconvertibleErrorCode(),
+                             "checkpoints can only be restored at the start "
+                             "of the simulation");
+  Reader reader(arrayRefFromStringRef(checkpoint.drop_front(
+      checkpointMagic.size())));
+
+  StringRef hash;
+  if (auto err = reader.readString(hash))
+    return err;
+  if (hash != designHash)
+    return makeMismatchError();
+
+  Time time;
+  if (auto err = reader.readTime(time))
+    return err;
+
+  uint64_t numSignals;
+  if (auto err = reader.readULEB128(numSignals))
+    return err;
+  if (numSignals != state.signals.size())
+    return makeMismatchError();
+  for (const auto &sig : state.signals) {
+    ArrayRef<uint8_t> value;
+    if (auto err = reader.readBytes(sig.getSize(), value,
+                                    "signal " + sig.getName()))
+      return err;
+    std::memcpy(sig.getValue(), value.data(), value.size());
+  }
+
+  uint64_t numInstances;
+  if (auto err = reader.readULEB128(numInstances))
+    return err;
+  if (numInstances != state.instances.size())
+    return makeMismatchError();
+  for (auto &inst : state.instances) {
+    ArrayRef<uint8_t> name;
+    if (auto err = reader.readBytes(inst.name.size(), name,
+                                    "instance " + inst.name))
+      return err;
+    if (toStringRef(name) != inst.name)
+      return makeMismatchError();
+    if (auto err = reader.readTime(inst.expectedWakeup))
+      return err;
+
+    ArrayRef<uint8_t> bytes;
+    if (inst.isEntity) {
+      if (auto err = reader.readBytes(inst.entityStateSize, bytes,
+                                      "the state of " + inst.name))
+        return err;
+      std::memcpy(inst.entityState, bytes.data(), bytes.size());
+      continue;
+    }
+
+    uint64_t resume;
+    if (auto err = reader.readULEB128(resume))
+      return err;
+    inst.procState->resume = resume;
+    if (auto err =
+            reader.readBytes(inst.nArgs, bytes, "the senses of " + inst.name))
+      return err;
+    std::memcpy(inst.procState->senses, bytes.data(), bytes.size());
+    if (auto err =
+            reader.readBytes(inst.procStateSize - persistenceOffset, bytes,
+                             "the state of " + inst.name))
+      return err;
+    auto *persisted =
+        reinterpret_cast<uint8_t *>(inst.procState) + persistenceOffset;
+    std::memcpy(persisted, bytes.data(), bytes.size());
+
+    // Signal values are allocated anew by every run, so the signal pointers
+    // persisted by the process need to be relocated.
+    uint64_t numSignalSlots;
+    if (auto err = reader.readULEB128(numSignalSlots))
+      return err;
+    if (numSignalSlots != inst.procSignalSlots.size())
+      return makeMismatchError();
+    for (auto slot : inst.procSignalSlots)
+      if (auto err = restoreSignalSlot(reader, state, inst, slot))
+        return err;
+  }
+
+  uint64_t numSlots;
+  if (auto err = reader.readULEB128(numSlots))
+    return err;
+  for (uint64_t i = 0; i < numSlots; ++i) {
+    Time slotTime;
+    uint64_t numChanges;
+    if (auto err = reader.readTime(slotTime))
+      return err;
+    if (slotTime < time)
+      return makeError("event scheduled in the past");
+    auto &slot = state.queue.getOrCreateSlot(slotTime);
+    if (auto err = reader.readULEB128(numChanges))
+      return err;
+    for (uint64_t j = 0; j < numChanges; ++j) {
+      uint64_t index, bitOffset, width;
+      ArrayRef<uint8_t> value;
+      if (auto err = reader.readULEB128(index))
+        return err;
+      if (auto err = reader.readULEB128(bitOffset))
+        return err;
+      if (auto err = reader.readULEB128(width))
+        return err;
+      if (index >= state.signals.size())
+        return makeError("invalid drive");
+      if (auto err = reader.readBytes(divideCeil(width, 8), value, "a drive"))
+        return err;
+      slot.insertChange(index, bitOffset, value.data(), width);
+    }
+
+    uint64_t numScheduled;
+    if (auto err = reader.readULEB128(numScheduled))
+      return err;
+    for (uint64_t j = 0; j < numScheduled; ++j) {
+      uint64_t inst;
+      if (auto err = reader.readULEB128(inst))
+        return err;
+      if (inst >= state.instances.size())
+        return makeError("invalid wakeup");
+      slot.insertChange(inst);
+    }
+  }
+
+  state.time = time;
+  return Error::success();
+}
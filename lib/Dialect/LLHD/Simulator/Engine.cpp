@@ -11,21 +11,135 @@
 //===----------------------------------------------------------------------===//
 
 #include "circt/Dialect/LLHD/Simulator/Engine.h"
+#include "circt/Dialect/LLHD/Simulator/Checkpoint.h"
 #include "circt/Conversion/LLHDToLLVM.h"
+#include "circt/Dialect/HW/HWTypes.h"
 
+#include "mlir/Dialect/LLVMIR/LLVMDialect.h"
 #include "mlir/ExecutionEngine/ExecutionEngine.h"
 #include "mlir/IR/Builders.h"
 
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/TargetSelect.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 using namespace circt::llhd::sim;
 
+//===----------------------------------------------------------------------===//
+// WakeupPool
+//===----------------------------------------------------------------------===//
+
+namespace {
+/// A fixed set of threads evaluating the units of a wakeup set, the calling
+/// thread being one of them. Tasks are handed out through a shared counter, so
+/// threads done with cheap units keep picking up the remaining work instead of
+/// waiting on a static partition.
+class WakeupPool {
+public:
+  WakeupPool(unsigned numThreads) {
+    threadIds.push_back(std::this_thread::get_id());
+    for (unsigned i = 1; i < numThreads; ++i) {
+      workers.emplace_back([this, i] { work(i); });
+      threadIds.push_back(workers.back().get_id());
+    }
+  }
+
+  ~WakeupPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      shutdown = true;
+    }
+    startCond.notify_all();
+    for (auto &worker : workers)
+      worker.join();
+  }
+
+  /// Return the IDs of the threads of the pool, indexed by the thread index
+  /// passed to the task function.
+  llvm::ArrayRef<std::thread::id> getThreadIds() const { return threadIds; }
+
+  /// Call `fn(task, thread)` for every task in [0, numTasks) and wait until all
+  /// of them completed.
+  void run(size_t numTasks, llvm::function_ref<void(size_t, unsigned)> fn) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      taskFn = fn;
+      taskCount = numTasks;
+      nextTask = 0;
+      pendingWorkers = workers.size();
+      ++generation;
+    }
+    startCond.notify_all();
+    drain(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCond.wait(lock, [&] { return pendingWorkers == 0; });
+  }
+
+private:
+  /// Process tasks until none is left.
+  void drain(unsigned thread) {
+    for (size_t task = nextTask++; task < taskCount; task = nextTask++)
+      taskFn(task, thread);
+  }
+
+  /// The main loop of the worker threads.
+  void work(unsigned thread) {
+    uint64_t seenGeneration = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        startCond.wait(
+            lock, [&] { return shutdown || generation != seenGeneration; });
+        if (shutdown)
+          return;
+        seenGeneration = generation;
+      }
+      drain(thread);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pendingWorkers == 0)
+          doneCond.notify_one();
+      }
+    }
+  }
+
+  llvm::SmallVector<std::thread::id, 8> threadIds;
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable startCond;
+  std::condition_variable doneCond;
+  uint64_t generation = 0;
+  size_t pendingWorkers = 0;
+  bool shutdown = false;
+  llvm::function_ref<void(size_t, unsigned)> taskFn;
+  size_t taskCount = 0;
+  std::atomic<size_t> nextTask{0};
+};
+} // namespace
+
+//===----------------------------------------------------------------------===//
+// Engine
+//===----------------------------------------------------------------------===//
+
+/// The symbol holding the hash of the design a model was compiled from.
+static constexpr llvm::StringLiteral modelHashSymbol = "llhd_model_hash";
+
 Engine::Engine(
     llvm::raw_ostream &out, ModuleOp module,
     llvm::function_ref<mlir::LogicalResult(mlir::ModuleOp)> mlirTransformer,
     llvm::function_ref<llvm::Error(llvm::Module *)> llvmTransformer,
-    std::string root, TraceMode tm, ArrayRef<StringRef> sharedLibPaths)
-    : out(out), root(root), traceMode(tm) {
+    std::string root, TraceMode tm, ArrayRef<StringRef> sharedLibPaths,
+    unsigned numThreads, const ModelOptions &modelOptions)
+    : out(out), root(root), traceMode(tm), numThreads(numThreads),
+      designHash(modelOptions.designHash) {
   state = std::make_unique<State>();
   state->root = root + '.' + root;
 
@@ -40,44 +154,181 @@ Engine::Engine(
                             std::nullopt, root, root, ArrayRef<Value>(),
                             ArrayRef<Value>());
 
+  this->module = module;
+
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  // Skip the lowering and JIT compilation if a precompiled model is provided.
+  if (!modelOptions.modelFile.empty()) {
+    if (auto err = loadModel(modelOptions.modelFile, modelOptions.designHash,
+                             sharedLibPaths)) {
+      llvm::errs() << "failed to load the precompiled model "
+                   << modelOptions.modelFile << ": "
+                   << llvm::toString(std::move(err)) << "\n";
+      exit(EXIT_FAILURE);
+    }
+    return;
+  }
+
   if (failed(mlirTransformer(module))) {
     llvm::errs() << "failed to apply the MLIR passes\n";
     exit(EXIT_FAILURE);
   }
 
-  this->module = module;
-
-  llvm::InitializeNativeTarget();
-  llvm::InitializeNativeTargetAsmPrinter();
+  // Embed the hash of the design, such that a model compiled from it can be
+  // checked against the design it gets simulated with.
+  if (!modelOptions.designHash.empty()) {
+    auto builder = OpBuilder::atBlockEnd(module.getBody());
+    auto hashTy = LLVM::LLVMArrayType::get(builder.getI8Type(),
+                                           modelOptions.designHash.size() + 1);
+    builder.create<LLVM::GlobalOp>(
+        module.getLoc(), hashTy, /*isConstant=*/true, LLVM::Linkage::External,
+        modelHashSymbol, builder.getStringAttr(modelOptions.designHash + '\0'));
+  }
 
   mlir::ExecutionEngineOptions options;
   options.transformer = llvmTransformer;
   options.sharedLibPaths = sharedLibPaths;
+  options.enableObjectDump = !modelOptions.emitModelFile.empty();
   auto maybeEngine = mlir::ExecutionEngine::create(this->module, options);
   assert(maybeEngine && "failed to create JIT");
   engine = std::move(*maybeEngine);
+
+  if (!modelOptions.emitModelFile.empty()) {
+    // The design is only compiled once one of its symbols is looked up, so
+    // force the compilation before dumping the object file.
+    if (auto init = engine->lookupPacked("llhd_init"); !init) {
+      llvm::errs() << "failed to compile the model: "
+                   << llvm::toString(init.takeError()) << "\n";
+      exit(EXIT_FAILURE);
+    }
+    llvm::sys::fs::remove(modelOptions.emitModelFile);
+    engine->dumpToObjectFile(modelOptions.emitModelFile);
+    uint64_t modelSize = 0;
+    if (llvm::sys::fs::file_size(modelOptions.emitModelFile, modelSize) ||
+        modelSize == 0) {
+      llvm::errs() << "failed to write the model to "
+                   << modelOptions.emitModelFile << "\n";
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+llvm::Error Engine::loadModel(StringRef modelFile, StringRef designHash,
+                              ArrayRef<StringRef> sharedLibPaths) {
+  auto buffer = llvm::MemoryBuffer::getFile(modelFile);
+  if (!buffer)
+    return llvm::errorCodeToError(buffer.getError());
+  if ((*buffer)->getBufferSize() == 0)
+    return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                   "the model file is empty");
+
+  auto jit = llvm::orc::LLJITBuilder().create();
+  if (!jit)
+    return jit.takeError();
+  model = std::move(*jit);
+
+  // Resolve the runtime library functions from the current process and the
+  // given shared libraries.
+  auto &mainDylib = model->getMainJITDylib();
+  char prefix = model->getDataLayout().getGlobalPrefix();
+  auto processGenerator =
+      llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(prefix);
+  if (!processGenerator)
+    return processGenerator.takeError();
+  mainDylib.addGenerator(std::move(*processGenerator));
+  for (auto path : sharedLibPaths) {
+    auto generator =
+        llvm::orc::DynamicLibrarySearchGenerator::Load(path.str().c_str(),
+                                                       prefix);
+    if (!generator)
+      return generator.takeError();
+    mainDylib.addGenerator(std::move(*generator));
+  }
+
+  if (auto err = model->addObjectFile(std::move(*buffer)))
+    return err;
+
+  // Check that the model was compiled from the simulated design.
+  auto hashAddr = model->lookup(modelHashSymbol);
+  if (!hashAddr)
+    return hashAddr.takeError();
+  if (!designHash.empty() && designHash != hashAddr->toPtr<const char *>())
+    return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                   "the model was compiled from a different "
+                                   "design");
+  return llvm::Error::success();
+}
+
+llvm::Expected<void (*)(void **)> Engine::lookupPacked(StringRef name) {
+  if (!model)
+    return engine->lookupPacked(name);
+
+  // The packed interface functions are named the same way as the ones
+  // generated by mlir::ExecutionEngine.
+  auto addr = model->lookup(("_mlir_" + name).str());
+  if (!addr)
+    return addr.takeError();
+  return addr->toPtr<void (*)(void **)>();
 }
 
 Engine::~Engine() = default;
 
+llvm::Error Engine::writeCheckpoint(StringRef checkpointFile) {
+  std::error_code ec;
+  llvm::raw_fd_ostream os(checkpointFile, ec, llvm::sys::fs::OF_None);
+  if (ec)
+    return llvm::errorCodeToError(ec);
+  circt::llhd::sim::writeCheckpoint(*state, designHash, os);
+  return llvm::Error::success();
+}
+
 void Engine::dumpStateLayout() { state->dumpLayout(); }
 
 void Engine::dumpStateSignalTriggers() { state->dumpSignalTriggers(); }
 
+void Engine::dumpStatistics() {
+  llvm::errs() << "Instance wakeups: " << stats.wakeups << "\n";
+  llvm::errs() << "Suppressed wakeups: " << stats.suppressedWakeups << "\n";
+}
+
 int Engine::simulate(int n, uint64_t maxTime) {
-  assert(engine && "engine not found");
+  assert((engine || model) && "engine not found");
   assert(state && "state not found");
 
+  stats = EngineStatistics();
+
   auto tm = static_cast<TraceMode>(traceMode);
   Trace trace(state, out, tm);
 
   SmallVector<void *, 1> arg({&state});
   // Initialize tbe simulation state.
-  auto invocationResult = engine->invokePacked("llhd_init", arg);
-  if (invocationResult) {
-    llvm::errs() << "Failed invocation of llhd_init: " << invocationResult;
+  auto init = lookupPacked("llhd_init");
+  if (!init) {
+    llvm::errs() << "Failed invocation of llhd_init: "
+                 << llvm::toString(init.takeError()) << "\n";
     return -1;
   }
+  (*init)(arg.data());
+
+  // Restore the state of the checkpoint to resume from, if any.
+  bool restored = false;
+  if (!restoreFile.empty()) {
+    auto buffer = llvm::MemoryBuffer::getFile(restoreFile);
+    if (!buffer) {
+      llvm::errs() << "Failed to open " << restoreFile << ": "
+                   << buffer.getError().message() << "\n";
+      return -1;
+    }
+    if (auto err = restoreCheckpoint(*state, (*buffer)->getBuffer(),
+                                     designHash)) {
+      llvm::errs() << "Failed to restore " << restoreFile << ": "
+                   << llvm::toString(std::move(err)) << "\n";
+      return -1;
+    }
+    restored = true;
+  }
 
   if (traceMode != TraceMode::None) {
     // Add changes for all the signals' initial values.
@@ -86,9 +337,10 @@ int Engine::simulate(int n, uint64_t maxTime) {
     }
   }
 
-  // Add a dummy event to get the simulation started.
-  state->queue.push_back(Slot(Time()));
-  ++state->queue.events;
+  // Add a dummy event to get the simulation started. A restored simulation
+  // resumes with the events pending in the checkpoint instead.
+  if (!restored)
+    state->queue.getOrCreateSlot(Time());
 
   // Keep track of the instances that need to wakeup.
   llvm::SmallVector<unsigned, 8> wakeupQueue;
@@ -96,9 +348,10 @@ int Engine::simulate(int n, uint64_t maxTime) {
   // Add all instances to the wakeup queue for the first run and add the jitted
   // function pointers to all of the instances to make them readily available.
   for (size_t i = 0, e = state->instances.size(); i < e; ++i) {
-    wakeupQueue.push_back(i);
+    if (!restored)
+      wakeupQueue.push_back(i);
     auto &inst = state->instances[i];
-    auto expectedFPtr = engine->lookupPacked(inst.unit);
+    auto expectedFPtr = lookupPacked(inst.unit);
     if (!expectedFPtr) {
       llvm::errs() << "Could not lookup " << inst.unit << "!\n";
       return -1;
@@ -106,6 +359,31 @@ int Engine::simulate(int n, uint64_t maxTime) {
     inst.unitFPtr = *expectedFPtr;
   }
 
+  auto runInstance = [&](unsigned i) {
+    auto &inst = state->instances[i];
+    auto signalTable = inst.sensitivityList.data();
+
+    // Gather the instance arguments for unit invocation.
+    SmallVector<void *, 3> args;
+    if (inst.isEntity)
+      args.assign({&state, &inst.entityState, &signalTable});
+    else {
+      args.assign({&state, &inst.procState, &signalTable});
+    }
+    // Run the unit.
+    (*inst.unitFPtr)(args.data());
+  };
+
+  // Set up the worker threads and register them, along with the current
+  // thread, for event staging.
+  std::unique_ptr<WakeupPool> pool;
+  SmallVector<StagedEvents, 0> staged;
+  if (numThreads > 1) {
+    pool = std::make_unique<WakeupPool>(numThreads);
+    for (auto id : pool->getThreadIds())
+      state->staging.push_back({id, nullptr});
+  }
+
   int cycle = 0;
   while (state->queue.events > 0) {
     const auto &pop = state->queue.top();
@@ -127,41 +405,30 @@ int Engine::simulate(int n, uint64_t maxTime) {
     while (i < e) {
       const auto sigIndex = pop.changes[i].first;
       auto &curr = state->signals[sigIndex];
-      APInt buff(curr.getSize() * 8, 0);
-      llvm::LoadIntFromMemory(buff, curr.getValue(), curr.getSize());
-
-      // Apply the changes to the buffer until we reach the next signal.
-      while (i < e && pop.changes[i].first == sigIndex) {
-        const auto &change = pop.buffers[pop.changes[i].second];
-        const auto offset = change.first;
-        const auto &drive = change.second;
-        if (drive.getBitWidth() < buff.getBitWidth())
-          buff.insertBits(drive, offset);
-        else
-          buff = drive;
 
+      // Apply the changes until we reach the next signal.
+      size_t begin = i;
+      while (i < e && pop.changes[i].first == sigIndex)
         ++i;
-      }
 
-      if (!curr.updateWhenChanged(buff.getRawData()))
+      if (!pop.applyChanges(curr, begin, i))
         continue;
 
       // Add sensitive instances.
-      for (auto inst : curr.getTriggeredInstanceIndices()) {
+      const auto &triggered = curr.getTriggeredInstanceIndices();
+      const auto &senseIndices = curr.getTriggeredSenseIndices();
+      for (size_t t = 0, te = triggered.size(); t < te; ++t) {
+        auto inst = triggered[t];
+        auto &instance = state->instances[inst];
         // Skip if the process is not currently sensible to the signal.
-        if (!state->instances[inst].isEntity) {
-          const auto &sensList = state->instances[inst].sensitivityList;
-          auto it = std::find_if(sensList.begin(), sensList.end(),
-                                 [sigIndex](const SignalDetail &sig) {
-                                   return sig.globalIndex == sigIndex;
-                                 });
-          if (sensList.end() != it &&
-              state->instances[inst].procState->senses[it - sensList.begin()] ==
-                  0)
+        if (!instance.isEntity) {
+          if (instance.procState->senses[senseIndices[t]] == 0) {
+            ++stats.suppressedWakeups;
             continue;
+          }
 
           // Invalidate scheduled wakeup
-          state->instances[inst].expectedWakeup = Time();
+          instance.expectedWakeup = Time();
         }
         wakeupQueue.push_back(inst);
       }
@@ -184,19 +451,25 @@ int Engine::simulate(int n, uint64_t maxTime) {
                       wakeupQueue.end());
 
     // Run the instances present in the wakeup queue.
-    for (auto i : wakeupQueue) {
-      auto &inst = state->instances[i];
-      auto signalTable = inst.sensitivityList.data();
-
-      // Gather the instance arguments for unit invocation.
-      SmallVector<void *, 3> args;
-      if (inst.isEntity)
-        args.assign({&state, &inst.entityState, &signalTable});
-      else {
-        args.assign({&state, &inst.procState, &signalTable});
-      }
-      // Run the unit.
-      (*inst.unitFPtr)(args.data());
+    stats.wakeups += wakeupQueue.size();
+    if (pool && wakeupQueue.size() > 1) {
+      // Units only read signal values during a delta cycle, so they can run in
+      // parallel as long as the events they emit are staged and committed in
+      // the serial invocation order afterwards.
+      if (staged.size() < wakeupQueue.size())
+        staged.resize(wakeupQueue.size());
+      pool->run(wakeupQueue.size(), [&](size_t task, unsigned thread) {
+        staged[task].clear();
+        state->staging[thread].second = &staged[task];
+        runInstance(wakeupQueue[task]);
+      });
+      for (auto &entry : state->staging)
+        entry.second = nullptr;
+      for (size_t i = 0, e = wakeupQueue.size(); i < e; ++i)
+        state->commitStagedEvents(staged[i]);
+    } else {
+      for (auto i : wakeupQueue)
+        runInstance(i);
     }
 
     // Clear wakeup queue.
@@ -204,6 +477,9 @@ int Engine::simulate(int n, uint64_t maxTime) {
     ++cycle;
   }
 
+  pool.reset();
+  state->staging.clear();
+
   if (traceMode != TraceMode::None) {
     // Flush any remainign changes
     trace.flush(/*force=*/true);
@@ -233,15 +509,37 @@ void Engine::buildLayout(ModuleOp module) {
   // Store the root instance.
   state->instances.push_back(std::move(rootInst));
 
-  // Add triggers to signals.
+  // Add triggers to signals. Each trigger records the index of the first
+  // occurrence of the signal in the instance's sensitivity list, such that the
+  // process sense flag can be looked up directly when the signal changes.
+  llvm::DenseMap<uint64_t, unsigned> firstSenseIndex;
   for (size_t i = 0, e = state->instances.size(); i < e; ++i) {
     auto &inst = state->instances[i];
-    for (auto trigger : inst.sensitivityList) {
-      state->signals[trigger.globalIndex].pushInstanceIndex(i);
+    firstSenseIndex.clear();
+    for (const auto &trigger : llvm::enumerate(inst.sensitivityList)) {
+      auto globalIndex = trigger.value().globalIndex;
+      auto senseIndex =
+          firstSenseIndex.insert({globalIndex, trigger.index()}).first->second;
+      state->signals[globalIndex].pushInstanceIndex(i, senseIndex);
     }
   }
 }
 
+/// Record the width in bits of a signal of the given type, and of each of its
+/// elements in the order LLHDToLLVM registers them with the state.
+static void setSignalBitWidths(Signal &sig, mlir::Type type) {
+  std::vector<unsigned> elementWidths;
+  if (auto arrayTy = type.dyn_cast<circt::hw::ArrayType>()) {
+    elementWidths.assign(arrayTy.getSize(),
+                         circt::hw::getBitWidth(arrayTy.getElementType()));
+  } else if (auto structTy = type.dyn_cast<circt::hw::StructType>()) {
+    // Struct fields are laid out in reverse order in LLVM.
+    for (auto field : llvm::reverse(structTy.getElements()))
+      elementWidths.push_back(circt::hw::getBitWidth(field.type));
+  }
+  sig.setBitWidths(circt::hw::getBitWidth(type), std::move(elementWidths));
+}
+
 void Engine::walkEntity(EntityOp entity, Instance &child) {
   entity.walk([&](Operation *op) {
     assert(op);
@@ -249,6 +547,7 @@ void Engine::walkEntity(EntityOp entity, Instance &child) {
     // Add a signal to the signal table.
     if (auto sig = dyn_cast<SigOp>(op)) {
       uint64_t index = state->addSignal(sig.getName().str(), child.name);
+      setSignalBitWidths(state->signals[index], sig.getInit().getType());
       child.sensitivityList.push_back(
           SignalDetail({nullptr, 0, child.sensitivityList.size(), index}));
     }
@@ -14,6 +14,7 @@
 #include "circt/Dialect/LLHD/Simulator/State.h"
 
 #include "llvm/Support/Format.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <string>
@@ -66,26 +67,63 @@ Signal::~Signal() {
 // Slot
 //===----------------------------------------------------------------------===//
 
+/// Load a value of up to 8 bytes into a machine word. The common sizes are
+/// special-cased to avoid a variable-sized memcpy. Only the low bytes of the
+/// word are written, which is correct on little-endian hosts only, as is the
+/// memory layout of the JIT-ed signals.
+static uint64_t loadWord(const uint8_t *bytes, uint64_t size) {
+  switch (size) {
+  case 1:
+    return *bytes;
+  case 2: {
+    uint16_t value;
+    std::memcpy(&value, bytes, 2);
+    return value;
+  }
+  case 4: {
+    uint32_t value;
+    std::memcpy(&value, bytes, 4);
+    return value;
+  }
+  case 8: {
+    uint64_t value;
+    std::memcpy(&value, bytes, 8);
+    return value;
+  }
+  default: {
+    uint64_t value = 0;
+    std::memcpy(&value, bytes, size);
+    return value;
+  }
+  }
+}
+
 bool Slot::operator<(const Slot &rhs) const { return time < rhs.time; }
 
 bool Slot::operator>(const Slot &rhs) const { return rhs.time < time; }
 
-void Slot::insertChange(int index, int bitOffset, uint8_t *bytes,
+void Slot::insertChange(int index, int bitOffset, const uint8_t *bytes,
                         unsigned width) {
-  // Get the amount of 64 bit words required to store the value in an APInt.
-  auto size = llvm::divideCeil(width, 8);
-
-  APInt buffer(width, 0);
-  llvm::LoadIntFromMemory(buffer, bytes, size);
-  auto offsetBufferPair = std::make_pair(bitOffset, buffer);
-
   if (changesSize >= buffers.size()) {
     // Create a new change buffer if we don't have any unused one available for
     // reuse.
-    buffers.push_back(offsetBufferPair);
+    buffers.emplace_back();
+  }
+
+  // Reuse the first available buffer.
+  auto &drive = buffers[changesSize];
+  drive.bitOffset = bitOffset;
+  drive.width = width;
+
+  // Get the amount of bytes required to store the value.
+  auto size = llvm::divideCeil(width, 8);
+
+  if (drive.isWord()) {
+    drive.word =
+        loadWord(bytes, size) & llvm::maskTrailingOnes<uint64_t>(width);
   } else {
-    // Reuse the first available buffer.
-    buffers[changesSize] = offsetBufferPair;
+    drive.wide = APInt(width, 0);
+    llvm::LoadIntFromMemory(drive.wide, bytes, size);
   }
 
   // Map the signal index to the change buffer so we can retrieve
@@ -96,11 +134,49 @@ void Slot::insertChange(int index, int bitOffset, uint8_t *bytes,
 
 void Slot::insertChange(unsigned inst) { scheduled.push_back(inst); }
 
+bool Slot::applyChanges(Signal &signal, size_t begin, size_t end) const {
+  auto size = signal.getSize();
+  auto bitWidth = size * 8;
+
+  // Fast path: merge the drives into a machine word holding the signal value.
+  if (size <= 8) {
+    uint64_t word = loadWord(signal.getValue(), size);
+    for (size_t i = begin; i < end; ++i) {
+      const auto &drive = buffers[changes[i].second];
+      assert(drive.isWord() && "drive wider than the signal!");
+      if (drive.width >= bitWidth) {
+        word = drive.word;
+        continue;
+      }
+      auto mask = llvm::maskTrailingOnes<uint64_t>(drive.width)
+                  << drive.bitOffset;
+      word = (word & ~mask) | (drive.word << drive.bitOffset);
+    }
+    return signal.updateWhenChanged(&word);
+  }
+
+  // Slow path: wide signals are merged in an APInt.
+  APInt buff(bitWidth, 0);
+  llvm::LoadIntFromMemory(buff, signal.getValue(), size);
+  for (size_t i = begin; i < end; ++i) {
+    const auto &drive = buffers[changes[i].second];
+    if (!drive.isWord()) {
+      if (drive.width < bitWidth)
+        buff.insertBits(drive.wide, drive.bitOffset);
+      else
+        buff = drive.wide;
+    } else {
+      buff.insertBits(drive.word, drive.bitOffset, drive.width);
+    }
+  }
+  return signal.updateWhenChanged(buff.getRawData());
+}
+
 //===----------------------------------------------------------------------===//
 // UpdateQueue
 //===----------------------------------------------------------------------===//
 void UpdateQueue::insertOrUpdate(Time time, int index, int bitOffset,
-                                 uint8_t *bytes, unsigned width) {
+                                 const uint8_t *bytes, unsigned width) {
   auto &slot = getOrCreateSlot(time);
   slot.insertChange(index, bitOffset, bytes, width);
 }
@@ -111,67 +187,109 @@ void UpdateQueue::insertOrUpdate(Time time, unsigned inst) {
 }
 
 Slot &UpdateQueue::getOrCreateSlot(Time time) {
-  auto &top = begin()[topSlot];
-
-  // Directly add to top slot.
-  if (!top.unused && time == top.time) {
-    return top;
-  }
-
-  // We need to search through the queue for an existing slot only if we're
-  // spawning an event later than the top slot. Adding to an existing slot
-  // scheduled earlier than the top slot should never happens, as then it should
-  // be the top.
-  if (events > 0 && top.time < time) {
-    for (size_t i = 0, e = size(); i < e; ++i) {
-      if (time == begin()[i].time) {
-        return begin()[i];
-      }
-    }
-  }
-
-  // Spawn new event using an existing slot.
+  // Directly return an existing slot with the same timestamp.
+  auto it = slotMap.find(time);
+  if (it != slotMap.end())
+    return slots[it->second];
+
+  // Spawn new event using an existing slot, or generate a new one if we do not
+  // have pre-allocated slots available.
+  unsigned index;
   if (!unused.empty()) {
-    auto firstUnused = unused.pop_back_val();
-    auto &newSlot = begin()[firstUnused];
-    newSlot.unused = false;
-    newSlot.time = time;
-
-    // Update the top of the queue either if it is currently unused or the new
-    // timestamp is earlier than it.
-    if (top.unused || time < top.time)
-      topSlot = firstUnused;
-
-    ++events;
-    return newSlot;
+    index = unused.pop_back_val();
+    slots[index].time = time;
+  } else {
+    index = slots.size();
+    slots.push_back(Slot(time));
   }
 
-  // We do not have pre-allocated slots available, generate a new one.
-  push_back(Slot(time));
+  slotMap.insert({time, index});
+  schedule(index);
 
-  // Update the top of the queue either if it is currently unused or the new
-  // timestamp is earlier than it.
-  if (top.unused || time < top.time)
-    topSlot = size() - 1;
+  // Invalidate the cached top of the queue if the new timestamp is earlier than
+  // it.
+  if (topSlot && time < slots[*topSlot].time)
+    topSlot.reset();
 
   ++events;
-  return back();
+  return slots[index];
 }
 
-const Slot &UpdateQueue::top() {
-  assert(topSlot < size() && "top is pointing out of bounds!");
+void UpdateQueue::schedule(unsigned index) {
+  uint64_t time = slots[index].time.getTime();
+  assert(time >= now && "scheduling a slot in the past!");
+
+  // The level is given by the most significant byte in which the slot's time
+  // differs from the current time of the wheel.
+  unsigned level = time == now ? 0 : Log2_64(time ^ now) / bitsPerLevel;
+  unsigned bucket = (time >> (level * bitsPerLevel)) & (bucketsPerLevel - 1);
+
+  levels[level].buckets[bucket].push_back(index);
+  levels[level].occupied.set(bucket);
+}
+
+unsigned UpdateQueue::getTopIndex() {
+  assert(events > 0 && "the event queue is empty");
+  if (topSlot)
+    return *topSlot;
+
+  // Cascade the first occupied bucket of the lowest occupied level until the
+  // earliest slots land in level 0.
+  while (levels[0].occupied.none()) {
+    unsigned level = 1;
+    while (levels[level].occupied.none())
+      ++level;
+    auto &curr = levels[level];
+    unsigned bucket = curr.occupied.find_first();
+
+    // Advance the wheel to the start of the bucket's time range. Every slot in
+    // the bucket is now closer to the current time and moves to a lower level.
+    unsigned shift = level * bitsPerLevel;
+    uint64_t highMask =
+        level + 1 == numLevels ? 0 : ~0ULL << (shift + bitsPerLevel);
+    now = (now & highMask) | (uint64_t(bucket) << shift);
+
+    auto indices = std::move(curr.buckets[bucket]);
+    curr.buckets[bucket].clear();
+    curr.occupied.reset(bucket);
+    for (auto index : indices)
+      schedule(index);
+  }
 
+  // All the slots in the first occupied bucket of level 0 share the same real
+  // time, pick the one with the earliest delta and epsilon.
+  const auto &bucket = levels[0].buckets[levels[0].occupied.find_first()];
+  topSlot = *std::min_element(
+      bucket.begin(), bucket.end(),
+      [&](unsigned a, unsigned b) { return slots[a] < slots[b]; });
+  return *topSlot;
+}
+
+const Slot &UpdateQueue::top() {
   // Sort the changes of the top slot such that all changes to the same signal
   // are in succession.
-  auto &top = begin()[topSlot];
+  auto &top = slots[getTopIndex()];
   llvm::sort(top.changes.begin(), top.changes.begin() + top.changesSize);
   return top;
 }
 
 void UpdateQueue::pop() {
+  unsigned index = getTopIndex();
+  auto &curr = slots[index];
+
+  // Remove the slot from its level-0 bucket and advance the wheel to its time.
+  now = curr.time.getTime();
+  unsigned bucketIndex = now & (bucketsPerLevel - 1);
+  auto &bucket = levels[0].buckets[bucketIndex];
+  auto it = llvm::find(bucket, index);
+  assert(it != bucket.end() && "top slot not found in the timing wheel!");
+  *it = bucket.back();
+  bucket.pop_back();
+  if (bucket.empty())
+    levels[0].occupied.reset(bucketIndex);
+  slotMap.erase(curr.time);
+
   // Reset internal structures and decrease the event counter.
-  auto &curr = begin()[topSlot];
-  curr.unused = true;
   curr.changesSize = 0;
   curr.scheduled.clear();
   curr.changes.clear();
@@ -179,16 +297,17 @@ void UpdateQueue::pop() {
   --events;
 
   // Add to unused slots list for easy retrieval.
-  unused.push_back(topSlot);
-
-  // Update the current top of the queue.
-  topSlot = std::distance(
-      begin(),
-      std::min_element(begin(), end(), [](const auto &a, const auto &b) {
-        // a is "smaller" than b if either a's timestamp is earlier than b's, or
-        // b is unused (i.e. b has no actual meaning).
-        return !a.unused && (a < b || b.unused);
-      }));
+  unused.push_back(index);
+  topSlot.reset();
+}
+
+SmallVector<const Slot *, 8> UpdateQueue::getPendingSlots() const {
+  SmallVector<const Slot *, 8> pending;
+  for (auto &entry : slotMap)
+    pending.push_back(&slots[entry.second]);
+  llvm::sort(pending,
+             [](const Slot *a, const Slot *b) { return a->time < b->time; });
+  return pending;
 }
 
 //===----------------------------------------------------------------------===//
@@ -223,10 +342,49 @@ Slot State::popQueue() {
 
 void State::pushQueue(Time t, unsigned inst) {
   Time newTime = time + t;
+  if (auto *staged = getStagedEvents()) {
+    staged->wakeups.push_back({newTime, inst});
+    return;
+  }
   queue.insertOrUpdate(newTime, inst);
   instances[inst].expectedWakeup = newTime;
 }
 
+void State::pushDrive(Time t, int index, int bitOffset, const uint8_t *bytes,
+                      unsigned width) {
+  auto *staged = getStagedEvents();
+  if (!staged) {
+    queue.insertOrUpdate(t, index, bitOffset, bytes, width);
+    return;
+  }
+
+  // Copy the driven value, as the bytes are only valid for the duration of the
+  // call.
+  auto size = llvm::divideCeil(width, 8);
+  staged->drives.push_back({t, index, bitOffset, width, staged->bytes.size()});
+  staged->bytes.append(bytes, bytes + size);
+}
+
+StagedEvents *State::getStagedEvents() {
+  if (staging.empty())
+    return nullptr;
+  auto id = std::this_thread::get_id();
+  for (auto &entry : staging)
+    if (entry.first == id)
+      return entry.second;
+  return nullptr;
+}
+
+void State::commitStagedEvents(const StagedEvents &events) {
+  for (const auto &drive : events.drives)
+    queue.insertOrUpdate(drive.time, drive.index, drive.bitOffset,
+                         events.bytes.data() + drive.byteOffset, drive.width);
+  for (auto [wakeupTime, inst] : events.wakeups) {
+    queue.insertOrUpdate(wakeupTime, inst);
+    instances[inst].expectedWakeup = wakeupTime;
+  }
+}
+
 llvm::SmallVectorTemplateCommon<Instance>::iterator
 State::getInstanceIterator(std::string instName) {
   auto it =
@@ -243,12 +401,14 @@ int State::addSignal(std::string name, std::string owner) {
   return signals.size() - 1;
 }
 
-void State::addProcPtr(std::string name, ProcState *procStatePtr) {
+void State::addProcPtr(std::string name, ProcState *procStatePtr,
+                       uint64_t size) {
   auto it = getInstanceIterator(name);
 
   // Store instance index in process state.
   procStatePtr->inst = it - instances.begin();
   (*it).procState = procStatePtr;
+  (*it).procStateSize = size;
 }
 
 int State::addSignalData(int index, std::string owner, uint8_t *value,
@@ -12,6 +12,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "circt/Dialect/LLHD/Simulator/Trace.h"
+#include "circt/Dialect/LLHD/Simulator/BinaryTrace.h"
 
 #include "llvm/Support/raw_ostream.h"
 
@@ -23,12 +24,14 @@ Trace::Trace(std::unique_ptr<State> const &state, llvm::raw_ostream &out,
   auto root = state->root;
   for (auto &sig : state->signals) {
     bool done = (mode != TraceMode::Full && mode != TraceMode::Merged &&
-                 !sig.isOwner(root)) ||
+                 mode != TraceMode::Binary && !sig.isOwner(root)) ||
                 (mode == TraceMode::NamedOnly && sig.isValidSigName());
     isTraced.push_back(!done);
   }
 }
 
+Trace::~Trace() = default;
+
 //===----------------------------------------------------------------------===//
 // Changes gathering methods
 //===----------------------------------------------------------------------===//
@@ -87,6 +90,13 @@ void Trace::addChange(unsigned sigIndex) {
     } else if (mode == TraceMode::Merged || mode == TraceMode::MergedReduce ||
                mode == TraceMode::NamedOnly) {
       addChangeMerged(sigIndex);
+    } else if (mode == TraceMode::Binary) {
+      // The signal table is only complete once the simulation started.
+      if (!binaryWriter)
+        binaryWriter = std::make_unique<BinaryTraceWriter>(out, *state);
+      auto &sig = state->signals[sigIndex];
+      binaryWriter->addChange(state->time, sigIndex, sig.getValue(),
+                              sig.getSize());
     }
   }
 }
@@ -122,9 +132,13 @@ void Trace::flush(bool force) {
   if (mode == TraceMode::Full || mode == TraceMode::Reduced)
     flushFull();
   else if (mode == TraceMode::Merged || mode == TraceMode::MergedReduce ||
-           mode == TraceMode::NamedOnly)
+           mode == TraceMode::NamedOnly) {
     if (state->time.getTime() > currentTime.getTime() || force)
       flushMerged();
+  } else if (mode == TraceMode::Binary && force && !binaryWriter) {
+    // Always emit the signal table, even if no change was recorded.
+    binaryWriter = std::make_unique<BinaryTraceWriter>(out, *state);
+  }
 }
 
 void Trace::flushFull() {
@@ -41,16 +41,24 @@ void addSigStructElement(State *state, unsigned index, unsigned offset,
   state->addSignalElement(index, offset, size);
 }
 
-void allocProc(State *state, char *owner, ProcState *procState) {
+void allocProc(State *state, char *owner, ProcState *procState,
+               uint64_t size) {
   assert(state && "alloc_proc: state not found");
   std::string sOwner(owner);
-  state->addProcPtr(sOwner, procState);
+  state->addProcPtr(sOwner, procState, size);
 }
 
-void allocEntity(State *state, char *owner, uint8_t *entityState) {
+void addProcSignalSlot(State *state, ProcState *procState, uint64_t offset) {
+  assert(state && "add_proc_signal_slot: state not found");
+  state->instances[procState->inst].procSignalSlots.push_back(offset);
+}
+
+void allocEntity(State *state, char *owner, uint8_t *entityState,
+                 uint64_t size) {
   assert(state && "alloc_entity: state not found");
   auto it = state->getInstanceIterator(owner);
   (*it).entityState = entityState;
+  (*it).entityStateSize = size;
 }
 
 void driveSignal(State *state, SignalDetail *detail, uint8_t *value,
@@ -64,8 +72,8 @@ void driveSignal(State *state, SignalDetail *detail, uint8_t *value,
       (detail->value - state->signals[globalIndex].getValue()) * 8 + offset;
 
   // Spawn a new event.
-  state->queue.insertOrUpdate(state->time + Time(time, delta, eps), globalIndex,
-                              bitOffset, value, width);
+  state->pushDrive(state->time + Time(time, delta, eps), globalIndex, bitOffset,
+                   value, width);
 }
 
 void llhdSuspend(State *state, ProcState *procState, int time, int delta,
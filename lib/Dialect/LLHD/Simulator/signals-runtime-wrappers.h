@@ -36,13 +36,20 @@ void addSigArrayElements(circt::llhd::sim::State *state, unsigned index,
 void addSigStructElement(circt::llhd::sim::State *state, unsigned index,
                          unsigned offset, unsigned size);
 
-/// Add allocated constructs to a process instance.
+/// Add allocated constructs, of the given size in bytes, to a process instance.
 void allocProc(circt::llhd::sim::State *state, char *owner,
-               circt::llhd::sim::ProcState *procState);
+               circt::llhd::sim::ProcState *procState, uint64_t size);
 
-/// Add allocated entity state to the given instance.
+/// Register the persisted signal struct at the given byte offset in the state
+/// of a process, which must have been added by allocProc.
+void addProcSignalSlot(circt::llhd::sim::State *state,
+                       circt::llhd::sim::ProcState *procState,
+                       uint64_t offset);
+
+/// Add allocated entity state, of the given size in bytes, to the given
+/// instance.
 void allocEntity(circt::llhd::sim::State *state, char *owner,
-                 uint8_t *entityState);
+                 uint8_t *entityState, uint64_t size);
 
 /// Drive a value onto a signal.
 void driveSignal(circt::llhd::sim::State *state,
@@ -0,0 +1,49 @@
+// RUN: circt-opt %s --lower-arc-to-llvm=profile=true | FileCheck %s
+
+// The model has a counter for its clock function and one for the arc it calls,
+// each taking up two words in the profile buffer.
+
+// CHECK: llvm.mlir.global external @Top_profile(dense<0> : tensor<4xi64>)
+// CHECK-SAME: !llvm.array<4 x i64>
+// CHECK: llvm.func @llvm.readcyclecounter() -> i64
+
+arc.define @Inc(%arg0: i8) -> i8 {
+  %c1_i8 = hw.constant 1 : i8
+  %0 = comb.add %arg0, %c1_i8 : i8
+  arc.output %0 : i8
+}
+
+// CHECK-LABEL: llvm.func @Top_clock(
+func.func @Top_clock(%arg0: !arc.storage<1>) {
+  // CHECK-NEXT: [[START:%.+]] = llvm.call @llvm.readcyclecounter()
+  %0 = arc.storage.get %arg0[0] : !arc.storage<1> -> !arc.state<i8>
+  %1 = arc.state_read %0 : <i8>
+
+  // CHECK: [[CALL_START:%.+]] = llvm.call @llvm.readcyclecounter()
+  // CHECK-NEXT: llvm.call @Inc(
+  // CHECK-NEXT: [[CALL_END:%.+]] = llvm.call @llvm.readcyclecounter()
+  // CHECK-NEXT: [[CALL_CYCLES:%.+]] = llvm.sub [[CALL_END]], [[CALL_START]]
+  // CHECK: llvm.mlir.addressof @Top_profile
+  // CHECK: llvm.getelementptr {{%.+}}[0, 2]
+  // CHECK: [[PTR:%.+]] = llvm.getelementptr {{%.+}}[0, 3]
+  // CHECK-NEXT: [[OLD:%.+]] = llvm.load [[PTR]]
+  // CHECK-NEXT: [[NEW:%.+]] = llvm.add [[OLD]], [[CALL_CYCLES]]
+  // CHECK-NEXT: llvm.store [[NEW]], [[PTR]]
+  %2 = arc.call @Inc(%1) : (i8) -> i8
+  arc.state_write %0 = %2 : <i8>
+
+  // CHECK: [[END:%.+]] = llvm.call @llvm.readcyclecounter()
+  // CHECK-NEXT: [[CYCLES:%.+]] = llvm.sub [[END]], [[START]]
+  // CHECK: llvm.getelementptr {{%.+}}[0, 0]
+  // CHECK: [[PTR:%.+]] = llvm.getelementptr {{%.+}}[0, 1]
+  // CHECK-NEXT: [[OLD:%.+]] = llvm.load [[PTR]]
+  // CHECK-NEXT: [[NEW:%.+]] = llvm.add [[OLD]], [[CYCLES]]
+  // CHECK-NEXT: llvm.store [[NEW]], [[PTR]]
+  // CHECK-NEXT: llvm.return
+  return
+}
+
+arc.model "Top" {
+^bb0(%arg0: !arc.storage<1>):
+  func.call @Top_clock(%arg0) : (!arc.storage<1>) -> ()
+}
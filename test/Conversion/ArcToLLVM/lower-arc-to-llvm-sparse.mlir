@@ -0,0 +1,68 @@
+// RUN: circt-opt %s --lower-arc-to-llvm | FileCheck %s
+
+// Sparse memories hold a table of page pointers in the model state. Writes
+// allocate missing pages, and reads of missing pages produce zero.
+
+// CHECK: llvm.func @calloc(i64, i64) -> !llvm.ptr<i8>
+
+// CHECK-LABEL: llvm.func @SparseMemory(%arg0: !llvm.ptr<i8>, %arg1: i12, %arg2: i1)
+func.func @SparseMemory(%arg0: !arc.storage<32>, %addr: i12, %enable: i1) {
+  %0 = arc.alloc_memory %arg0 {offset = 0, stride = 4} : (!arc.storage<32>) -> !arc.memory<4096 x i32, i12, sparse 1024>
+  // CHECK-NEXT: [[RAW_PTR:%.+]] = llvm.getelementptr %arg0[0]
+  // CHECK-NEXT: [[TABLE:%.+]] = llvm.bitcast [[RAW_PTR]] : !llvm.ptr<i8> to !llvm.ptr<ptr<i32>>
+
+  %1 = arc.memory_read %0[%addr] : <4096 x i32, i12, sparse 1024>
+  // CHECK-NEXT:   [[ADDR:%.+]] = llvm.zext %arg1 : i12 to i64
+  // CHECK-NEXT:   [[DEPTH:%.+]] = llvm.mlir.constant(4096 : i64)
+  // CHECK-NEXT:   [[INBOUNDS:%.+]] = llvm.icmp "ult" [[ADDR]], [[DEPTH]]
+  // CHECK-NEXT:   [[SHIFT:%.+]] = llvm.mlir.constant(10 : i64)
+  // CHECK-NEXT:   [[PAGE_IDX:%.+]] = llvm.lshr [[ADDR]], [[SHIFT]]
+  // CHECK-NEXT:   [[ZERO:%.+]] = llvm.mlir.constant(0 : i64)
+  // CHECK-NEXT:   [[PAGE_IDX2:%.+]] = llvm.select [[INBOUNDS]], [[PAGE_IDX]], [[ZERO]]
+  // CHECK-NEXT:   [[MASK:%.+]] = llvm.mlir.constant(1023 : i64)
+  // CHECK-NEXT:   [[WORD_IDX:%.+]] = llvm.and [[ADDR]], [[MASK]]
+  // CHECK-NEXT:   [[ENTRY:%.+]] = llvm.getelementptr [[TABLE]][[[PAGE_IDX2]]]
+  // CHECK-NEXT:   [[PAGE:%.+]] = llvm.load [[ENTRY]] : !llvm.ptr<ptr<i32>>
+  // CHECK-NEXT:   [[NULL:%.+]] = llvm.mlir.null : !llvm.ptr<i32>
+  // CHECK-NEXT:   [[ALLOCATED:%.+]] = llvm.icmp "ne" [[PAGE]], [[NULL]]
+  // CHECK-NEXT:   [[COND:%.+]] = llvm.and [[INBOUNDS]], [[ALLOCATED]]
+  // CHECK-NEXT:   llvm.cond_br [[COND]], [[BB_LOAD:\^.+]], [[BB_SKIP:\^.+]]
+  // CHECK-NEXT: [[BB_LOAD]]:
+  // CHECK-NEXT:   [[GEP:%.+]] = llvm.getelementptr [[PAGE]][[[WORD_IDX]]]
+  // CHECK-NEXT:   [[TMP:%.+]] = llvm.load [[GEP]]
+  // CHECK-NEXT:   llvm.br [[BB_RESUME:\^.+]]([[TMP]] : i32)
+  // CHECK-NEXT: [[BB_SKIP]]:
+  // CHECK-NEXT:   [[TMP:%.+]] = llvm.mlir.constant
+  // CHECK-NEXT:   llvm.br [[BB_RESUME:\^.+]]([[TMP]] : i32)
+  // CHECK-NEXT: [[BB_RESUME]]([[LOADED:%.+]]: i32):
+
+  arc.memory_write %0[%addr], %1 if %enable : <4096 x i32, i12, sparse 1024>
+  // CHECK:        [[ENTRY:%.+]] = llvm.getelementptr [[TABLE]]
+  // CHECK-NEXT:   [[PAGE:%.+]] = llvm.load [[ENTRY]] : !llvm.ptr<ptr<i32>>
+  // CHECK:        [[COUNT:%.+]] = llvm.mlir.constant(1024 : i64)
+  // CHECK-NEXT:   [[SIZE:%.+]] = llvm.mlir.constant(4 : i64)
+  // CHECK-NEXT:   [[NULL:%.+]] = llvm.mlir.null : !llvm.ptr<i32>
+  // CHECK:        [[MISSING:%.+]] = llvm.icmp "eq" [[PAGE]], [[NULL]]
+  // CHECK-NEXT:   llvm.cond_br [[MISSING]], [[BB_ALLOC:\^.+]], [[BB_KEEP:\^.+]]
+  // CHECK-NEXT: [[BB_ALLOC]]:
+  // CHECK-NEXT:   [[RAW_PAGE:%.+]] = llvm.call @calloc([[COUNT]], [[SIZE]])
+  // CHECK-NEXT:   [[NEW_PAGE:%.+]] = llvm.bitcast [[RAW_PAGE]] : !llvm.ptr<i8> to !llvm.ptr<i32>
+  // CHECK-NEXT:   llvm.store [[NEW_PAGE]], [[ENTRY]]
+  // CHECK-NEXT:   llvm.br [[BB_WRITE:\^.+]]([[NEW_PAGE]] : !llvm.ptr<i32>)
+  // CHECK-NEXT: [[BB_KEEP]]:
+  // CHECK-NEXT:   llvm.br [[BB_WRITE]]([[PAGE]] : !llvm.ptr<i32>)
+  // CHECK-NEXT: [[BB_WRITE]]([[WRITE_PAGE:%.+]]: !llvm.ptr<i32>):
+  // CHECK-NEXT:   [[GEP:%.+]] = llvm.getelementptr [[WRITE_PAGE]]
+  // CHECK-NEXT:   llvm.store [[LOADED]], [[GEP]]
+  return
+}
+
+// The page table of each lane is stored after the one of the previous lane.
+
+// CHECK-LABEL: llvm.func @SparseMemoryLanes(
+func.func @SparseMemoryLanes(%arg0: !arc.storage, %arg1: index) -> !arc.memory<4096 x i32, i12, sparse 1024> {
+  %0 = arc.storage.get %arg0[16] lane %arg1 : !arc.storage -> !arc.memory<4096 x i32, i12, sparse 1024>
+  // CHECK: [[SIZE:%.+]] = llvm.mlir.constant(32 : i64)
+  // CHECK-NEXT: llvm.mul {{%.+}}, [[SIZE]]
+  return %0 : !arc.memory<4096 x i32, i12, sparse 1024>
+}
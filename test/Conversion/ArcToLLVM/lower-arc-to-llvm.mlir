@@ -47,6 +47,26 @@ func.func @StorageTypes(%arg0: !arc.storage) -> (!arc.state<i1>, !arc.memory<4 x
 }
 // CHECK-NEXT: }
 
+// CHECK-LABEL: llvm.func @StorageLanes(
+func.func @StorageLanes(%arg0: !arc.storage, %arg1: index) -> (!arc.state<i16>, !arc.memory<4 x i8, i2>) {
+  %0 = arc.storage.get %arg0[8] lane %arg1 : !arc.storage -> !arc.state<i16>
+  // CHECK: [[OFFSET:%.+]] = llvm.mlir.constant(8 :
+  // CHECK-NEXT: [[PTR:%.+]] = llvm.getelementptr %arg0[[[OFFSET]]]
+  // CHECK: [[SIZE:%.+]] = llvm.mlir.constant(2 : i64)
+  // CHECK-NEXT: [[LANE_OFFSET:%.+]] = llvm.mul {{%.+}}, [[SIZE]]
+  // CHECK-NEXT: [[LANE_PTR:%.+]] = llvm.getelementptr [[PTR]][[[LANE_OFFSET]]]
+  // CHECK-NEXT: llvm.bitcast [[LANE_PTR]] : !llvm.ptr<i8> to !llvm.ptr<i16>
+  %1 = arc.storage.get %arg0[16] lane %arg1 : !arc.storage -> !arc.memory<4 x i8, i2>
+  // CHECK: [[OFFSET:%.+]] = llvm.mlir.constant(16 :
+  // CHECK-NEXT: [[PTR:%.+]] = llvm.getelementptr %arg0[[[OFFSET]]]
+  // CHECK: [[SIZE:%.+]] = llvm.mlir.constant(4 : i64)
+  // CHECK-NEXT: [[LANE_OFFSET:%.+]] = llvm.mul {{%.+}}, [[SIZE]]
+  // CHECK-NEXT: llvm.getelementptr [[PTR]][[[LANE_OFFSET]]]
+  return %0, %1 : !arc.state<i16>, !arc.memory<4 x i8, i2>
+  // CHECK: llvm.return
+}
+// CHECK-NEXT: }
+
 // CHECK-LABEL: llvm.func @StateAllocation(%arg0: !llvm.ptr<i8>) {
 func.func @StateAllocation(%arg0: !arc.storage<10>) {
   arc.root_input "a", %arg0 {offset = 0} : (!arc.storage<10>) -> !arc.state<i1>
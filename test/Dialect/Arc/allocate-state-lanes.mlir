@@ -0,0 +1,22 @@
+// RUN: circt-opt %s --arc-allocate-state=lanes=4 | FileCheck %s
+
+// The offsets are those of a single lane, scaled by the number of lanes such
+// that the copies of each allocation for the other lanes fit in between.
+
+// CHECK-LABEL: arc.model "Lanes" attributes {lanes = 4 : i32}
+arc.model "Lanes" {
+^bb0(%arg0: !arc.storage):
+  // CHECK-NEXT: ([[PTR:%.+]]: !arc.storage<36>):
+  arc.root_input "a", %arg0 : (!arc.storage) -> !arc.state<i1>
+  arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i16>
+  arc.alloc_memory %arg0 : (!arc.storage) -> !arc.memory<4 x i8, i2>
+  // CHECK-NEXT: arc.root_input "a", [[PTR]] {offset = 0 : i32}
+  // CHECK-NEXT: arc.alloc_state [[PTR]] {offset = 8 : i32}
+  // CHECK-NEXT: arc.alloc_memory [[PTR]] {offset = 16 : i32, stride = 1 : i32}
+  // CHECK-NEXT: arc.alloc_storage [[PTR]][32] : (!arc.storage<36>) -> !arc.storage<4>
+  // CHECK-NEXT: arc.passthrough {
+  arc.passthrough {
+    // CHECK-NEXT: arc.alloc_state {{%.+}} {offset = 0 : i32}
+    arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i8>
+  }
+}
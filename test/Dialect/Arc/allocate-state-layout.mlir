@@ -0,0 +1,37 @@
+// RUN: circt-opt %s --arc-allocate-state=optimize-layout=true | FileCheck %s
+
+// The input comes first, followed by the state shared by both clock trees, and
+// the states local to each tree in the order of their first access. Every
+// group starts on a new cache line. Unused states and memories come last.
+
+// CHECK-LABEL: arc.model "Layout"
+arc.model "Layout" {
+^bb0(%arg0: !arc.storage):
+  // CHECK-NEXT: ([[PTR:%.+]]: !arc.storage<260>):
+  %mem = arc.alloc_memory %arg0 : (!arc.storage) -> !arc.memory<4 x i8, i2>
+  %unused = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i8>
+  %b0 = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i8>
+  %a1 = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i8>
+  %shared = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i8>
+  %a0 = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i8>
+  %in = arc.root_input "clk", %arg0 : (!arc.storage) -> !arc.state<i1>
+  // CHECK-NEXT: arc.alloc_memory [[PTR]] {offset = 256 : i32, stride = 1 : i32}
+  // CHECK-NEXT: arc.alloc_state [[PTR]] {offset = 193 : i32}
+  // CHECK-NEXT: arc.alloc_state [[PTR]] {offset = 192 : i32}
+  // CHECK-NEXT: arc.alloc_state [[PTR]] {offset = 129 : i32}
+  // CHECK-NEXT: arc.alloc_state [[PTR]] {offset = 64 : i32}
+  // CHECK-NEXT: arc.alloc_state [[PTR]] {offset = 128 : i32}
+  // CHECK-NEXT: arc.root_input "clk", [[PTR]] {offset = 0 : i32}
+  %clk = arc.state_read %in : <i1>
+  arc.clock_tree %clk {
+    %0 = arc.state_read %a0 : <i8>
+    %1 = arc.state_read %shared : <i8>
+    %2 = comb.add %0, %1 : i8
+    arc.state_write %a1 = %2 : <i8>
+    arc.state_write %a0 = %2 : <i8>
+  }
+  arc.clock_tree %clk {
+    %0 = arc.state_read %shared : <i8>
+    arc.state_write %b0 = %0 : <i8>
+  }
+}
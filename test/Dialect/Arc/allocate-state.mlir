@@ -77,3 +77,14 @@ arc.model "test" {
   }
   // CHECK-NEXT: }
 }
+
+// Sparse memories only allocate their page table in the model state.
+
+// CHECK-LABEL: arc.model "SparseMemory"
+arc.model "SparseMemory" {
+^bb0(%arg0: !arc.storage):
+  // CHECK-NEXT: ([[PTR:%.+]]: !arc.storage<32>):
+  // CHECK-NEXT: arc.alloc_memory [[PTR]] {offset = 0 : i32, stride = 4 : i32}
+  // CHECK-SAME: -> !arc.memory<4096 x i32, i12, sparse 1024>
+  arc.alloc_memory %arg0 : (!arc.storage) -> !arc.memory<4096 x i32, i12, sparse 1024>
+}
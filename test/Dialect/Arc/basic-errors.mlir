@@ -337,3 +337,18 @@ arc.define @outputOpVerifier () -> i32 {
   // expected-note @+1 {{actual type: 'i16'}}
   arc.output %0 : i16
 }
+
+// -----
+
+func.func @storageGetLaneOfStorage(%arg0: !arc.storage<8>, %arg1: index) {
+  // expected-error @+1 {{cannot select a lane of a storage slice}}
+  %0 = arc.storage.get %arg0[0] lane %arg1 : !arc.storage<8> -> !arc.storage<4>
+  return
+}
+
+// -----
+
+// expected-error @+1 {{sparse memory page size must be a power of two}}
+func.func @sparseMemoryPageSize(%arg0: !arc.memory<4096 x i32, i12, sparse 1000>) {
+  return
+}
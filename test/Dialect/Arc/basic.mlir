@@ -145,6 +145,11 @@ hw.module @memoryOps(%clk: i1, %en: i1, %mask: i32) {
 
   // CHECK-NEXT: arc.memory_write [[MEM]][%c0_i32], %c0_i32 : <4 x i32, i32>
   arc.memory_write %mem[%c0_i32], %c0_i32 : <4 x i32, i32>
+
+  // CHECK-NEXT: [[SPARSE:%.+]] = arc.memory <65536 x i32, i32, sparse 1024>
+  %sparse = arc.memory <65536 x i32, i32, sparse 1024>
+  // CHECK-NEXT: arc.memory_read [[SPARSE]][%c0_i32] : <65536 x i32, i32, sparse 1024>
+  %3 = arc.memory_read %sparse[%c0_i32] : <65536 x i32, i32, sparse 1024>
 }
 arc.define @identity(%arg0: i32, %arg1: i32) -> (i32, i32) {
   arc.output %arg0, %arg1 : i32, i32
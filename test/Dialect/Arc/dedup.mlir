@@ -397,3 +397,46 @@ hw.module @OutlineRegression(%a: i1, %b: i3) {
   arc.call @OutlineRegressionA(%a, %b) : (i1, i3) -> (i3, i3)
   arc.call @OutlineRegressionB(%a, %b) : (i1, i3) -> (i3, i3)
 }
+
+//===----------------------------------------------------------------------===//
+
+// Each group of identical arcs is merged into its first arc, independently of
+// the other groups.
+
+// CHECK-LABEL: arc.define @GroupsA1
+arc.define @GroupsA1(%arg0: i4) -> i4 {
+  %0 = comb.add %arg0, %arg0 {Groups} : i4
+  arc.output %0 : i4
+}
+
+// CHECK-LABEL: arc.define @GroupsB1
+arc.define @GroupsB1(%arg0: i4) -> i4 {
+  %0 = comb.mul %arg0, %arg0 {Groups} : i4
+  arc.output %0 : i4
+}
+
+// CHECK-NOT: arc.define @GroupsA2
+arc.define @GroupsA2(%arg0: i4) -> i4 {
+  %0 = comb.add %arg0, %arg0 {Groups} : i4
+  arc.output %0 : i4
+}
+
+// CHECK-NOT: arc.define @GroupsB2
+arc.define @GroupsB2(%arg0: i4) -> i4 {
+  %0 = comb.mul %arg0, %arg0 {Groups} : i4
+  arc.output %0 : i4
+}
+
+// CHECK-LABEL: hw.module @Groups
+hw.module @Groups(%x: i4) {
+  // CHECK-NEXT: arc.state @GroupsA1(%x)
+  // CHECK-NEXT: arc.state @GroupsB1(%x)
+  // CHECK-NEXT: arc.state @GroupsA1(%x)
+  // CHECK-NEXT: arc.state @GroupsB1(%x)
+  %0 = arc.state @GroupsA1(%x) lat 0 : (i4) -> i4
+  %1 = arc.state @GroupsB1(%x) lat 0 : (i4) -> i4
+  %2 = arc.state @GroupsA2(%x) lat 0 : (i4) -> i4
+  %3 = arc.state @GroupsB2(%x) lat 0 : (i4) -> i4
+  // CHECK-NEXT: hw.output
+}
+// CHECK-NEXT: }
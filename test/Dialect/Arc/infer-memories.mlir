@@ -1,4 +1,5 @@
 // RUN: circt-opt %s --arc-infer-memories=tap-ports=0 | FileCheck %s
+// RUN: circt-opt %s --arc-infer-memories="tap-ports=0 sparse-threshold=1024 page-size=256" | FileCheck %s --check-prefix=THRESHOLD
 
 hw.generator.schema @FIRRTLMem, "FIRRTL_Memory", ["depth", "numReadPorts", "numWritePorts", "numReadWritePorts", "readLatency", "writeLatency", "width", "maskGran", "readUnderWrite", "writeUnderWrite", "writeClockIDs"]
 
@@ -8,6 +9,7 @@ hw.module @TestWOMemory(%clock: i1, %addr: i10, %enable: i1, %data: i8) {
   // CHECK-NOT: hw.instance
   // CHECK-NEXT: [[FOO:%.+]] = arc.memory <1024 x i8, i10> {name = "foo"}
   // CHECK-NEXT: arc.memory_write_port [[FOO]], @mem_write{{.*}}(%addr, %data, %enable) clock %clock enable lat 1 : <1024 x i8, i10>, i10, i8, i1
+  // THRESHOLD: arc.memory <1024 x i8, i10, sparse 256> {name = "foo"}
   // CHECK-NEXT: hw.output
   hw.instance "foo" @WOMemory(W0_addr: %addr: i10, W0_en: %enable: i1, W0_clk: %clock: i1, W0_data: %data: i8) -> ()
 }
@@ -91,3 +93,16 @@ hw.module @TestRWMemory(%clock: i1, %addr: i10, %enable: i1, %wmode: i1, %wdata:
 // CHECK-NEXT: }
 // CHECK-NOT: hw.module.generated @RWMemory, @FIRRTLMem
 hw.module.generated @RWMemory, @FIRRTLMem(%RW0_addr: i10, %RW0_en: i1, %RW0_clk: i1, %RW0_wmode: i1, %RW0_wdata: i8) -> (RW0_rdata: i8) attributes {depth = 1024 : i64, maskGran = 8 : ui32, numReadPorts = 0 : ui32, numReadWritePorts = 1 : ui32, numWritePorts = 0 : ui32, readLatency = 0 : ui32, readUnderWrite = 0 : ui32, width = 8 : ui32, writeClockIDs = [], writeLatency = 1 : ui32, writeUnderWrite = 1 : i32}
+
+
+// Instances marked as sparse use sparse storage regardless of their size.
+
+// CHECK-LABEL: hw.module @TestSparseMemory(
+hw.module @TestSparseMemory(%clock: i1, %addr: i16, %enable: i1) -> (data: i8) {
+  // CHECK-NOT: hw.instance
+  // CHECK-NEXT: [[FOO:%.+]] = arc.memory <65536 x i8, i16, sparse 4096> {name = "foo"}
+  // CHECK-NEXT: [[RDATA:%.+]] = arc.memory_read_port [[FOO]][%addr] : <65536 x i8, i16, sparse 4096>
+  %0 = hw.instance "foo" @SparseMemory(R0_addr: %addr: i16, R0_en: %enable: i1, R0_clk: %clock: i1) -> (R0_data: i8) {arc.sparse}
+  hw.output %0 : i8
+}
+hw.module.generated @SparseMemory, @FIRRTLMem(%R0_addr: i16, %R0_en: i1, %R0_clk: i1) -> (R0_data: i8) attributes {depth = 65536 : i64, maskGran = 8 : ui32, numReadPorts = 1 : ui32, numReadWritePorts = 0 : ui32, numWritePorts = 0 : ui32, readLatency = 0 : ui32, readUnderWrite = 0 : ui32, width = 8 : ui32, writeClockIDs = [], writeLatency = 1 : ui32, writeUnderWrite = 1 : i32}
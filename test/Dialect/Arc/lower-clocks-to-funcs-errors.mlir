@@ -1,4 +1,4 @@
-// RUN: circt-opt %s --arc-lower-clocks-to-funcs --verify-diagnostics
+// RUN: circt-opt %s --arc-lower-clocks-to-funcs --split-input-file --verify-diagnostics
 
 arc.model "NonConstExternalValue" {
 ^bb0(%arg0: !arc.storage<42>):
@@ -12,3 +12,18 @@ arc.model "NonConstExternalValue" {
     %1 = comb.sub %0, %0 : i9001
   }
 }
+
+// -----
+
+arc.model "LanesDerivedClock" attributes {lanes = 2 : i32} {
+^bb0(%arg0: !arc.storage<2>):
+  %true = hw.constant true
+  %0 = arc.storage.get %arg0[0] : !arc.storage<2> -> !arc.state<i1>
+  %1 = arc.state_read %0 : <i1>
+  %2 = comb.xor %1, %true : i1
+  // expected-error @+2 {{clock of a model with multiple lanes must be a model input}}
+  // expected-note @+1 {{each lane is clocked by its own copy of the input}}
+  arc.clock_tree %2 {
+    %c0_i8 = hw.constant 0 : i8
+  }
+}
@@ -86,3 +86,63 @@ arc.model "InsertionOrderProblem" {
     }
   }
 }
+
+//===----------------------------------------------------------------------===//
+
+// Models with multiple lanes of state evaluate each clock function once per
+// lane, with all state accesses referring to the current lane.
+
+// CHECK-LABEL: func.func @Lanes_clock(%arg0: !arc.storage<32>) {
+// CHECK-NEXT:    [[C0:%.+]] = arith.constant 0 : index
+// CHECK-NEXT:    [[C4:%.+]] = arith.constant 4 : index
+// CHECK-NEXT:    [[C1:%.+]] = arith.constant 1 : index
+// CHECK-NEXT:    scf.for [[LANE:%.+]] = [[C0]] to [[C4]] step [[C1]] {
+// CHECK-NEXT:      [[SUB:%.+]] = arc.storage.get %arg0[16] : !arc.storage<32> -> !arc.storage<16>
+// CHECK-NEXT:      [[STATE:%.+]] = arc.storage.get [[SUB]][0] lane [[LANE]] : !arc.storage<16> -> !arc.state<i8>
+// CHECK-NEXT:      [[VALUE:%.+]] = arc.state_read [[STATE]] : <i8>
+// CHECK-NEXT:      arc.state_write [[STATE]] = [[VALUE]] : <i8>
+// CHECK-NEXT:    }
+// CHECK-NEXT:    return
+// CHECK-NEXT:  }
+
+// CHECK-LABEL: arc.model "Lanes"
+arc.model "Lanes" attributes {lanes = 4 : i32} {
+^bb0(%arg0: !arc.storage<32>):
+  %true = hw.constant true
+  arc.clock_tree %true {
+    %0 = arc.storage.get %arg0[16] : !arc.storage<32> -> !arc.storage<16>
+    %1 = arc.storage.get %0[0] : !arc.storage<16> -> !arc.state<i8>
+    %2 = arc.state_read %1 : <i8>
+    arc.state_write %1 = %2 : <i8>
+  }
+}
+
+//===----------------------------------------------------------------------===//
+
+// Each lane is clocked by its own copy of the clock input, and lanes whose
+// clock is low are skipped.
+
+// CHECK-LABEL: func.func @LaneClocks_clock(%arg0: !arc.storage<8>) {
+// CHECK:         scf.for [[LANE:%.+]] = {{%.+}} to {{%.+}} step {{%.+}} {
+// CHECK-NEXT:      [[CLOCK:%.+]] = arc.storage.get %arg0[0] lane [[LANE]] : !arc.storage<8> -> !arc.state<i1>
+// CHECK-NEXT:      [[TRIGGER:%.+]] = arc.state_read [[CLOCK]] : <i1>
+// CHECK-NEXT:      scf.if [[TRIGGER]] {
+// CHECK-NEXT:        [[STATE:%.+]] = arc.storage.get %arg0[4] lane [[LANE]] : !arc.storage<8> -> !arc.state<i8>
+// CHECK-NEXT:        [[VALUE:%.+]] = arc.state_read [[STATE]] : <i8>
+// CHECK-NEXT:        arc.state_write [[STATE]] = [[VALUE]] : <i8>
+// CHECK-NEXT:      }
+// CHECK-NEXT:    }
+// CHECK-NEXT:    return
+// CHECK-NEXT:  }
+
+// CHECK-LABEL: arc.model "LaneClocks"
+arc.model "LaneClocks" attributes {lanes = 4 : i32} {
+^bb0(%arg0: !arc.storage<8>):
+  %0 = arc.storage.get %arg0[0] : !arc.storage<8> -> !arc.state<i1>
+  %1 = arc.state_read %0 : <i1>
+  arc.clock_tree %1 {
+    %2 = arc.storage.get %arg0[4] : !arc.storage<8> -> !arc.state<i8>
+    %3 = arc.state_read %2 : <i8>
+    arc.state_write %2 = %3 : <i8>
+  }
+}
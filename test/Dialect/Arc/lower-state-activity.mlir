@@ -0,0 +1,113 @@
+// RUN: circt-opt %s --arc-lower-state="activity-tracking=true activity-min-ops=6" | FileCheck %s
+// RUN: circt-opt %s --arc-lower-state="activity-tracking=true activity-min-ops=6 activity-counters=true" | FileCheck %s --check-prefix=COUNTERS
+
+arc.define @Add(%arg0: i8, %arg1: i8) -> i8 {
+  %0 = comb.add %arg0, %arg1 : i8
+  arc.output %0 : i8
+}
+
+arc.define @Id(%arg0: i8) -> i8 {
+  arc.output %arg0 : i8
+}
+
+// Each state forms its own cluster, which is only evaluated if the inputs it
+// reads differ from the ones seen at its last evaluation. The cluster reading
+// only a single input is too small to be worth tracking.
+
+// CHECK-LABEL: arc.model "Activity"
+hw.module @Activity(%clk: i1, %a: i8, %b: i8, %c: i8) {
+  %0 = arc.state @Add(%a, %b) clock %clk lat 1 : (i8, i8) -> i8
+  %1 = arc.state @Add(%0, %c) clock %clk lat 1 : (i8, i8) -> i8
+  %2 = arc.state @Id(%c) clock %clk lat 1 : (i8) -> i8
+  // CHECK: [[VALID0:%.+]] = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i1>
+  // CHECK-NEXT: [[SHADOWA:%.+]] = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i8>
+  // CHECK-NEXT: [[SHADOWB:%.+]] = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i8>
+  // CHECK-NEXT: [[VALID1:%.+]] = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i1>
+  // CHECK-NEXT: [[SHADOWS0:%.+]] = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i8>
+  // CHECK-NEXT: [[SHADOWC:%.+]] = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i8>
+  // CHECK-NEXT: arc.clock_tree
+  // CHECK-NEXT:   [[TRUE:%.+]] = hw.constant true
+  // CHECK-NEXT:   [[V:%.+]] = arc.state_read [[VALID0]] : <i1>
+  // CHECK-NEXT:   [[NOTV:%.+]] = comb.xor bin [[V]], [[TRUE]] : i1
+  // CHECK-NEXT:   [[A:%.+]] = arc.state_read %in_a : <i8>
+  // CHECK-NEXT:   [[OLDA:%.+]] = arc.state_read [[SHADOWA]] : <i8>
+  // CHECK-NEXT:   [[CHA:%.+]] = comb.icmp bin ne [[A]], [[OLDA]] : i8
+  // CHECK-NEXT:   [[B:%.+]] = arc.state_read %in_b : <i8>
+  // CHECK-NEXT:   [[OLDB:%.+]] = arc.state_read [[SHADOWB]] : <i8>
+  // CHECK-NEXT:   [[CHB:%.+]] = comb.icmp bin ne [[B]], [[OLDB]] : i8
+  // CHECK-NEXT:   [[DIRTY:%.+]] = comb.or bin [[NOTV]], [[CHA]], [[CHB]] : i1
+  // CHECK-NEXT:   scf.if [[DIRTY]] {
+  // CHECK-NEXT:     arc.state_write [[VALID0]] = [[TRUE]] : <i1>
+  // CHECK-NEXT:     arc.state_write [[SHADOWA]] = [[A]] : <i8>
+  // CHECK-NEXT:     arc.state_write [[SHADOWB]] = [[B]] : <i8>
+  // CHECK-NEXT:     [[SUM:%.+]] = arc.state @Add([[A]], [[B]]) lat 0
+  // CHECK-NEXT:     arc.state_write [[S0:%.+]] = [[SUM]] : <i8>
+  // CHECK-NEXT:   }
+  // CHECK-NEXT:   [[C:%.+]] = arc.state_read %in_c : <i8>
+  // CHECK:        scf.if
+  // CHECK:          arc.state @Add
+  // CHECK-NEXT:     arc.state_write
+  // CHECK-NEXT:   }
+  // CHECK-NEXT:   arc.state @Id([[C]])
+  // CHECK-NEXT:   arc.state_write
+  // CHECK-NEXT: }
+}
+
+// Clusters reading a memory are always evaluated.
+
+arc.define @MemRead(%arg0: !arc.memory<4 x i8, i2>, %arg1: i2) -> i8 {
+  %0 = arc.memory_read_port %arg0[%arg1] : <4 x i8, i2>
+  %1 = comb.add %0, %0 : i8
+  arc.output %1 : i8
+}
+
+// CHECK-LABEL: arc.model "MemoryReader"
+hw.module @MemoryReader(%clk: i1, %addr: i2) {
+  %mem = arc.memory <4 x i8, i2>
+  %0 = arc.state @MemRead(%mem, %addr) clock %clk lat 1 : (!arc.memory<4 x i8, i2>, i2) -> i8
+  // CHECK: arc.clock_tree
+  // CHECK-NOT: scf.if
+  // CHECK: }
+}
+
+// Skipping a write to a memory is only safe if nothing else writes the same
+// address in the meantime, which another clock tree may do. Clusters writing a
+// memory are therefore always evaluated.
+
+arc.define @MemWrite(%arg0: i2, %arg1: i8) -> (i2, i8) {
+  %0 = comb.add %arg1, %arg1 : i8
+  %1 = comb.mul %0, %arg1 : i8
+  %2 = comb.xor %1, %0 : i8
+  arc.output %arg0, %2 : i2, i8
+}
+
+// CHECK-LABEL: arc.model "MemoryWriters"
+hw.module @MemoryWriters(%clk0: i1, %clk1: i1, %addr: i2, %a: i8, %b: i8) {
+  %mem = arc.memory <4 x i8, i2>
+  arc.memory_write_port %mem, @MemWrite(%addr, %a) clock %clk0 lat 1 : <4 x i8, i2>, i2, i8
+  arc.memory_write_port %mem, @MemWrite(%addr, %b) clock %clk1 lat 1 : <4 x i8, i2>, i2, i8
+  // CHECK: arc.clock_tree
+  // CHECK-NOT: scf.if
+  // CHECK: arc.memory_write
+  // CHECK: arc.clock_tree
+  // CHECK-NOT: scf.if
+  // CHECK: arc.memory_write
+  // CHECK-NOT: scf.if
+  // CHECK: }
+}
+
+// COUNTERS-LABEL: arc.model "Activity"
+// COUNTERS: [[CHECKS:%.+]] = arc.alloc_state %arg0 {name = "activity/checks"} : (!arc.storage) -> !arc.state<i64>
+// COUNTERS: [[SKIPS:%.+]] = arc.alloc_state %arg0 {name = "activity/skips"} : (!arc.storage) -> !arc.state<i64>
+// COUNTERS: arc.clock_tree
+// COUNTERS:   [[ONE:%.+]] = hw.constant 1 : i64
+// COUNTERS-NEXT:   [[N:%.+]] = arc.state_read [[CHECKS]] : <i64>
+// COUNTERS-NEXT:   [[N1:%.+]] = comb.add bin [[N]], [[ONE]] : i64
+// COUNTERS-NEXT:   arc.state_write [[CHECKS]] = [[N1]] : <i64>
+// COUNTERS-NEXT:   scf.if
+// COUNTERS:        } else {
+// COUNTERS-NEXT:     [[ONE:%.+]] = hw.constant 1 : i64
+// COUNTERS-NEXT:     [[N:%.+]] = arc.state_read [[SKIPS]] : <i64>
+// COUNTERS-NEXT:     [[N1:%.+]] = comb.add bin [[N]], [[ONE]] : i64
+// COUNTERS-NEXT:     arc.state_write [[SKIPS]] = [[N1]] : <i64>
+// COUNTERS-NEXT:   }
@@ -1,10 +1,22 @@
 // RUN: circt-opt %s --arc-make-tables | FileCheck %s
+// RUN: circt-opt %s --arc-make-tables="inline-table-bits=0 min-cost=5" | FileCheck %s --check-prefix=ARRAY
+
+// Tables that fit into 64 bits are shifted out of an integer constant.
 
 // CHECK-LABEL: arc.define @Simple
+// ARRAY-LABEL: arc.define @Simple
 arc.define @Simple(%arg0: i4) -> i4 {
-  // CHECK-NEXT: %0 = hw.aggregate_constant [7 : i4, -2 : i4, -3 : i4, -4 : i4, -5 : i4, -6 : i4, -7 : i4, -8 : i4, 7 : i4, 6 : i4, 5 : i4, 4 : i4, 3 : i4, 2 : i4, 1 : i4, 0 : i4] : !hw.array<16xi4>
-  // CHECK-NEXT: hw.array_get %0[%arg0]
-  // CHECK-NEXT: arc.output %1
+  // CHECK-NEXT: [[TABLE:%.+]] = hw.constant 9141386507638288912 : i64
+  // CHECK-NEXT: [[ZEROS:%.+]] = hw.constant 0 : i60
+  // CHECK-NEXT: [[IDX:%.+]] = comb.concat [[ZEROS]], %arg0 : i60, i4
+  // CHECK-NEXT: [[STRIDE:%.+]] = hw.constant 4 : i64
+  // CHECK-NEXT: [[OFF:%.+]] = comb.mul [[IDX]], [[STRIDE]] : i64
+  // CHECK-NEXT: [[SHIFTED:%.+]] = comb.shru [[TABLE]], [[OFF]] : i64
+  // CHECK-NEXT: [[ENTRY:%.+]] = comb.extract [[SHIFTED]] from 0 : (i64) -> i4
+  // CHECK-NEXT: arc.output [[ENTRY]]
+  // ARRAY-NEXT: %0 = hw.aggregate_constant [7 : i4, -2 : i4, -3 : i4, -4 : i4, -5 : i4, -6 : i4, -7 : i4, -8 : i4, 7 : i4, 6 : i4, 5 : i4, 4 : i4, 3 : i4, 2 : i4, 1 : i4, 0 : i4] : !hw.array<16xi4>
+  // ARRAY-NEXT: hw.array_get %0[%arg0]
+  // ARRAY-NEXT: arc.output %1
   %c0_i3 = hw.constant 0 : i3
   %c0_i2 = hw.constant 0 : i2
   %false = hw.constant false
@@ -33,10 +45,50 @@ arc.define @Simple(%arg0: i4) -> i4 {
   arc.output %21 : i4
 }
 // CHECK-NEXT: }
+// ARRAY-NEXT: }
+
+// All outputs are packed into a single table entry, with the first output in
+// the lowest bits.
+
+// CHECK-LABEL: arc.define @Packed
+// ARRAY-LABEL: arc.define @Packed
+arc.define @Packed(%arg0: i2, %arg1: i1) -> (i1, i2) {
+  // CHECK-NOT: hw.aggregate_constant
+  // ARRAY-NEXT: [[IDX:%.+]] = comb.concat %arg1, %arg0 : i1, i2
+  // ARRAY-NEXT: [[TABLE:%.+]] = hw.aggregate_constant [1 : i3, -1 : i3, -1 : i3, 1 : i3, -3 : i3, -2 : i3, 2 : i3, 0 : i3] : !hw.array<8xi3>
+  // ARRAY-NEXT: [[ENTRY:%.+]] = hw.array_get [[TABLE]]{{\[}}[[IDX]]{{\]}}
+  // ARRAY-NEXT: [[OUT0:%.+]] = comb.extract [[ENTRY]] from 0 : (i3) -> i1
+  // ARRAY-NEXT: [[OUT1:%.+]] = comb.extract [[ENTRY]] from 1 : (i3) -> i2
+  // ARRAY-NEXT: arc.output [[OUT0]], [[OUT1]]
+  %0 = comb.extract %arg0 from 1 : (i2) -> i1
+  %1 = comb.extract %arg0 from 0 : (i2) -> i1
+  %2 = comb.xor %0, %arg1 : i1
+  %3 = comb.and %1, %2 : i1
+  %4 = comb.concat %3, %0 : i1, i1
+  %5 = comb.add %4, %arg0 : i2
+  %6 = comb.or %3, %arg1 : i1
+  arc.output %6, %5 : i1, i2
+}
+
+// Logic that is not more expensive than the table lookup is left alone.
+
+// CHECK-LABEL: arc.define @Cheap
+// ARRAY-LABEL: arc.define @Cheap
+arc.define @Cheap(%arg0: i2, %arg1: i2) -> (i1, i1, i2) {
+  // ARRAY-NOT: hw.aggregate_constant
+  %0 = comb.extract %arg0 from 0 : (i2) -> i1
+  %1 = comb.extract %arg1 from 1 : (i2) -> i1
+  %2 = comb.xor %arg0, %arg1 : i2
+  %3 = comb.and %arg0, %2 : i2
+  %4 = comb.or %3, %arg1 : i2
+  arc.output %0, %1, %4 : i1, i1, i2
+}
 
 // CHECK-LABEL: arc.define @TooManyBits
+// ARRAY-LABEL: arc.define @TooManyBits
 arc.define @TooManyBits(%arg0: i30) -> i30 {
   // CHECK-NOT: hw.aggregate_constant
+  // ARRAY-NOT: hw.aggregate_constant
   %0 = comb.and %arg0, %arg0 : i30
   %1 = comb.add %arg0, %0 : i30
   %2 = comb.and %arg0, %1 : i30
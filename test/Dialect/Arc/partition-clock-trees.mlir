@@ -0,0 +1,109 @@
+// RUN: circt-opt %s --arc-partition-clock-trees=num-tasks=2 | FileCheck %s
+
+// The two counters are independent of each other, so they end up in separate
+// clock trees. The constant is copied into the new tree.
+
+// CHECK-LABEL: arc.model "Independent"
+arc.model "Independent" {
+^bb0(%arg0: !arc.storage):
+  %clk = arc.root_input "clk", %arg0 : (!arc.storage) -> !arc.state<i1>
+  %0 = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i8>
+  %1 = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i8>
+  %2 = arc.state_read %clk : <i1>
+  // CHECK: [[CLK:%.+]] = arc.state_read
+  // CHECK-NEXT: arc.clock_tree [[CLK]] {
+  // CHECK-NEXT:   [[C1:%.+]] = hw.constant 1 : i8
+  // CHECK-NEXT:   [[A:%.+]] = arc.state_read %0
+  // CHECK-NEXT:   [[A1:%.+]] = comb.add [[A]], [[C1]]
+  // CHECK-NEXT:   arc.state_write %0 = [[A1]]
+  // CHECK-NEXT: }
+  // CHECK-NEXT: arc.clock_tree [[CLK]] {
+  // CHECK-NEXT:   [[C1:%.+]] = hw.constant 1 : i8
+  // CHECK-NEXT:   [[B:%.+]] = arc.state_read %1
+  // CHECK-NEXT:   [[B1:%.+]] = comb.add [[B]], [[C1]]
+  // CHECK-NEXT:   arc.state_write %1 = [[B1]]
+  // CHECK-NEXT: }
+  arc.clock_tree %2 {
+    %c1_i8 = hw.constant 1 : i8
+    %3 = arc.state_read %0 : <i8>
+    %4 = comb.add %3, %c1_i8 : i8
+    arc.state_write %0 = %4 : <i8>
+    %5 = arc.state_read %1 : <i8>
+    %6 = comb.add %5, %c1_i8 : i8
+    arc.state_write %1 = %6 : <i8>
+  }
+}
+
+// States read by one group and written by another must stay in the same tree,
+// since the order of the accesses matters. States that are only read can be
+// shared across trees.
+
+// CHECK-LABEL: arc.model "Dependent"
+arc.model "Dependent" {
+^bb0(%arg0: !arc.storage):
+  %clk = arc.root_input "clk", %arg0 : (!arc.storage) -> !arc.state<i1>
+  %in = arc.root_input "in", %arg0 : (!arc.storage) -> !arc.state<i8>
+  %0 = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i8>
+  %1 = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i8>
+  %2 = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i8>
+  %3 = arc.state_read %clk : <i1>
+  // CHECK: arc.clock_tree
+  // CHECK-NEXT:   arc.state_read %in_in
+  // CHECK-NEXT:   arc.state_write %0
+  // CHECK-NEXT:   arc.state_read %0
+  // CHECK-NEXT:   arc.state_write %1
+  // CHECK-NEXT: }
+  // CHECK-NEXT: arc.clock_tree
+  // CHECK-NEXT:   arc.state_read %in_in
+  // CHECK-NEXT:   arc.state_write %2
+  // CHECK-NEXT: }
+  // CHECK-NOT: arc.clock_tree
+  arc.clock_tree %3 {
+    %4 = arc.state_read %in : <i8>
+    arc.state_write %0 = %4 : <i8>
+    %5 = arc.state_read %0 : <i8>
+    arc.state_write %1 = %5 : <i8>
+    %6 = arc.state_read %in : <i8>
+    arc.state_write %2 = %6 : <i8>
+  }
+}
+
+// Components are balanced across the tasks by the number of operations,
+// including the operations of called arcs.
+
+arc.define @Heavy(%arg0: i8) -> i8 {
+  %0 = comb.mul %arg0, %arg0 : i8
+  %1 = comb.mul %0, %0 : i8
+  %2 = comb.mul %1, %1 : i8
+  arc.output %2 : i8
+}
+
+// CHECK-LABEL: arc.model "Balanced"
+arc.model "Balanced" {
+^bb0(%arg0: !arc.storage):
+  %clk = arc.root_input "clk", %arg0 : (!arc.storage) -> !arc.state<i1>
+  %0 = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i8>
+  %1 = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i8>
+  %2 = arc.alloc_state %arg0 : (!arc.storage) -> !arc.state<i8>
+  %3 = arc.state_read %clk : <i1>
+  // CHECK: arc.clock_tree
+  // CHECK-NEXT:   arc.state_read %0
+  // CHECK-NEXT:   arc.call @Heavy
+  // CHECK-NEXT:   arc.state_write %0
+  // CHECK-NEXT: }
+  // CHECK-NEXT: arc.clock_tree
+  // CHECK-NEXT:   arc.state_read %1
+  // CHECK-NEXT:   arc.state_write %1
+  // CHECK-NEXT:   arc.state_read %2
+  // CHECK-NEXT:   arc.state_write %2
+  // CHECK-NEXT: }
+  arc.clock_tree %3 {
+    %4 = arc.state_read %0 : <i8>
+    %5 = arc.call @Heavy(%4) : (i8) -> i8
+    arc.state_write %0 = %5 : <i8>
+    %6 = arc.state_read %1 : <i8>
+    arc.state_write %1 = %6 : <i8>
+    %7 = arc.state_read %2 : <i8>
+    arc.state_write %2 = %7 : <i8>
+  }
+}
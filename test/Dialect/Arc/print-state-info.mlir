@@ -44,4 +44,53 @@ arc.model "Bar" {
   // CHECK-NEXT: "numBits": 1337
   // CHECK-NEXT: "type": "wire"
   arc.alloc_state %arg0 tap {name = "z", offset = 92} : (!arc.storage<9001>) -> !arc.state<i1337>
+
+  // CHECK:      "name": "w"
+  // CHECK-NEXT: "offset": 264
+  // CHECK-NEXT: "numBits": 32
+  // CHECK-NEXT: "type": "memory"
+  // CHECK-NEXT: "stride": 4
+  // CHECK-NEXT: "depth": 65536
+  // CHECK-NEXT: "pageWords": 1024
+  arc.alloc_memory %arg0 {name = "w", offset = 264, stride = 4} : (!arc.storage<9001>) -> !arc.memory<65536 x i32, i16, sparse 1024>
+}
+
+// Every clock and passthrough function has a profile counter, followed by one
+// counter for every arc it calls.
+
+arc.define @Inc(%arg0: i8) -> i8 {
+  %c1_i8 = hw.constant 1 : i8
+  %0 = comb.add %arg0, %c1_i8 : i8
+  arc.output %0 : i8
+}
+
+// CHECK-LABEL: "name": "Baz"
+// CHECK:      "profile": [
+// CHECK-NEXT:   {
+// CHECK-NEXT:     "kind": "clock",
+// CHECK-NEXT:     "function": 0
+// CHECK-NEXT:   },
+// CHECK-NEXT:   {
+// CHECK-NEXT:     "kind": "arc",
+// CHECK-NEXT:     "name": "Inc",
+// CHECK-NEXT:     "function": 0
+// CHECK-NEXT:   },
+// CHECK-NEXT:   {
+// CHECK-NEXT:     "kind": "passthrough",
+// CHECK-NEXT:     "function": 1
+// CHECK-NEXT:   }
+// CHECK-NEXT: ]
+arc.model "Baz" {
+^bb0(%arg0: !arc.storage<2>):
+  %in = arc.root_input "clk", %arg0 {offset = 0} : (!arc.storage<2>) -> !arc.state<i1>
+  %0 = arc.alloc_state %arg0 {offset = 1} : (!arc.storage<2>) -> !arc.state<i8>
+  %1 = arc.state_read %in : <i1>
+  arc.clock_tree %1 {
+    %2 = arc.state_read %0 : <i8>
+    %3 = arc.call @Inc(%2) : (i8) -> i8
+    %4 = arc.call @Inc(%3) : (i8) -> i8
+    arc.state_write %0 = %4 : <i8>
+  }
+  arc.passthrough {
+  }
 }
@@ -0,0 +1,26 @@
+// REQUIRES: llhd-sim
+// RUN: llhd-sim %s -n 10 -r Foo --trace-format=binary -o %t.trace -shared-libs=%shlibdir/libcirct-llhd-signals-runtime-wrappers%shlibext
+// RUN: llhd-sim %t.trace -trace-to-vcd | FileCheck %s
+
+// CHECK:      $timescale 1ps $end
+// CHECK-NEXT: $scope module Foo $end
+// CHECK-NEXT: $var wire 1 ! toggle $end
+// CHECK-NEXT: $upscope $end
+// CHECK-NEXT: $enddefinitions $end
+// CHECK-NEXT: #0
+// CHECK-NEXT: b0 !
+// CHECK-NEXT: #1000
+// CHECK-NEXT: b1 !
+// CHECK-NEXT: #2000
+// CHECK-NEXT: b0 !
+// CHECK:      #9000
+// CHECK-NEXT: b1 !
+llhd.entity @Foo () -> () {
+  %0 = hw.constant 0 : i1
+  %toggle = llhd.sig "toggle" %0 : i1
+  %1 = llhd.prb %toggle : !llhd.sig<i1>
+  %allset = hw.constant 1 : i1
+  %2 = comb.xor %1, %allset : i1
+  %dt = llhd.constant_time #llhd.time<1ns, 0d, 0e>
+  llhd.drv %toggle, %2 after %dt : !llhd.sig<i1>
+}
@@ -0,0 +1,75 @@
+// REQUIRES: llhd-sim
+// RUN: llhd-sim %s -r Foo -T 2500 -checkpoint=%t.ckpt -shared-libs=%shlibdir/libcirct-llhd-signals-runtime-wrappers%shlibext | FileCheck %s --check-prefix=FIRST
+// RUN: llhd-sim %s -r Foo -T 5000 -restore=%t.ckpt -shared-libs=%shlibdir/libcirct-llhd-signals-runtime-wrappers%shlibext | FileCheck %s --check-prefix=RESUMED
+// RUN: not llhd-sim %s -r Bar -restore=%t.ckpt -shared-libs=%shlibdir/libcirct-llhd-signals-runtime-wrappers%shlibext 2>&1 | FileCheck %s --check-prefix=MISMATCH
+// RUN: llhd-sim %s -r Baz -T 2500 -checkpoint=%t.baz.ckpt -shared-libs=%shlibdir/libcirct-llhd-signals-runtime-wrappers%shlibext | FileCheck %s --check-prefix=SLICE-FIRST
+// RUN: llhd-sim %s -r Baz -T 4000 -restore=%t.baz.ckpt -shared-libs=%shlibdir/libcirct-llhd-signals-runtime-wrappers%shlibext | FileCheck %s --check-prefix=SLICE-RESUMED
+
+// FIRST: 0ps 0d 0e  Foo/counter/s  0x00
+// FIRST-NEXT: 0ps 0d 0e  Foo/s  0x00
+// FIRST-NEXT: 1000ps 0d 0e  Foo/counter/s  0x01
+// FIRST-NEXT: 1000ps 0d 0e  Foo/s  0x01
+// FIRST-NEXT: 2000ps 0d 0e  Foo/counter/s  0x02
+// FIRST-NEXT: 2000ps 0d 0e  Foo/s  0x02
+// FIRST-NOT: Foo
+
+// The resumed simulation starts with the values at the checkpoint, and the
+// process continues counting from its persisted value.
+// RESUMED: 2000ps 0d 0e  Foo/counter/s  0x02
+// RESUMED-NEXT: 2000ps 0d 0e  Foo/s  0x02
+// RESUMED-NEXT: 3000ps 0d 0e  Foo/counter/s  0x03
+// RESUMED-NEXT: 3000ps 0d 0e  Foo/s  0x03
+// RESUMED-NEXT: 4000ps 0d 0e  Foo/counter/s  0x04
+// RESUMED-NEXT: 4000ps 0d 0e  Foo/s  0x04
+// RESUMED-NEXT: 5000ps 0d 0e  Foo/counter/s  0x05
+// RESUMED-NEXT: 5000ps 0d 0e  Foo/s  0x05
+// RESUMED-NOT: Foo
+
+// MISMATCH: Failed to restore {{.*}}: the checkpoint was taken from a different design
+
+// The signal pointer persisted by the process is relocated to the signal value
+// of the resumed simulation.
+// SLICE-FIRST: 2000ps 0d 0e  Baz/s  0x0200
+// SLICE-RESUMED: 2000ps 0d 0e  Baz/s  0x0200
+// SLICE-RESUMED: 3000ps 0d 0e  Baz/s  0x0300
+// SLICE-RESUMED: 4000ps 0d 0e  Baz/s  0x0400
+llhd.entity @Foo () -> () {
+  %0 = hw.constant 0 : i8
+  %s = llhd.sig "s" %0 : i8
+  llhd.inst "counter" @counter () -> (%s) : () -> (!llhd.sig<i8>)
+}
+
+llhd.proc @counter () -> (%s : !llhd.sig<i8>) {
+  %c1 = hw.constant 1 : i8
+  cf.br ^loop(%c1 : i8)
+^loop(%v : i8):
+  %t = llhd.constant_time #llhd.time<1ns, 0d, 0e>
+  llhd.drv %s, %v after %t : !llhd.sig<i8>
+  %one = hw.constant 1 : i8
+  %n = comb.add %v, %one : i8
+  llhd.wait for %t, ^loop(%n : i8)
+}
+
+llhd.entity @Bar () -> () {
+  %0 = hw.constant 0 : i8
+  %s = llhd.sig "s" %0 : i8
+}
+
+llhd.entity @Baz () -> () {
+  %0 = hw.constant 0 : i16
+  %s = llhd.sig "s" %0 : i16
+  llhd.inst "upper" @upper () -> (%s) : () -> (!llhd.sig<i16>)
+}
+
+llhd.proc @upper () -> (%s : !llhd.sig<i16>) {
+  %c8 = hw.constant 8 : i4
+  %hi = llhd.sig.extract %s from %c8 : (!llhd.sig<i16>) -> !llhd.sig<i8>
+  %c1 = hw.constant 1 : i8
+  cf.br ^loop(%c1 : i8)
+^loop(%v : i8):
+  %t = llhd.constant_time #llhd.time<1ns, 0d, 0e>
+  llhd.drv %hi, %v after %t : !llhd.sig<i8>
+  %one = hw.constant 1 : i8
+  %n = comb.add %v, %one : i8
+  llhd.wait for %t, ^loop(%n : i8)
+}
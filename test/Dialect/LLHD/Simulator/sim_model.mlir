@@ -0,0 +1,33 @@
+// REQUIRES: llhd-sim
+// RUN: rm -f %t.o
+// RUN: llhd-sim %s -n 1 -r Foo -emit-model=%t.o -shared-libs=%shlibdir/libcirct-llhd-signals-runtime-wrappers%shlibext
+// RUN: test -s %t.o
+// RUN: llhd-sim %s -n 4 -r Foo -load-model=%t.o -shared-libs=%shlibdir/libcirct-llhd-signals-runtime-wrappers%shlibext | FileCheck %s
+// RUN: not llhd-sim %s -n 4 -r Bar -load-model=%t.o -shared-libs=%shlibdir/libcirct-llhd-signals-runtime-wrappers%shlibext 2>&1 | FileCheck %s --check-prefix=MISMATCH
+// RUN: not llhd-sim %s -n 4 -r Foo -load-model=%t.missing.o -shared-libs=%shlibdir/libcirct-llhd-signals-runtime-wrappers%shlibext 2>&1 | FileCheck %s --check-prefix=MISSING
+// RUN: touch %t.empty.o
+// RUN: not llhd-sim %s -n 4 -r Foo -load-model=%t.empty.o -shared-libs=%shlibdir/libcirct-llhd-signals-runtime-wrappers%shlibext 2>&1 | FileCheck %s --check-prefix=EMPTY
+// RUN: not llhd-sim %s -n 4 -r Foo -O0 -load-model=%t.o -shared-libs=%shlibdir/libcirct-llhd-signals-runtime-wrappers%shlibext 2>&1 | FileCheck %s --check-prefix=MISMATCH
+
+// CHECK: 0ps 0d 0e  Foo/toggle  0x00
+// CHECK-NEXT: 1000ps 0d 0e  Foo/toggle  0x01
+// CHECK-NEXT: 2000ps 0d 0e  Foo/toggle  0x00
+// CHECK-NEXT: 3000ps 0d 0e  Foo/toggle  0x01
+
+// MISSING: failed to load the precompiled model {{.*}}.missing.o
+// EMPTY: failed to load the precompiled model {{.*}}: the model file is empty
+// MISMATCH: failed to load the precompiled model {{.*}}: the model was compiled from a different design
+llhd.entity @Foo () -> () {
+  %0 = hw.constant 0 : i1
+  %toggle = llhd.sig "toggle" %0 : i1
+  %1 = llhd.prb %toggle : !llhd.sig<i1>
+  %allset = hw.constant 1 : i1
+  %2 = comb.xor %1, %allset : i1
+  %dt = llhd.constant_time #llhd.time<1ns, 0d, 0e>
+  llhd.drv %toggle, %2 after %dt : !llhd.sig<i1>
+}
+
+llhd.entity @Bar () -> () {
+  %0 = hw.constant 0 : i1
+  %toggle = llhd.sig "toggle" %0 : i1
+}
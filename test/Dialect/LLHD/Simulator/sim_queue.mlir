@@ -0,0 +1,47 @@
+// REQUIRES: llhd-sim
+// RUN: llhd-sim %s -shared-libs=%shlibdir/libcirct-llhd-signals-runtime-wrappers%shlibext | FileCheck %s
+
+// Drives scheduled out of order and far apart in time, such that the events
+// are spread over multiple levels of the event queue's timing wheel.
+
+// CHECK: 0ps 0d 0e  root/a  0x00
+// CHECK-NEXT: 0ps 0d 0e  root/b  0x00
+// CHECK-NEXT: 0ps 0d 0e  root/c  0x00
+// CHECK-NEXT: 0ps 0d 0e  root/proc/a  0x00
+// CHECK-NEXT: 0ps 0d 0e  root/proc/b  0x00
+// CHECK-NEXT: 0ps 0d 0e  root/proc/c  0x00
+// CHECK-NEXT: 1ps 0d 0e  root/c  0x01
+// CHECK-NEXT: 1ps 0d 0e  root/proc/c  0x01
+// CHECK-NEXT: 1ps 0d 1e  root/c  0x02
+// CHECK-NEXT: 1ps 0d 1e  root/proc/c  0x02
+// CHECK-NEXT: 300ps 0d 0e  root/b  0x01
+// CHECK-NEXT: 300ps 0d 0e  root/proc/b  0x01
+// CHECK-NEXT: 65536ps 0d 0e  root/b  0x02
+// CHECK-NEXT: 65536ps 0d 0e  root/proc/b  0x02
+// CHECK-NEXT: 70000000ps 0d 0e  root/a  0x01
+// CHECK-NEXT: 70000000ps 0d 0e  root/proc/a  0x01
+llhd.entity @root () -> () {
+  %0 = hw.constant 0 : i8
+  %a = llhd.sig "a" %0 : i8
+  %b = llhd.sig "b" %0 : i8
+  %c = llhd.sig "c" %0 : i8
+  llhd.inst "proc" @proc () -> (%a, %b, %c) : () -> (!llhd.sig<i8>, !llhd.sig<i8>, !llhd.sig<i8>)
+}
+
+llhd.proc @proc () -> (%a : !llhd.sig<i8>, %b : !llhd.sig<i8>, %c : !llhd.sig<i8>) {
+  cf.br ^drive
+^drive:
+  %1 = hw.constant 1 : i8
+  %2 = hw.constant 2 : i8
+  %t0 = llhd.constant_time #llhd.time<70000ns, 0d, 0e>
+  %t1 = llhd.constant_time #llhd.time<65536ps, 0d, 0e>
+  %t2 = llhd.constant_time #llhd.time<300ps, 0d, 0e>
+  %t3 = llhd.constant_time #llhd.time<1ps, 0d, 1e>
+  %t4 = llhd.constant_time #llhd.time<1ps, 0d, 0e>
+  llhd.drv %a, %1 after %t0 : !llhd.sig<i8>
+  llhd.drv %b, %2 after %t1 : !llhd.sig<i8>
+  llhd.drv %b, %1 after %t2 : !llhd.sig<i8>
+  llhd.drv %c, %2 after %t3 : !llhd.sig<i8>
+  llhd.drv %c, %1 after %t4 : !llhd.sig<i8>
+  llhd.halt
+}
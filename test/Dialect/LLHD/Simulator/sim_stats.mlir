@@ -0,0 +1,25 @@
+// REQUIRES: llhd-sim
+// RUN: llhd-sim %s -sim-stats --trace-format=none -shared-libs=%shlibdir/libcirct-llhd-signals-runtime-wrappers%shlibext 2>&1 | FileCheck %s
+
+// The process only observes %b, so the change of %a only wakes up the root.
+// CHECK: Instance wakeups: 5
+// CHECK-NEXT: Suppressed wakeups: 1
+llhd.entity @root () -> () {
+  %0 = hw.constant 0 : i8
+  %a = llhd.sig "a" %0 : i8
+  %b = llhd.sig "b" %0 : i8
+  llhd.inst "proc" @proc () -> (%a, %b) : () -> (!llhd.sig<i8>, !llhd.sig<i8>)
+}
+
+llhd.proc @proc () -> (%a : !llhd.sig<i8>, %b : !llhd.sig<i8>) {
+  cf.br ^drive
+^drive:
+  %1 = hw.constant 1 : i8
+  %t0 = llhd.constant_time #llhd.time<0ns, 0d, 1e>
+  %t1 = llhd.constant_time #llhd.time<0ns, 0d, 2e>
+  llhd.drv %a, %1 after %t0 : !llhd.sig<i8>
+  llhd.drv %b, %1 after %t1 : !llhd.sig<i8>
+  llhd.wait (%b : !llhd.sig<i8>), ^end
+^end:
+  llhd.halt
+}
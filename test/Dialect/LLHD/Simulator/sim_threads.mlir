@@ -0,0 +1,39 @@
+// REQUIRES: llhd-sim
+// RUN: llhd-sim %s -threads=1 -shared-libs=%shlibdir/libcirct-llhd-signals-runtime-wrappers%shlibext | FileCheck %s
+// RUN: llhd-sim %s -threads=4 -shared-libs=%shlibdir/libcirct-llhd-signals-runtime-wrappers%shlibext | FileCheck %s
+
+// Both processes drive the same signal in the same delta cycle. The drives have
+// to be committed in instance order regardless of the number of threads, such
+// that the drive of the last instance always wins.
+
+// CHECK: 0ps 0d 0e  root/a/s  0x00
+// CHECK-NEXT: 0ps 0d 0e  root/b/s  0x00
+// CHECK-NEXT: 0ps 0d 0e  root/s  0x00
+// CHECK-NEXT: 0ps 0d 1e  root/a/s  0x02
+// CHECK-NEXT: 0ps 0d 1e  root/b/s  0x02
+// CHECK-NEXT: 0ps 0d 1e  root/s  0x02
+// CHECK-NOT: root
+llhd.entity @root () -> () {
+  %0 = hw.constant 0 : i8
+  %s = llhd.sig "s" %0 : i8
+  llhd.inst "a" @drive1 () -> (%s) : () -> (!llhd.sig<i8>)
+  llhd.inst "b" @drive2 () -> (%s) : () -> (!llhd.sig<i8>)
+}
+
+llhd.proc @drive1 () -> (%s : !llhd.sig<i8>) {
+  cf.br ^drive
+^drive:
+  %1 = hw.constant 1 : i8
+  %t = llhd.constant_time #llhd.time<0ns, 0d, 1e>
+  llhd.drv %s, %1 after %t : !llhd.sig<i8>
+  llhd.halt
+}
+
+llhd.proc @drive2 () -> (%s : !llhd.sig<i8>) {
+  cf.br ^drive
+^drive:
+  %1 = hw.constant 2 : i8
+  %t = llhd.constant_time #llhd.time<0ns, 0d, 1e>
+  llhd.drv %s, %1 after %t : !llhd.sig<i8>
+  llhd.halt
+}
@@ -0,0 +1,32 @@
+// RUN: printf 'a b\n1 2\n1 2\n3 2\n3 2\n' > %t.stim
+// RUN: arcilator %s --run --stimulus=%t.stim | FileCheck %s
+// RUN: arcilator %s --run --stimulus=%t.stim --activity-tracking --activity-stats 2>&1 | FileCheck %s --check-prefixes=CHECK,STATS
+
+// Skipping the logic while its inputs are stable must not change the result.
+// CHECK:      cycle 0: x=0x1ff
+// CHECK-NEXT: cycle 1: x=0x1ff
+// CHECK-NEXT: cycle 2: x=0x5fd
+// CHECK-NEXT: cycle 3: x=0x5fd
+
+// The register's logic only runs in the first cycle and once the inputs change.
+// STATS: Skipped 2 of 4 evaluations of activity-tracked logic (50.0%)
+hw.module @Activity(%clock: i1, %a: i32, %b: i32) -> (x: i32) {
+  %0 = comb.mul %a, %b : i32
+  %1 = comb.add %0, %a : i32
+  %2 = comb.mul %1, %b : i32
+  %3 = comb.add %2, %a : i32
+  %4 = comb.mul %3, %b : i32
+  %5 = comb.add %4, %a : i32
+  %6 = comb.mul %5, %b : i32
+  %7 = comb.add %6, %a : i32
+  %8 = comb.mul %7, %b : i32
+  %9 = comb.add %8, %a : i32
+  %10 = comb.mul %9, %b : i32
+  %11 = comb.add %10, %a : i32
+  %12 = comb.mul %11, %b : i32
+  %13 = comb.add %12, %a : i32
+  %14 = comb.mul %13, %b : i32
+  %15 = comb.add %14, %a : i32
+  %x = seq.compreg %15, %clock : i32
+  hw.output %x : i32
+}
@@ -0,0 +1,20 @@
+// RUN: arcilator %s --lanes=4 --state-file=%t.json | FileCheck %s
+// RUN: FileCheck %s --check-prefix=STATE < %t.json
+// RUN: not arcilator %s --lanes=4 --run 2>&1 | FileCheck %s --check-prefix=RUNERR
+
+// The clock function evaluates the counter of every lane.
+// CHECK-LABEL: define void @Counter_clock(ptr %0)
+// CHECK:         phi i64
+// CHECK:         icmp slt i64 {{%.+}}, 4
+
+// STATE:      "name": "Counter"
+// STATE-NEXT: "numStateBytes": {{[0-9]+}}
+// STATE-NEXT: "numLanes": 4
+
+// RUNERR: error: --run does not support multiple lanes
+hw.module @Counter(%clock: i1) -> (count: i8) {
+  %c1_i8 = hw.constant 1 : i8
+  %0 = comb.add %count, %c1_i8 : i8
+  %count = seq.compreg %0, %clock : i8
+  hw.output %count : i8
+}
@@ -0,0 +1,17 @@
+// RUN: arcilator %s --run --cycles=4 --profile 2>&1 | FileCheck %s
+// RUN: arcilator %s --profile | FileCheck %s --check-prefix=LLVM
+
+// The clock function runs once per cycle, and calls the counter's arc once.
+// CHECK:      cycle 3: count=0x4
+// CHECK:      Profile of `Counter`
+// CHECK-DAG:  {{^ +4 +[0-9]+ +[0-9.]+  clock function 0$}}
+// CHECK-DAG:  {{^ +4 +[0-9]+ +[0-9.]+  arc .+$}}
+
+// LLVM: @Counter_profile = global [{{[0-9]+}} x i64] zeroinitializer
+// LLVM: call i64 @llvm.readcyclecounter()
+hw.module @Counter(%clock: i1) -> (count: i8) {
+  %c1_i8 = hw.constant 1 : i8
+  %0 = comb.add %count, %c1_i8 : i8
+  %count = seq.compreg %0, %clock : i8
+  hw.output %count : i8
+}
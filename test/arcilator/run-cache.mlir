@@ -0,0 +1,20 @@
+// RUN: rm -rf %t.cache
+// RUN: arcilator %s --run --cycles=3 --jit-cache-dir=%t.cache 2> %t.cold.log | FileCheck %s
+// RUN: FileCheck %s --check-prefix=COLD < %t.cold.log
+// RUN: arcilator %s --run --cycles=3 --jit-cache-dir=%t.cache 2> %t.warm.log | FileCheck %s
+// RUN: FileCheck %s --check-prefix=WARM < %t.warm.log
+
+// The second run loads every partition of the unchanged model from the cache,
+// which must not change the simulation result.
+// CHECK:      cycle 0: count=0x3
+// CHECK-NEXT: cycle 1: count=0x6
+// CHECK-NEXT: cycle 2: count=0x9
+
+// COLD: Reused 0 of {{[1-9][0-9]*}} model partitions from the JIT cache
+// WARM: Reused [[N:[1-9][0-9]*]] of [[N]] model partitions from the JIT cache
+hw.module @Counter(%clock: i1) -> (count: i8) {
+  %c3_i8 = hw.constant 3 : i8
+  %0 = comb.add %count, %c3_i8 : i8
+  %count = seq.compreg %0, %clock : i8
+  hw.output %count : i8
+}
@@ -0,0 +1,22 @@
+// RUN: arcilator %s --run --cycles=4 | FileCheck %s
+// RUN: arcilator %s --run --cycles=4 --threads=2 | FileCheck %s
+// RUN: arcilator %s --until-after=state-alloc --emit-mlir --threads=2 | FileCheck %s --check-prefix=SEQUENTIAL
+
+// The two counters are independent and evaluated on separate threads, which
+// must not change the simulation result.
+// CHECK:      cycle 0: up=0x1 down=0xff
+// CHECK-NEXT: cycle 1: up=0x2 down=0xfe
+// CHECK-NEXT: cycle 2: up=0x3 down=0xfd
+// CHECK-NEXT: cycle 3: up=0x4 down=0xfc
+
+// Clock trees are only partitioned for the in-process simulation.
+// SEQUENTIAL-COUNT-1: arc.clock_tree
+// SEQUENTIAL-NOT: arc.clock_tree
+hw.module @Counters(%clock: i1) -> (up: i8, down: i8) {
+  %c1_i8 = hw.constant 1 : i8
+  %0 = comb.add %up, %c1_i8 : i8
+  %1 = comb.sub %down, %c1_i8 : i8
+  %up = seq.compreg %0, %clock : i8
+  %down = seq.compreg %1, %clock : i8
+  hw.output %up, %down : i8, i8
+}
@@ -0,0 +1,41 @@
+// RUN: printf 'en # enable\n1\n1\n0\n1\n' > %t.stim
+// RUN: arcilator %s --run --stimulus=%t.stim --cycles=6 --vcd=%t.vcd | FileCheck %s
+// RUN: FileCheck %s --check-prefix=VCD < %t.vcd
+// RUN: printf 'clock en\n0 1\n1 1\n0 1\n1 0\n0 1\n1 1\n' > %t.clocked.stim
+// RUN: arcilator %s --run --stimulus=%t.clocked.stim | FileCheck %s --check-prefix=CLOCKED
+// RUN: printf 'en\n2\n' > %t.bad.stim
+// RUN: not arcilator %s --run --stimulus=%t.bad.stim 2>&1 | FileCheck %s --check-prefix=BAD
+
+// The clock is not driven by the stimulus, so it rises once per cycle, and the
+// last stimulus line stays in effect for the additional cycles.
+// CHECK:      cycle 0: count=0x1
+// CHECK-NEXT: cycle 1: count=0x2
+// CHECK-NEXT: cycle 2: count=0x2
+// CHECK-NEXT: cycle 3: count=0x3
+// CHECK-NEXT: cycle 4: count=0x4
+// CHECK-NEXT: cycle 5: count=0x5
+
+// VCD: $scope module Counter $end
+// VCD-DAG: $var wire 1 {{.+}} clock $end
+// VCD-DAG: $var wire 1 {{.+}} en $end
+// VCD-DAG: $var wire 8 {{.+}} count [7:0] $end
+// VCD: $enddefinitions $end
+// VCD: #0
+// VCD: #1
+
+// The clock is driven by the stimulus and only rises on every other line.
+// CLOCKED:      cycle 0: count=0x0
+// CLOCKED-NEXT: cycle 1: count=0x1
+// CLOCKED-NEXT: cycle 2: count=0x1
+// CLOCKED-NEXT: cycle 3: count=0x1
+// CLOCKED-NEXT: cycle 4: count=0x1
+// CLOCKED-NEXT: cycle 5: count=0x2
+
+// BAD: error: value `2` does not fit input `en`
+hw.module @Counter(%clock: i1, %en: i1) -> (count: i8) {
+  %c1_i8 = hw.constant 1 : i8
+  %0 = comb.add %count, %c1_i8 : i8
+  %1 = comb.mux %en, %0, %count : i8
+  %count = seq.compreg %1, %clock : i8
+  hw.output %count : i8
+}
@@ -46,10 +46,21 @@ class StateInfo:
   typ: StateType
   stride: Optional[int]
   depth: Optional[int]
+  pageWords: Optional[int]
 
   def decode(d: dict) -> "StateInfo":
     return StateInfo(d["name"], d["offset"], d["numBits"], StateType(d["type"]),
-                     d.get("stride"), d.get("depth"))
+                     d.get("stride"), d.get("depth"), d.get("pageWords"))
+
+
+@dataclass
+class ProfileCounter:
+  kind: str
+  name: Optional[str]
+  function: int
+
+  def decode(d: dict) -> "ProfileCounter":
+    return ProfileCounter(d["kind"], d.get("name"), d["function"])
 
 
 @dataclass
@@ -59,17 +70,34 @@ class StateHierarchy:
   children: List["StateHierarchy"]
 
 
+# A 64 bit FNV-1a hash of the state layout of a model, used to check that a
+# snapshot is restored into a model with the same layout.
+def layout_hash(d: dict) -> int:
+  keys = ("name", "numStateBytes", "numLanes", "states")
+  layout = {k: d.get(k) for k in keys}
+  h = 0xcbf29ce484222325
+  for byte in json.dumps(layout, sort_keys=True).encode():
+    h = ((h ^ byte) * 0x100000001b3) & 0xffffffffffffffff
+  return h
+
+
 @dataclass
 class ModelInfo:
   name: str
   numStateBytes: int
+  numLanes: int
+  layoutHash: int
   states: List[StateInfo]
+  profile: List[ProfileCounter]
   io: List[StateInfo]
   hierarchy: List[StateHierarchy]
+  sparse: List[StateInfo]
 
   def decode(d: dict) -> "ModelInfo":
-    return ModelInfo(d["name"], d["numStateBytes"],
-                     [StateInfo.decode(d) for d in d["states"]], list(), list())
+    return ModelInfo(d["name"], d["numStateBytes"], d.get("numLanes", 1),
+                     layout_hash(d), [StateInfo.decode(d) for d in d["states"]],
+                     [ProfileCounter.decode(d) for d in d.get("profile", [])],
+                     list(), list(), list())
 
 
 with open(args.state_json, "r") as f:
@@ -121,7 +149,11 @@ def group_state_by_hierarchy(
 for model in models:
   internal = list()
   for state in model.states:
-    if state.typ != StateType.INPUT and state.typ != StateType.OUTPUT:
+    # The words of sparse memories are not part of the state, so they cannot be
+    # exposed in the views.
+    if state.pageWords:
+      model.sparse.append(state)
+    elif state.typ != StateType.INPUT and state.typ != StateType.OUTPUT:
       internal.append(state)
     else:
       model.io.append(state)
@@ -155,6 +187,16 @@ def format_hierarchy(hierarchy: StateHierarchy) -> str:
   return f"Hierarchy{{\"{hierarchy.name}\", {len(hierarchy.states)}, {len(hierarchy.children)}, (Signal[]){states}, (Hierarchy[]){children}}}"
 
 
+def format_profile_counter(counter: ProfileCounter) -> str:
+  name = f"\"{counter.name}\"" if counter.name else "nullptr"
+  return f"ProfileCounter{{ProfileCounter::{counter.kind.capitalize()}, {name}, {counter.function}}}"
+
+
+def format_sparse_memory(state: StateInfo) -> str:
+  num_pages = (state.depth + state.pageWords - 1) // state.pageWords
+  return f"SparseMemory{{\"{state.name}\", {state.offset}, {num_pages}, {state.pageWords * state.stride}}}"
+
+
 def state_cpp_type_nonmemory(state: StateInfo) -> str:
   for bits, ty in [(8, "uint8_t"), (16, "uint16_t"), (32, "uint32_t"),
                    (64, "uint64_t")]:
@@ -205,18 +247,28 @@ def format_view_hierarchy(hierarchy: StateHierarchy, depth: int) -> str:
   return f"struct {{{lines}}}"
 
 
-def state_cpp_ref(state: StateInfo) -> str:
+# The number of bytes each lane's copy of a state occupies.
+def state_lane_size(state: StateInfo) -> int:
+  if state.typ == StateType.MEMORY:
+    return state.stride * state.depth
+  return (state.numBits + 7) // 8
+
+
+def state_cpp_ref(state: StateInfo, lanes: int) -> str:
+  if lanes > 1:
+    return f"*({state_cpp_type(state)}*)(state+{state.offset}+lane*{state_lane_size(state)})"
   return f"*({state_cpp_type(state)}*)(state+{state.offset})"
 
 
-def format_view_constructor(hierarchy: StateHierarchy, depth: int) -> str:
+def format_view_constructor(hierarchy: StateHierarchy, depth: int,
+                            lanes: int) -> str:
   lines = []
   for state in hierarchy.states:
-    lines.append(f".{clean_name(state.name)} = {state_cpp_ref(state)}")
+    lines.append(f".{clean_name(state.name)} = {state_cpp_ref(state, lanes)}")
   if depth > 0:
     for child in hierarchy.children:
       lines.append(
-          f".{clean_name(child.name)} = {indent(format_view_constructor(child, depth-1))}"
+          f".{clean_name(child.name)} = {indent(format_view_constructor(child, depth-1, lanes))}"
       )
   lines = ",\n  ".join(lines)
   if lines:
@@ -242,6 +294,8 @@ for model in models:
   print('extern "C" {')
   print(f"void {model.name}_clock(void* state);")
   print(f"void {model.name}_passthrough(void* state);")
+  # Only present if the model was lowered with profiling enabled.
+  print(f"__attribute__((weak)) extern uint64_t {model.name}_profile[];")
   print('}')
 
   # Generate the model layout.
@@ -251,8 +305,16 @@ for model in models:
   print(f"  static const char *name;")
   print(f"  static const unsigned numStates;")
   print(f"  static const unsigned numStateBytes;")
+  print(f"  static const unsigned numLanes;")
+  print(f"  static const uint64_t layoutHash;")
   print(f"  static const std::array<Signal, {len(model.io)}> io;")
   print(f"  static const Hierarchy hierarchy;")
+  print(
+      f"  static const std::array<ProfileCounter, {len(model.profile)}> profile;"
+  )
+  print(
+      f"  static const std::array<SparseMemory, {len(model.sparse)}> sparseMemories;"
+  )
   print("};")
   print()
   print(f"const char *{model.name}Layout::name = \"{model.name}\";")
@@ -260,6 +322,10 @@ for model in models:
   print(
       f"const unsigned {model.name}Layout::numStateBytes = {model.numStateBytes};"
   )
+  print(f"const unsigned {model.name}Layout::numLanes = {model.numLanes};")
+  print(
+      f"const uint64_t {model.name}Layout::layoutHash = {model.layoutHash:#x}ULL;"
+  )
   print(
       f"const std::array<Signal, {len(model.io)}> {model.name}Layout::io = {{")
   for io in model.io:
@@ -269,6 +335,20 @@ for model in models:
   print(
       f"const Hierarchy {model.name}Layout::hierarchy = {indent(format_hierarchy(model.hierarchy[0]))};"
   )
+  print()
+  print(
+      f"const std::array<ProfileCounter, {len(model.profile)}> {model.name}Layout::profile = {{"
+  )
+  for counter in model.profile:
+    print(f"  {format_profile_counter(counter)},")
+  print("};")
+  print()
+  print(
+      f"const std::array<SparseMemory, {len(model.sparse)}> {model.name}Layout::sparseMemories = {{"
+  )
+  for state in model.sparse:
+    print(f"  {format_sparse_memory(state)},")
+  print("};")
 
   # Generate the model view.
   print()
@@ -281,27 +361,45 @@ for model in models:
   )
   print("  uint8_t *state;")
   print()
-  print(f"  {model.name}View(uint8_t *state) :")
+  # Views of models with multiple lanes refer to the state of a single lane.
+  if model.numLanes > 1:
+    print(f"  {model.name}View(uint8_t *state, unsigned lane = 0) :")
+  else:
+    print(f"  {model.name}View(uint8_t *state) :")
   for io in model.io:
-    print(f"    {io.name}({state_cpp_ref(io)}),")
+    print(f"    {io.name}({state_cpp_ref(io, model.numLanes)}),")
   print(
-      f"    {model.hierarchy[0].name}({indent(format_view_constructor(model.hierarchy[0], args.view_depth), 2)}),"
+      f"    {model.hierarchy[0].name}({indent(format_view_constructor(model.hierarchy[0], args.view_depth, model.numLanes), 2)}),"
   )
   print("    state(state) {}")
   print("};")
 
   # Generate the convenience wrapper that also allocates storage.
   print()
+  print("// A model instance, owning its state. Instances can neither be copied")
+  print("// nor moved, since the view points into their state; use `snapshot` and")
+  print("// `fork` to duplicate one.")
   print(f"class {model.name} {{")
   print("public:")
-  print(f"  std::vector<uint8_t> storage;")
+  print(f"  StateBuffer storage;")
   print(f"  {model.name}View view;")
   print()
   print(
-      f"  {model.name}() : storage({model.name}Layout::numStateBytes, 0), view(&storage[0]) {{}}"
+      f"  {model.name}() : storage({model.name}Layout::numStateBytes), view(&storage[0]) {{}}"
+  )
+  print(f"  {model.name}(const {model.name} &) = delete;")
+  print(f"  {model.name} &operator=(const {model.name} &) = delete;")
+  print(
+      f"  ~{model.name}() {{ freeSparsePages<{model.name}Layout>(storage.data()); }}"
   )
+  if model.numLanes > 1:
+    print("  // Clocks the lanes whose clock input is high.")
   print(f"  void clock() {{ {model.name}_clock(&storage[0]); }}")
   print(f"  void passthrough() {{ {model.name}_passthrough(&storage[0]); }}")
+  if model.numLanes > 1:
+    print(
+        f"  {model.name}View lane(unsigned i) {{ return {model.name}View(&storage[0], i); }}"
+    )
   print(
       f"  ValueChangeDump<{model.name}Layout> vcd(std::basic_ostream<char> &os) {{"
   )
@@ -310,6 +408,57 @@ for model in models:
   print("    vcd.writeDumpvars();")
   print("    return vcd;")
   print("  }")
+  print(
+      f"  BinaryTrace<{model.name}Layout> trace(std::basic_ostream<char> &os) {{"
+  )
+  print(f"    BinaryTrace<{model.name}Layout> trace(os, &storage[0]);")
+  print("    trace.writeHeader();")
+  print("    trace.writeDumpvars();")
+  print("    return trace;")
+  print("  }")
+  print("  void profileReport(std::basic_ostream<char> &os) {")
+  print(
+      f"    writeProfileReport<{model.name}Layout>(os, {model.name}_profile);")
+  print("  }")
+  # Snapshots hold the entire state, including the memories.
+  print(f"  Snapshot snapshot() const {{")
+  print(
+      f"    Snapshot snapshot({model.name}Layout::layoutHash, storage.data(), storage.size());"
+  )
+  print(f"    forEachSparsePage<{model.name}Layout>(")
+  print("        storage.data(), [&](size_t slot, uint8_t *page, unsigned n) {")
+  print("          snapshot.addPage(slot, page, n);")
+  print("        });")
+  print("    return snapshot;")
+  print("  }")
+  print("  bool restore(const Snapshot &snapshot) {")
+  print(
+      f"    if (!snapshot.matches({model.name}Layout::layoutHash, storage.size()))"
+  )
+  print("      return false;")
+  print(f"    freeSparsePages<{model.name}Layout>(storage.data());")
+  print(
+      "    std::memcpy(storage.data(), snapshot.bytes(), storage.size());")
+  print("    snapshot.restorePages(storage.data());")
+  print("    return true;")
+  print("  }")
+  print(
+      f"  static std::unique_ptr<{model.name}> fork(const Snapshot &snapshot) {{"
+  )
+  print(
+      f"    if (!snapshot.matches({model.name}Layout::layoutHash, {model.name}Layout::numStateBytes))"
+  )
+  print("      return nullptr;")
+  print(
+      f"    return std::unique_ptr<{model.name}>(new {model.name}(snapshot));")
+  print("  }")
+  print()
+  print("private:")
+  print(
+      f"  explicit {model.name}(const Snapshot &snapshot) : storage(snapshot), view(&storage[0]) {{"
+  )
+  print("    snapshot.restorePages(storage.data());")
+  print("  }")
   print("};")
 
   # Generate a port name macro.
@@ -1,11 +1,28 @@
 // NOLINTBEGIN
 #pragma once
+#include <algorithm>
 #include <array>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
 #include <ostream>
+#include <string>
+#include <thread>
 #include <vector>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 struct Signal {
   const char *name;
@@ -25,6 +42,15 @@ struct Hierarchy {
   Hierarchy *children;
 };
 
+/// A counter in the profile buffer of a model lowered with `--profile`. Each
+/// counter occupies two words in the buffer: the number of invocations of its
+/// function or arc, and the number of cycles spent in them.
+struct ProfileCounter {
+  enum Kind { Clock, Passthrough, Arc } kind;
+  const char *name;
+  unsigned function;
+};
+
 template <unsigned N>
 struct Bytes {
   uint8_t byte[N];
@@ -37,107 +63,600 @@ struct Memory {
   } words[Depth];
 };
 
+/// A memory whose words are kept in pages that are allocated on the first write
+/// to one of their words. The model state only holds a table of pointers to the
+/// pages for every lane, which are null for pages that have not been written.
+struct SparseMemory {
+  const char *name;
+  unsigned offset;
+  unsigned numPages;
+  unsigned pageBytes;
+};
+
+/// Call `fn(slot, page, numBytes)` for every allocated page of the sparse
+/// memories of a model, where `slot` is the offset of the page table entry
+/// pointing to the page.
+template <class ModelLayout, typename Fn>
+void forEachSparsePage(const uint8_t *state, Fn fn) {
+  for (unsigned lane = 0; lane < ModelLayout::numLanes; ++lane) {
+    for (const auto &memory : ModelLayout::sparseMemories) {
+      for (unsigned page = 0; page < memory.numPages; ++page) {
+        size_t slot = memory.offset +
+                      (size_t(lane) * memory.numPages + page) * sizeof(void *);
+        uint8_t *bytes;
+        std::memcpy(&bytes, state + slot, sizeof(bytes));
+        if (bytes)
+          fn(slot, bytes, memory.pageBytes);
+      }
+    }
+  }
+}
+
+/// Release the pages of the sparse memories of a model and clear their page
+/// table entries.
 template <class ModelLayout>
-class ValueChangeDump {
+void freeSparsePages(uint8_t *state) {
+  forEachSparsePage<ModelLayout>(
+      state, [&](size_t slot, uint8_t *page, unsigned) {
+        std::free(page);
+        std::memset(state + slot, 0, sizeof(void *));
+      });
+}
+
+/// A saved copy of the state of a model, including the contents of its
+/// memories, tagged with a hash of the layout it was taken from. Copies of a
+/// snapshot share the same bytes. On Linux the bytes are kept in an anonymous
+/// file, such that models forked from the snapshot can map them copy-on-write
+/// and only copy the pages they actually modify. The pages of sparse memories
+/// are held separately and copied when a model is restored or forked.
+class Snapshot {
 public:
-  ValueChangeDump(std::basic_ostream<char> &os, const uint8_t *state)
-      : os(os), state(state) {}
+  Snapshot() = default;
+  Snapshot(uint64_t layoutHash, const uint8_t *state, size_t numBytes)
+      : layoutHash(layoutHash), data(std::make_shared<Data>(numBytes)) {
+    std::memcpy(data->bytes, state, numBytes);
+  }
 
-  void writeHeader(bool withHierarchy = true) {
-    os << "$date\n    October 21, 2015\n$end\n";
-    os << "$version\n    Some cryptic MLIR magic\n$end\n";
-    os << "$timescale 1ns $end\n";
+  uint64_t getLayoutHash() const { return layoutHash; }
+  size_t size() const { return data ? data->numBytes : 0; }
+  const uint8_t *bytes() const { return data ? data->bytes : nullptr; }
 
-    os << "$scope module " << ModelLayout::name << " $end\n";
+  /// Whether the snapshot was taken from a model with the given layout.
+  bool matches(uint64_t hash, size_t numBytes) const {
+    return data && layoutHash == hash && data->numBytes == numBytes;
+  }
 
-    auto writeSignal = [&](const Signal &state) {
-      if (state.type != Signal::Memory) {
-        auto &signal =
-            allocSignal(state, state.offset, (state.numBits + 7) / 8);
-        if (state.type == Signal::Register) {
-          os << "$var reg " << state.numBits << " " << signal.abbrev << " "
-             << state.name;
-        } else {
-          os << "$var wire " << state.numBits << " " << signal.abbrev << " "
-             << state.name;
-        }
-        if (state.numBits > 1)
-          os << " [" << (state.numBits - 1) << ":0]";
-        os << " $end\n";
-      } else {
-        for (unsigned i = 0; i < state.depth; ++i) {
-          auto &signal = allocSignal(state, state.offset + i * state.stride,
-                                     (state.numBits + 7) / 8);
-          os << "$var reg " << state.numBits << " " << signal.abbrev << " "
-             << state.name << "[" << i << "]";
-          if (state.numBits > 1)
-            os << " [" << (state.numBits - 1) << ":0]";
-          os << " $end\n";
+  /// Add a copy of a page of a sparse memory while building the snapshot. The
+  /// page table entry at `slot` is cleared in the snapshot bytes, since the
+  /// page is recreated by `restorePages`.
+  void addPage(size_t slot, const uint8_t *page, size_t numBytes) {
+    std::memset(data->bytes + slot, 0, sizeof(void *));
+    data->pages.push_back({slot, std::vector<uint8_t>(page, page + numBytes)});
+  }
+
+  /// Allocate a copy of every page of a sparse memory in the snapshot, and
+  /// point the page table entries in `state` at them.
+  void restorePages(uint8_t *state) const {
+    if (!data)
+      return;
+    for (const auto &page : data->pages) {
+      auto *bytes = static_cast<uint8_t *>(std::malloc(page.bytes.size()));
+      std::memcpy(bytes, page.bytes.data(), page.bytes.size());
+      std::memcpy(state + page.slot, &bytes, sizeof(bytes));
+    }
+  }
+
+  /// Write the snapshot to a stream, to be read back with `read`.
+  void write(std::ostream &os) const {
+    uint64_t header[4] = {magic, layoutHash, size(),
+                          data ? data->pages.size() : 0};
+    os.write(reinterpret_cast<const char *>(header), sizeof(header));
+    os.write(reinterpret_cast<const char *>(bytes()), size());
+    for (size_t i = 0; i < header[3]; ++i) {
+      const auto &page = data->pages[i];
+      uint64_t pageHeader[2] = {page.slot, page.bytes.size()};
+      os.write(reinterpret_cast<const char *>(pageHeader), sizeof(pageHeader));
+      os.write(reinterpret_cast<const char *>(page.bytes.data()),
+               page.bytes.size());
+    }
+  }
+
+  /// Read a snapshot written by `write`. Returns false if the stream does not
+  /// hold a valid snapshot.
+  static bool read(std::istream &is, Snapshot &snapshot) {
+    uint64_t header[4];
+    if (!is.read(reinterpret_cast<char *>(header), sizeof(header)) ||
+        header[0] != magic)
+      return false;
+    auto data = std::make_shared<Data>(header[2]);
+    if (!is.read(reinterpret_cast<char *>(data->bytes), header[2]))
+      return false;
+    for (uint64_t i = 0; i < header[3]; ++i) {
+      uint64_t pageHeader[2];
+      if (!is.read(reinterpret_cast<char *>(pageHeader), sizeof(pageHeader)) ||
+          pageHeader[0] + sizeof(void *) > header[2])
+        return false;
+      std::vector<uint8_t> bytes(pageHeader[1]);
+      if (!is.read(reinterpret_cast<char *>(bytes.data()), bytes.size()))
+        return false;
+      data->pages.push_back({pageHeader[0], std::move(bytes)});
+    }
+    snapshot.layoutHash = header[1];
+    snapshot.data = std::move(data);
+    return true;
+  }
+
+  /// Map the bytes of the snapshot copy-on-write, or allocate a copy of them if
+  /// the platform does not support it. Sets `mapped` accordingly, which has to
+  /// be passed to `unmap` to release the bytes again.
+  uint8_t *map(bool &mapped) const {
+#if defined(__linux__)
+    if (data && data->fd >= 0) {
+      void *address = mmap(nullptr, size(), PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE, data->fd, 0);
+      if (address != MAP_FAILED) {
+        mapped = true;
+        return static_cast<uint8_t *>(address);
+      }
+    }
+#endif
+    mapped = false;
+    auto *copy = new uint8_t[size()];
+    std::memcpy(copy, bytes(), size());
+    return copy;
+  }
+
+  static void unmap(uint8_t *address, size_t numBytes, bool mapped) {
+#if defined(__linux__)
+    if (mapped) {
+      munmap(address, numBytes);
+      return;
+    }
+#endif
+    delete[] address;
+  }
+
+private:
+  static constexpr uint64_t magic = 0x3150414e53435241; // "ARCSNAP1"
+
+  /// A copy of a page of a sparse memory.
+  struct Page {
+    size_t slot;
+    std::vector<uint8_t> bytes;
+  };
+
+  /// The bytes of a snapshot, shared by all of its copies.
+  struct Data {
+    explicit Data(size_t numBytes) : numBytes(numBytes) {
+#if defined(__linux__)
+      fd = memfd_create("arcilator-snapshot", MFD_CLOEXEC);
+      if (fd >= 0 && ftruncate(fd, numBytes) == 0) {
+        void *address = mmap(nullptr, numBytes, PROT_READ | PROT_WRITE,
+                             MAP_SHARED, fd, 0);
+        if (address != MAP_FAILED) {
+          bytes = static_cast<uint8_t *>(address);
+          return;
         }
       }
-    };
+      if (fd >= 0)
+        close(fd);
+      fd = -1;
+#endif
+      bytes = new uint8_t[numBytes];
+    }
+    ~Data() {
+#if defined(__linux__)
+      if (fd >= 0) {
+        munmap(bytes, numBytes);
+        close(fd);
+        return;
+      }
+#endif
+      delete[] bytes;
+    }
+    Data(const Data &) = delete;
+    Data &operator=(const Data &) = delete;
 
-    std::function<void(const Hierarchy &)> writeHierarchy =
-        [&](const Hierarchy &hierarchy) {
-          os << "$scope module " << hierarchy.name << " $end\n";
-          for (unsigned i = 0; i < hierarchy.numStates; ++i)
-            writeSignal(hierarchy.states[i]);
-          for (unsigned i = 0; i < hierarchy.numChildren; ++i)
-            writeHierarchy(hierarchy.children[i]);
-          os << "$upscope $end\n";
-        };
+    size_t numBytes;
+    uint8_t *bytes = nullptr;
+    int fd = -1;
+    std::vector<Page> pages;
+  };
 
-    for (auto &port : ModelLayout::io)
-      writeSignal(port);
-    if (withHierarchy)
-      writeHierarchy(ModelLayout::hierarchy);
+  uint64_t layoutHash = 0;
+  std::shared_ptr<Data> data;
+};
 
-    os << "$upscope $end\n";
-    os << "$enddefinitions $end\n";
+/// The zero-initialized state storage of a model, or the copy-on-write state
+/// of a model forked from a snapshot. The buffer can neither be copied nor
+/// moved, and neither can the generated model classes holding one.
+class StateBuffer {
+public:
+  explicit StateBuffer(size_t numBytes)
+      : bytes(new uint8_t[numBytes]()), numBytes(numBytes) {}
+  explicit StateBuffer(const Snapshot &snapshot)
+      : bytes(snapshot.map(mapped)), numBytes(snapshot.size()) {}
+  ~StateBuffer() { Snapshot::unmap(bytes, numBytes, mapped); }
+  StateBuffer(const StateBuffer &) = delete;
+  StateBuffer &operator=(const StateBuffer &) = delete;
+
+  uint8_t *data() { return bytes; }
+  const uint8_t *data() const { return bytes; }
+  size_t size() const { return numBytes; }
+  uint8_t &operator[](size_t i) { return bytes[i]; }
+  const uint8_t &operator[](size_t i) const { return bytes[i]; }
+
+private:
+  bool mapped = false;
+  uint8_t *bytes;
+  size_t numBytes;
+};
+
+/// Tracks which of a set of byte ranges in the model state changed since the
+/// last check. The traced part of the state is diffed against a shadow copy in
+/// blocks of 64 bytes, using vector compares where available, such that only
+/// the ranges overlapping a dirty block have to be looked at individually.
+class StateDiff {
+public:
+  static constexpr unsigned blockSize = 64;
+
+  explicit StateDiff(const uint8_t *state) : state(state) {}
+
+  /// Register a range of bytes to be tracked and return its index.
+  unsigned addRange(unsigned offset, unsigned numBytes) {
+    ranges.push_back(Range{offset, numBytes});
+    finalized = false;
+    return ranges.size() - 1;
   }
 
-  void writeValues(bool includeUnchanged = false) {
-    for (auto &signal : signals) {
-      const uint8_t *valNew = state + signal.offset;
-      uint8_t *valOld = &previousValues[0] + signal.previousOffset;
-      size_t numBytes = (signal.state.numBits + 7) / 8;
-      bool unchanged = std::equal(valNew, valNew + numBytes, valOld);
-      if (unchanged && !includeUnchanged)
+  unsigned getNumRanges() const { return ranges.size(); }
+
+  /// Call `fn` with the index of every range whose bytes differ from the
+  /// shadow copy, or of every range if `all` is set. The ranges are visited in
+  /// order of their offset. Updates the shadow copy afterwards.
+  template <typename Fn>
+  void forEachChanged(Fn fn, bool all = false) {
+    if (!finalized)
+      finalize();
+    if (all) {
+      for (auto index : order)
+        fn(index);
+      std::memcpy(shadow.data(), state, shadow.size());
+      return;
+    }
+    unsigned cursor = 0;
+    for (unsigned block = 0, e = blockFirst.size(); block < e; ++block) {
+      unsigned blockBegin = block * blockSize;
+      unsigned blockBytes =
+          std::min<unsigned>(blockSize, shadow.size() - blockBegin);
+      const uint8_t *current = state + blockBegin;
+      uint8_t *previous = shadow.data() + blockBegin;
+      if (!differs(current, previous, blockBytes))
         continue;
-      if (signal.state.numBits > 1)
-        os << 'b';
-      for (unsigned n = signal.state.numBits; n > 0; --n)
-        os << (valNew[(n - 1) / 8] & (1 << ((n - 1) % 8)) ? '1' : '0');
-      if (signal.state.numBits > 1)
-        os << ' ';
-      os << signal.abbrev << "\n";
-      std::copy(valNew, valNew + numBytes, valOld);
+      // Visit the ranges overlapping this block that have not been visited as
+      // part of an earlier block yet.
+      unsigned i = std::max(cursor, blockFirst[block]);
+      for (; i < order.size(); ++i) {
+        auto &range = ranges[order[i]];
+        if (range.offset >= blockBegin + blockBytes)
+          break;
+        if (std::memcmp(state + range.offset, shadow.data() + range.offset,
+                        range.numBytes) != 0)
+          fn(order[i]);
+      }
+      // Ranges reaching into the next block have already been compared.
+      cursor = i;
+      std::memcpy(previous, current, blockBytes);
+    }
+  }
+
+  /// Whether `numBytes` bytes at `a` and `b` differ.
+  static bool differs(const uint8_t *a, const uint8_t *b, unsigned numBytes) {
+    unsigned i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= numBytes; i += 32) {
+      __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+      __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+      __m256i d = _mm256_xor_si256(x, y);
+      if (!_mm256_testz_si256(d, d))
+        return true;
+    }
+#elif defined(__SSE2__)
+    for (; i + 16 <= numBytes; i += 16) {
+      __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+      __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF)
+        return true;
+    }
+#endif
+    uint64_t diff = 0;
+    for (; i + 8 <= numBytes; i += 8) {
+      uint64_t x, y;
+      std::memcpy(&x, a + i, 8);
+      std::memcpy(&y, b + i, 8);
+      diff |= x ^ y;
     }
+    for (; i < numBytes; ++i)
+      diff |= a[i] ^ b[i];
+    return diff != 0;
+  }
+
+private:
+  struct Range {
+    unsigned offset;
+    unsigned numBytes;
+  };
+
+  /// Sort the ranges by offset, size the shadow copy to cover all of them,
+  /// and record the first range overlapping each block.
+  void finalize() {
+    order.resize(ranges.size());
+    for (unsigned i = 0; i < ranges.size(); ++i)
+      order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+      return ranges[a].offset < ranges[b].offset;
+    });
+    unsigned end = 0;
+    for (auto &range : ranges)
+      end = std::max(end, range.offset + range.numBytes);
+    shadow.assign(state, state + end);
+    unsigned numBlocks = (end + blockSize - 1) / blockSize;
+    blockFirst.assign(numBlocks, unsigned(order.size()));
+    for (unsigned i = order.size(); i > 0; --i) {
+      auto &range = ranges[order[i - 1]];
+      if (range.numBytes == 0)
+        continue;
+      unsigned first = range.offset / blockSize;
+      unsigned last = (range.offset + range.numBytes - 1) / blockSize;
+      for (unsigned block = first; block <= last; ++block)
+        blockFirst[block] = std::min(blockFirst[block], i - 1);
+    }
+    finalized = true;
+  }
+
+  const uint8_t *state;
+  std::vector<Range> ranges;
+  /// Range indices sorted by offset.
+  std::vector<unsigned> order;
+  /// Position in `order` of the first range overlapping each block.
+  std::vector<unsigned> blockFirst;
+  /// Values of the state at the last check.
+  std::vector<uint8_t> shadow;
+  bool finalized = false;
+};
+
+/// Buffers trace output and writes it to a stream in large chunks, optionally
+/// on a separate thread such that the simulation does not wait for the I/O.
+class TraceOutput {
+public:
+  static constexpr size_t chunkSize = 1 << 20;
+
+  TraceOutput(std::basic_ostream<char> &os, bool async) : os(os) {
+    buffer.reserve(chunkSize + chunkSize / 8);
+    if (async)
+      writer = std::thread([this] { run(); });
+  }
+
+  ~TraceOutput() {
+    flush();
+    if (writer.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+      }
+      wakeWriter.notify_one();
+      writer.join();
+    }
+  }
+
+  void append(const char *data, size_t size) {
+    buffer.insert(buffer.end(), data, data + size);
+  }
+  void append(char c) { buffer.push_back(c); }
+
+  /// Hand the buffered output off once enough of it has accumulated.
+  void maybeSubmit() {
+    if (buffer.size() >= chunkSize)
+      submit();
+  }
+
+  /// Write out all buffered output and wait for it to reach the stream.
+  void flush() {
+    submit();
+    if (writer.joinable()) {
+      std::unique_lock<std::mutex> lock(mutex);
+      writerIdle.wait(lock, [&] { return pending.empty() && !busy; });
+    }
+    os.flush();
+  }
+
+private:
+  void submit() {
+    if (buffer.empty())
+      return;
+    if (!writer.joinable()) {
+      os.write(buffer.data(), buffer.size());
+      buffer.clear();
+      return;
+    }
+    std::vector<char> next;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending.push_back(std::move(buffer));
+      if (!spare.empty()) {
+        next = std::move(spare.back());
+        spare.pop_back();
+      }
+    }
+    wakeWriter.notify_one();
+    next.clear();
+    next.reserve(chunkSize + chunkSize / 8);
+    buffer = std::move(next);
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      wakeWriter.wait(lock, [&] { return stop || !pending.empty(); });
+      if (pending.empty())
+        return;
+      auto chunk = std::move(pending.front());
+      pending.pop_front();
+      busy = true;
+      lock.unlock();
+      os.write(chunk.data(), chunk.size());
+      lock.lock();
+      busy = false;
+      spare.push_back(std::move(chunk));
+      writerIdle.notify_all();
+    }
+  }
+
+  std::basic_ostream<char> &os;
+  std::vector<char> buffer;
+  std::thread writer;
+  std::mutex mutex;
+  std::condition_variable wakeWriter;
+  std::condition_variable writerIdle;
+  std::deque<std::vector<char>> pending;
+  std::vector<std::vector<char>> spare;
+  bool busy = false;
+  bool stop = false;
+};
+
+/// Append the `numBits` bit value at `value` to `out` as binary digits, most
+/// significant bit first. Whole bytes are converted through a lookup table.
+inline void formatBinary(TraceOutput &out, const uint8_t *value,
+                         unsigned numBits) {
+  struct Table {
+    char digits[256][8];
+    Table() {
+      for (unsigned byte = 0; byte < 256; ++byte)
+        for (unsigned bit = 0; bit < 8; ++bit)
+          digits[byte][7 - bit] = (byte >> bit) & 1 ? '1' : '0';
+    }
+  };
+  static const Table table;
+  unsigned numBytes = numBits / 8;
+  if (unsigned rest = numBits % 8)
+    out.append(table.digits[value[numBytes]] + 8 - rest, rest);
+  for (unsigned i = numBytes; i > 0; --i)
+    out.append(table.digits[value[i - 1]], 8);
+}
+
+/// Call `fn(path, signal, offset)` for every value traced in a model: every
+/// port, and with `withHierarchy` set, every state and memory word in the
+/// hierarchy. `enter` and `leave` are called around every nested scope.
+template <class ModelLayout, typename Fn, typename Enter, typename Leave>
+void forEachTracedValue(bool withHierarchy, Fn fn, Enter enter, Leave leave) {
+  for (auto &port : ModelLayout::io)
+    fn(port, port.offset, -1);
+  if (!withHierarchy)
+    return;
+  std::function<void(const Hierarchy &)> walk = [&](const Hierarchy &scope) {
+    enter(scope);
+    for (unsigned i = 0; i < scope.numStates; ++i) {
+      auto &state = scope.states[i];
+      if (state.type != Signal::Memory) {
+        fn(state, state.offset, -1);
+        continue;
+      }
+      for (unsigned word = 0; word < state.depth; ++word)
+        fn(state, state.offset + word * state.stride, int(word));
+    }
+    for (unsigned i = 0; i < scope.numChildren; ++i)
+      walk(scope.children[i]);
+    leave(scope);
+  };
+  walk(ModelLayout::hierarchy);
+}
+
+template <class ModelLayout>
+class ValueChangeDump {
+public:
+  /// Create a VCD writer for the given model state. With `async` set, the
+  /// formatted output is written to the stream on a separate thread.
+  ValueChangeDump(std::basic_ostream<char> &os, const uint8_t *state,
+                  bool async = false)
+      : out(std::make_unique<TraceOutput>(os, async)), diff(state),
+        state(state) {}
+
+  void writeHeader(bool withHierarchy = true) {
+    std::string header;
+    header += "$date\n    October 21, 2015\n$end\n";
+    header += "$version\n    Some cryptic MLIR magic\n$end\n";
+    header += "$timescale 1ns $end\n";
+    header += std::string("$scope module ") + ModelLayout::name + " $end\n";
+
+    auto writeSignal = [&](const Signal &state, unsigned offset, int word) {
+      auto &signal = allocSignal(state, offset);
+      header += state.type == Signal::Register || state.type == Signal::Memory
+                    ? "$var reg "
+                    : "$var wire ";
+      header += std::to_string(state.numBits) + " " + signal.abbrev + " " +
+                state.name;
+      if (word >= 0)
+        header += "[" + std::to_string(word) + "]";
+      if (state.numBits > 1)
+        header += " [" + std::to_string(state.numBits - 1) + ":0]";
+      header += " $end\n";
+    };
+    forEachTracedValue<ModelLayout>(
+        withHierarchy, writeSignal,
+        [&](const Hierarchy &scope) {
+          header += std::string("$scope module ") + scope.name + " $end\n";
+        },
+        [&](const Hierarchy &) { header += "$upscope $end\n"; });
+
+    header += "$upscope $end\n";
+    header += "$enddefinitions $end\n";
+    out->append(header.data(), header.size());
+  }
+
+  void writeValues(bool includeUnchanged = false) {
+    diff.forEachChanged(
+        [&](unsigned index) {
+          auto &signal = signals[index];
+          if (signal.numBits > 1)
+            out->append('b');
+          formatBinary(*out, state + signal.offset, signal.numBits);
+          if (signal.numBits > 1)
+            out->append(' ');
+          out->append(signal.abbrev.data(), signal.abbrev.size());
+          out->append('\n');
+        },
+        includeUnchanged);
+    out->maybeSubmit();
   }
 
   void writeDumpvars() {
-    os << "$dumpvars\n";
+    static const char dumpvars[] = "$dumpvars\n";
+    out->append(dumpvars, sizeof(dumpvars) - 1);
     writeValues(true);
   }
 
   void writeTimestep(size_t timeIncrement) {
     time += timeIncrement;
-    os << "#" << time << "\n";
+    out->append('#');
+    auto timeStr = std::to_string(time);
+    out->append(timeStr.data(), timeStr.size());
+    out->append('\n');
     writeValues();
   }
 
+  /// Write all buffered output to the stream.
+  void flush() { out->flush(); }
+
   size_t time = 0;
 
 private:
   struct VcdSignal {
     std::string abbrev;
     unsigned offset;
-    const Signal &state;
-    unsigned previousOffset;
+    unsigned numBits;
   };
 
-  VcdSignal &allocSignal(const Signal &state, unsigned offset,
-                         unsigned numBytes) {
+  VcdSignal &allocSignal(const Signal &state, unsigned offset) {
     std::string abbrev;
     unsigned rest = signals.size() + 1;
     while (rest != 0) {
@@ -147,16 +666,271 @@ private:
       abbrev += c;
       rest /= 84;
     }
-    signals.push_back(
-        VcdSignal{abbrev, offset, state, unsigned(previousValues.size())});
-    previousValues.resize(previousValues.size() + numBytes);
+    diff.addRange(offset, (state.numBits + 7) / 8);
+    signals.push_back(VcdSignal{abbrev, offset, state.numBits});
     return signals.back();
   }
 
-  std::basic_ostream<char> &os;
+  std::unique_ptr<TraceOutput> out;
+  StateDiff diff;
   const uint8_t *state;
   std::vector<VcdSignal> signals;
-  std::vector<uint8_t> previousValues;
 };
 
+/// Writes a compact binary trace of the model state. The trace starts with the
+/// magic `ARCTRACE`, followed by the number of signals and the name and bit
+/// width of each signal. The remainder is a sequence of records: a signal
+/// index plus one, followed by the signal's new value as little-endian bytes,
+/// or a zero followed by the time increment that starts a new timestep. All
+/// integers are LEB128-encoded. Use `BinaryTraceReader` to convert a trace
+/// into VCD.
+template <class ModelLayout>
+class BinaryTrace {
+public:
+  /// Create a binary trace writer for the given model state. By default the
+  /// output is written to the stream on a separate thread.
+  BinaryTrace(std::basic_ostream<char> &os, const uint8_t *state,
+              bool async = true)
+      : out(std::make_unique<TraceOutput>(os, async)), diff(state),
+        state(state) {}
+
+  void writeHeader(bool withHierarchy = true) {
+    std::vector<std::string> names;
+    std::vector<unsigned> widths;
+    std::string prefix;
+    std::vector<size_t> prefixLengths;
+    forEachTracedValue<ModelLayout>(
+        withHierarchy,
+        [&](const Signal &state, unsigned offset, int word) {
+          std::string name = prefix + state.name;
+          if (word >= 0)
+            name += "[" + std::to_string(word) + "]";
+          names.push_back(std::move(name));
+          widths.push_back(state.numBits);
+          diff.addRange(offset, (state.numBits + 7) / 8);
+          signals.push_back(TraceSignal{offset, (state.numBits + 7) / 8});
+        },
+        [&](const Hierarchy &scope) {
+          prefixLengths.push_back(prefix.size());
+          prefix += scope.name;
+          prefix += '.';
+        },
+        [&](const Hierarchy &) {
+          prefix.resize(prefixLengths.back());
+          prefixLengths.pop_back();
+        });
+
+    static const char magic[] = "ARCTRACE";
+    out->append(magic, sizeof(magic) - 1);
+    writeNumber(names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+      writeNumber(names[i].size());
+      out->append(names[i].data(), names[i].size());
+      writeNumber(widths[i]);
+    }
+  }
+
+  void writeValues(bool includeUnchanged = false) {
+    diff.forEachChanged(
+        [&](unsigned index) {
+          auto &signal = signals[index];
+          writeNumber(index + 1);
+          out->append(reinterpret_cast<const char *>(state + signal.offset),
+                      signal.numBytes);
+        },
+        includeUnchanged);
+    out->maybeSubmit();
+  }
+
+  void writeDumpvars() { writeValues(true); }
+
+  void writeTimestep(size_t timeIncrement) {
+    time += timeIncrement;
+    writeNumber(0);
+    writeNumber(timeIncrement);
+    writeValues();
+  }
+
+  /// Write all buffered output to the stream.
+  void flush() { out->flush(); }
+
+  size_t time = 0;
+
+private:
+  struct TraceSignal {
+    unsigned offset;
+    unsigned numBytes;
+  };
+
+  void writeNumber(uint64_t value) {
+    do {
+      uint8_t byte = value & 0x7F;
+      value >>= 7;
+      if (value != 0)
+        byte |= 0x80;
+      out->append(char(byte));
+    } while (value != 0);
+  }
+
+  std::unique_ptr<TraceOutput> out;
+  StateDiff diff;
+  const uint8_t *state;
+  std::vector<TraceSignal> signals;
+};
+
+/// Converts a trace written by `BinaryTrace` into VCD. Returns false if the
+/// input is not a well-formed trace, or is truncated.
+class BinaryTraceReader {
+public:
+  explicit BinaryTraceReader(std::istream &is) : is(is) {}
+
+  bool writeVCD(std::basic_ostream<char> &os) {
+    char magic[8];
+    if (!is.read(magic, 8) || std::memcmp(magic, "ARCTRACE", 8) != 0)
+      return false;
+    uint64_t numSignals;
+    if (!readNumber(numSignals))
+      return false;
+    std::vector<unsigned> widths;
+    std::vector<std::string> abbrevs;
+    std::vector<uint8_t> value;
+    TraceOutput out(os, false);
+    std::string header = "$timescale 1ns $end\n$scope module trace $end\n";
+    for (uint64_t i = 0; i < numSignals; ++i) {
+      uint64_t nameLength, width;
+      if (!readNumber(nameLength))
+        return false;
+      std::string name(nameLength, '\0');
+      if (!is.read(&name[0], nameLength) || !readNumber(width))
+        return false;
+      std::string abbrev;
+      for (uint64_t rest = i + 1; rest != 0; rest /= 84) {
+        uint8_t c = (rest % 84) + 33;
+        if (c >= '0')
+          c += 10;
+        abbrev += c;
+      }
+      header += "$var wire " + std::to_string(width) + " " + abbrev + " " +
+                name + " $end\n";
+      widths.push_back(width);
+      abbrevs.push_back(std::move(abbrev));
+    }
+    header += "$upscope $end\n$enddefinitions $end\n$dumpvars\n";
+    out.append(header.data(), header.size());
+
+    // The trace may only end between records. Running out of input within a
+    // record, including within one of its numbers, means it was truncated.
+    uint64_t time = 0;
+    uint64_t record;
+    while (is.peek() != EOF) {
+      if (!readNumber(record))
+        return false;
+      if (record == 0) {
+        uint64_t increment;
+        if (!readNumber(increment))
+          return false;
+        time += increment;
+        auto timeStr = "#" + std::to_string(time) + "\n";
+        out.append(timeStr.data(), timeStr.size());
+        continue;
+      }
+      if (record > numSignals)
+        return false;
+      unsigned numBits = widths[record - 1];
+      value.resize((numBits + 7) / 8);
+      if (!is.read(reinterpret_cast<char *>(value.data()), value.size()))
+        return false;
+      if (numBits > 1)
+        out.append('b');
+      formatBinary(out, value.data(), numBits);
+      if (numBits > 1)
+        out.append(' ');
+      out.append(abbrevs[record - 1].data(), abbrevs[record - 1].size());
+      out.append('\n');
+      out.maybeSubmit();
+    }
+    return true;
+  }
+
+private:
+  bool readNumber(uint64_t &value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      int byte = is.get();
+      if (byte == EOF)
+        return false;
+      value |= uint64_t(byte & 0x7F) << shift;
+      if (!(byte & 0x80))
+        return true;
+    }
+    return false;
+  }
+
+  std::istream &is;
+};
+
+/// Print the hot spots of a model from its profile buffer, hottest first. The
+/// counters of an arc called from several functions are added up. The cycles
+/// of a function include the arcs it calls.
+inline void writeProfileReport(std::ostream &os, const char *modelName,
+                               const ProfileCounter *counters,
+                               size_t numCounters, const uint64_t *buffer) {
+  struct Entry {
+    std::string name;
+    uint64_t calls;
+    uint64_t cycles;
+  };
+  std::vector<Entry> entries;
+  uint64_t totalCycles = 0;
+  for (size_t i = 0; i < numCounters; ++i) {
+    auto &counter = counters[i];
+    uint64_t calls = buffer[2 * i];
+    uint64_t cycles = buffer[2 * i + 1];
+    if (counter.kind != ProfileCounter::Arc) {
+      totalCycles += cycles;
+      std::string name =
+          counter.kind == ProfileCounter::Clock ? "clock" : "passthrough";
+      name += " function " + std::to_string(counter.function);
+      entries.push_back({name, calls, cycles});
+      continue;
+    }
+    std::string name = std::string("arc ") + counter.name;
+    auto it = std::find_if(entries.begin(), entries.end(),
+                           [&](auto &entry) { return entry.name == name; });
+    if (it == entries.end()) {
+      entries.push_back({name, calls, cycles});
+      continue;
+    }
+    it->calls += calls;
+    it->cycles += cycles;
+  }
+  std::stable_sort(entries.begin(), entries.end(), [](auto &a, auto &b) {
+    return a.cycles > b.cycles;
+  });
+
+  os << "Profile of `" << modelName << "` (" << totalCycles
+     << " cycles in functions):\n";
+  os << "       calls        cycles       %  entry\n";
+  for (auto &entry : entries) {
+    char line[64];
+    std::snprintf(line, sizeof(line), "%12llu  %12llu  %6.1f  ",
+                  (unsigned long long)entry.calls,
+                  (unsigned long long)entry.cycles,
+                  totalCycles ? 100.0 * entry.cycles / totalCycles : 0.0);
+    os << line << entry.name << "\n";
+  }
+}
+
+/// Print the profile report of a model. The buffer is null if the model was
+/// built without profiling.
+template <class ModelLayout>
+void writeProfileReport(std::ostream &os, const uint64_t *buffer) {
+  if (!buffer) {
+    os << ModelLayout::name << " was not built with --profile\n";
+    return;
+  }
+  writeProfileReport(os, ModelLayout::name, ModelLayout::profile.data(),
+                     ModelLayout::profile.size(), buffer);
+}
+
 // NOLINTEND
@@ -11,11 +11,13 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "arcilator-runtime.h"
 #include "circt/Conversion/CombToArith.h"
 #include "circt/Dialect/Arc/ArcDialect.h"
 #include "circt/Dialect/Arc/ArcInterfaces.h"
 #include "circt/Dialect/Arc/ArcOps.h"
 #include "circt/Dialect/Arc/ArcPasses.h"
+#include "circt/Dialect/Arc/ModelInfo.h"
 #include "circt/InitAllDialects.h"
 #include "circt/InitAllPasses.h"
 #include "circt/Support/Version.h"
@@ -27,6 +29,8 @@
 #include "mlir/Dialect/LLVMIR/LLVMDialect.h"
 #include "mlir/Dialect/LLVMIR/Transforms/Passes.h"
 #include "mlir/Dialect/SCF/IR/SCF.h"
+#include "mlir/ExecutionEngine/ExecutionEngine.h"
+#include "mlir/ExecutionEngine/OptUtils.h"
 #include "mlir/IR/AsmState.h"
 #include "mlir/IR/BuiltinOps.h"
 #include "mlir/IR/OperationSupport.h"
@@ -41,17 +45,33 @@
 #include "mlir/Target/LLVMIR/Export.h"
 #include "mlir/Transforms/GreedyPatternRewriteDriver.h"
 #include "mlir/Transforms/Passes.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/SHA256.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
 
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 #include <optional>
+#include <sstream>
+#include <thread>
 
 using namespace llvm;
 using namespace mlir;
@@ -97,6 +117,43 @@ static cl::opt<bool>
                    cl::desc("Optimize arcs into lookup tables"), cl::init(true),
                    cl::cat(mainCategory));
 
+static cl::opt<unsigned>
+    numLanes("lanes",
+             cl::desc("Number of independent copies of the model state to "
+                      "simulate side by side in a single evaluation"),
+             cl::init(1), cl::cat(mainCategory));
+
+static cl::opt<bool> optimizeLayout(
+    "optimize-layout",
+    cl::desc("Group states by the clock trees accessing them and align the "
+             "groups to cache lines"),
+    cl::init(false), cl::cat(mainCategory));
+
+static cl::opt<uint64_t> sparseMemoryThreshold(
+    "sparse-memory-threshold",
+    cl::desc("Only allocate the written pages of memories with at least this "
+             "many bytes (0 to disable)"),
+    cl::init(0), cl::cat(mainCategory));
+
+static cl::opt<bool> activityTracking(
+    "activity-tracking",
+    cl::desc("Only evaluate logic whose inputs changed since its last "
+             "evaluation"),
+    cl::init(false), cl::cat(mainCategory));
+
+static cl::opt<bool> activityStats(
+    "activity-stats",
+    cl::desc("Count how often activity tracking skips logic, and report it "
+             "after simulating with --run"),
+    cl::init(false), cl::cat(mainCategory));
+
+static cl::opt<bool> profile(
+    "profile",
+    cl::desc("Count the invocations and cycles of the model's functions and "
+             "arc calls, and report the hot spots after simulating with --run "
+             "(disables arc inlining)"),
+    cl::init(false), cl::cat(mainCategory));
+
 static cl::opt<bool> printDebugInfo("print-debug-info",
                                     cl::desc("Print debug information"),
                                     cl::init(false), cl::cat(mainCategory));
@@ -155,10 +212,63 @@ static cl::opt<OutputFormat> outputFormat(
                           "Do not output anything")),
     cl::init(OutputLLVM), cl::cat(mainCategory));
 
+// Options to control the JIT execution of the model.
+static cl::opt<bool>
+    runJIT("run",
+           cl::desc("JIT-compile the model and simulate it in-process instead "
+                    "of emitting it; see --stimulus, --cycles and --vcd"),
+           cl::init(false), cl::cat(mainCategory));
+
+static cl::opt<std::string>
+    stimulusFile("stimulus",
+                 cl::desc("Stimulus file driving the inputs of the simulated "
+                          "model, one line per cycle"),
+                 cl::value_desc("filename"), cl::init(""),
+                 cl::cat(mainCategory));
+
+static cl::opt<unsigned>
+    numCycles("cycles",
+              cl::desc("Number of cycles to simulate (defaults to the number "
+                       "of stimulus lines)"),
+              cl::init(0), cl::cat(mainCategory));
+
+static cl::opt<std::string> vcdFile("vcd",
+                                    cl::desc("Dump a VCD trace of the "
+                                             "simulated model's named states"),
+                                    cl::value_desc("filename"), cl::init(""),
+                                    cl::cat(mainCategory));
+
+static cl::opt<std::string> jitCacheDir(
+    "jit-cache-dir",
+    cl::desc("Split the JIT-compiled model into partitions and cache their "
+             "object code in this directory, such that later runs only "
+             "recompile the partitions that changed"),
+    cl::value_desc("directory"), cl::init(""), cl::cat(mainCategory));
+
+static cl::opt<unsigned> jitCachePartitions(
+    "jit-cache-partitions",
+    cl::desc("Number of partitions the model is split into with "
+             "--jit-cache-dir"),
+    cl::init(16), cl::cat(mainCategory));
+
+static cl::opt<unsigned> numThreads(
+    "threads",
+    cl::desc("Partition the clock trees of the simulated model into "
+             "independent tasks and evaluate them on this many threads"),
+    cl::init(1), cl::cat(mainCategory));
+
 //===----------------------------------------------------------------------===//
 // Main Tool Logic
 //===----------------------------------------------------------------------===//
 
+/// Populate a pass manager with the lowering of the clock functions to LLVM.
+static void populateLLVMLowering(PassManager &pm) {
+  pm.addPass(createConvertCombToArithPass());
+  pm.addPass(createLowerArcToLLVMPass(profile));
+  pm.addPass(createCSEPass());
+  pm.addPass(arc::createArcCanonicalizerPass());
+}
+
 /// Populate a pass manager with the arc simulator pipeline for the given
 /// command line options.
 static void populatePipeline(PassManager &pm) {
@@ -174,7 +284,8 @@ static void populatePipeline(PassManager &pm) {
   pm.addPass(
       arc::createAddTapsPass(observePorts, observeWires, observeNamedValues));
   pm.addPass(arc::createStripSVPass());
-  pm.addPass(arc::createInferMemoriesPass(observePorts));
+  pm.addPass(
+      arc::createInferMemoriesPass(observePorts, sparseMemoryThreshold));
   pm.addPass(createCSEPass());
   pm.addPass(arc::createArcCanonicalizerPass());
 
@@ -220,7 +331,7 @@ static void populatePipeline(PassManager &pm) {
   // Lower stateful arcs into explicit state reads and writes.
   if (untilReached(UntilStateLowering))
     return;
-  pm.addPass(arc::createLowerStatePass());
+  pm.addPass(arc::createLowerStatePass(activityTracking, activityStats));
   pm.addPass(createCSEPass());
   pm.addPass(arc::createArcCanonicalizerPass());
 
@@ -231,7 +342,9 @@ static void populatePipeline(PassManager &pm) {
   // following is commented out
   // pm.addPass(arc::createMuxToControlFlowPass());
 
-  if (shouldInline) {
+  // Inlining would fold the arcs into their callers and leave nothing to
+  // attribute the cycles to, so it is skipped when profiling.
+  if (shouldInline && !profile) {
     pm.addPass(arc::createInlineArcsPass());
     pm.addPass(arc::createArcCanonicalizerPass());
     pm.addPass(createCSEPass());
@@ -244,21 +357,699 @@ static void populatePipeline(PassManager &pm) {
   // Allocate states.
   if (untilReached(UntilStateAlloc))
     return;
+  if (runJIT && numThreads > 1)
+    pm.addPass(arc::createPartitionClockTreesPass(numThreads));
   pm.addPass(arc::createLegalizeStateUpdatePass());
-  pm.nest<arc::ModelOp>().addPass(arc::createAllocateStatePass());
+  pm.nest<arc::ModelOp>().addPass(
+      arc::createAllocateStatePass(numLanes, optimizeLayout));
   if (!stateFile.empty())
     pm.addPass(arc::createPrintStateInfoPass(stateFile));
   pm.addPass(createCSEPass());
   pm.addPass(arc::createArcCanonicalizerPass());
 
-  // Lower the arcs and update functions to LLVM.
-  if (untilReached(UntilLLVMLowering))
+  // Lower the arcs and update functions to LLVM. The JIT execution mode runs
+  // these steps itself, since it needs to inspect the models in between.
+  if (untilReached(UntilLLVMLowering) || runJIT)
     return;
   pm.addPass(arc::createLowerClocksToFuncsPass());
-  pm.addPass(createConvertCombToArithPass());
-  pm.addPass(createLowerArcToLLVMPass());
-  pm.addPass(createCSEPass());
-  pm.addPass(arc::createArcCanonicalizerPass());
+  populateLLVMLowering(pm);
+}
+
+//===----------------------------------------------------------------------===//
+// JIT Execution
+//===----------------------------------------------------------------------===//
+
+namespace {
+/// A clock or passthrough function of a model.
+struct ModelFunction {
+  std::string name;
+  // The offset of the input clocking the function in the model's storage, or
+  // none for the passthrough function.
+  std::optional<unsigned> clockOffset;
+  void (*fn)(void *) = nullptr;
+};
+
+/// A model to simulate, along with its functions.
+struct JITModel {
+  JITModel(arc::ModelInfo info) : info(std::move(info)) {}
+
+  arc::ModelInfo info;
+  SmallVector<ModelFunction> functions;
+};
+
+/// The functions of a model run on the rising edge of the same clock. These
+/// are independent of each other, since LowerState emits a single clock tree
+/// per clock and PartitionClockTrees only splits off independent tasks.
+struct ClockGroup {
+  unsigned clockOffset;
+  SmallVector<void (*)(void *)> functions;
+};
+
+/// A pool of threads evaluating the functions of a clock group concurrently.
+/// The calling thread takes part in the evaluation and waits for all others to
+/// finish, which acts as a barrier between the clock groups of a cycle. The
+/// workers spin while waiting for work, since the next group is usually only
+/// a few microseconds away.
+class TaskPool {
+public:
+  TaskPool(unsigned numThreads) {
+    for (unsigned i = 1; i < numThreads; ++i)
+      workers.emplace_back([this, i] { work(i); });
+  }
+
+  ~TaskPool() {
+    stop.store(true, std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_release);
+    for (auto &worker : workers)
+      worker.join();
+  }
+
+  /// Run the given functions on the model state, distributing them across the
+  /// threads of the pool, and return once all of them have finished.
+  void run(ArrayRef<void (*)(void *)> functions, void *state) {
+    currentFunctions = functions;
+    currentState = state;
+    pending.store(workers.size(), std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_release);
+    runShare(0);
+    while (pending.load(std::memory_order_acquire) != 0)
+      std::this_thread::yield();
+  }
+
+private:
+  void work(unsigned index) {
+    uint64_t seen = 0;
+    while (true) {
+      uint64_t current;
+      while ((current = generation.load(std::memory_order_acquire)) == seen)
+        std::this_thread::yield();
+      seen = current;
+      if (stop.load(std::memory_order_relaxed))
+        return;
+      runShare(index);
+      pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+  }
+
+  /// Run the functions assigned to the thread with the given index.
+  void runShare(unsigned index) {
+    for (size_t i = index, e = currentFunctions.size(); i < e;
+         i += workers.size() + 1)
+      currentFunctions[i](currentState);
+  }
+
+  std::vector<std::thread> workers;
+  std::atomic<uint64_t> generation{0};
+  std::atomic<size_t> pending{0};
+  std::atomic<bool> stop{false};
+  ArrayRef<void (*)(void *)> currentFunctions;
+  void *currentState = nullptr;
+};
+
+/// A JIT compiling the model in independent partitions, caching the object
+/// code of each partition on disk. The cache is keyed by a hash of the
+/// unoptimized LLVM IR of a partition, such that a partition whose functions
+/// did not change since an earlier run is loaded from the cache instead of
+/// being optimized and compiled again. The functions are assigned to
+/// partitions by a hash of their name, which keeps the assignment stable
+/// across changes to the design.
+class CachingJIT {
+public:
+  static Expected<std::unique_ptr<CachingJIT>>
+  create(ModuleOp module, StringRef cacheDir, unsigned numPartitions);
+
+  Expected<void *> lookup(StringRef name) {
+    auto addr = jit->lookup(name);
+    if (!addr)
+      return addr.takeError();
+    return addr->toPtr<void *>();
+  }
+
+  unsigned numPartitions = 0;
+  unsigned numCachedPartitions = 0;
+
+private:
+  Error addPartition(llvm::Module &part, StringRef cacheDir);
+
+  std::unique_ptr<orc::LLJIT> jit;
+  std::unique_ptr<TargetMachine> targetMachine;
+  std::function<Error(llvm::Module *)> optimize;
+};
+
+/// The inputs driven by the stimulus file, and their value on each line.
+struct Stimulus {
+  SmallVector<const arc::StateInfo *> inputs;
+  std::vector<SmallVector<APInt>> lines;
+};
+
+/// A minimal VCD writer dumping the named states of a model, with the VCD time
+/// counting half cycles.
+class VCDWriter {
+public:
+  VCDWriter(raw_ostream &os, const arc::ModelInfo &model, const uint8_t *state)
+      : os(os), state(state) {
+    os << "$timescale 1ns $end\n";
+    os << "$scope module " << model.name << " $end\n";
+    for (const auto &info : model.states) {
+      if (info.type != arc::StateInfo::Memory) {
+        addVariable(info, info.offset, info.name);
+        continue;
+      }
+      // The words of sparse memories live outside of the model state.
+      if (info.memoryPageWords != 0)
+        continue;
+      for (unsigned i = 0; i < info.memoryDepth; ++i)
+        addVariable(info, info.offset + i * info.memoryStride,
+                    info.name + "[" + std::to_string(i) + "]");
+    }
+    os << "$upscope $end\n";
+    os << "$enddefinitions $end\n";
+  }
+
+  /// Dump the values that changed since the last time step.
+  void writeTimestep(uint64_t time) {
+    bool first = true;
+    for (auto &var : variables) {
+      const uint8_t *value = state + var.offset;
+      size_t numBytes = (var.numBits + 7) / 8;
+      if (time != 0 && std::equal(value, value + numBytes,
+                                  previousValues.data() + var.previousOffset))
+        continue;
+      if (first)
+        os << "#" << time << "\n";
+      first = false;
+      if (var.numBits > 1)
+        os << 'b';
+      for (unsigned n = var.numBits; n > 0; --n)
+        os << (value[(n - 1) / 8] & (1 << ((n - 1) % 8)) ? '1' : '0');
+      if (var.numBits > 1)
+        os << ' ';
+      os << var.id << "\n";
+      std::copy(value, value + numBytes,
+                previousValues.data() + var.previousOffset);
+    }
+  }
+
+private:
+  struct Variable {
+    std::string id;
+    unsigned offset;
+    unsigned numBits;
+    size_t previousOffset;
+  };
+
+  void addVariable(const arc::StateInfo &info, unsigned offset,
+                   const std::string &name) {
+    std::string id;
+    for (unsigned rest = variables.size() + 1; rest != 0; rest /= 94)
+      id += static_cast<char>('!' + rest % 94);
+    os << "$var " << (info.type == arc::StateInfo::Register ? "reg" : "wire")
+       << " " << info.numBits << " " << id << " " << name;
+    if (info.numBits > 1)
+      os << " [" << (info.numBits - 1) << ":0]";
+    os << " $end\n";
+    variables.push_back({id, offset, info.numBits, previousValues.size()});
+    previousValues.resize(previousValues.size() + (info.numBits + 7) / 8);
+  }
+
+  raw_ostream &os;
+  const uint8_t *state;
+  std::vector<Variable> variables;
+  std::vector<uint8_t> previousValues;
+};
+} // namespace
+
+Expected<std::unique_ptr<CachingJIT>>
+CachingJIT::create(ModuleOp module, StringRef cacheDir,
+                   unsigned numPartitions) {
+  auto self = std::make_unique<CachingJIT>();
+  auto machineBuilder = orc::JITTargetMachineBuilder::detectHost();
+  if (!machineBuilder)
+    return machineBuilder.takeError();
+  machineBuilder->setCodeGenOptLevel(CodeGenOpt::Aggressive);
+  auto targetMachine = machineBuilder->createTargetMachine();
+  if (!targetMachine)
+    return targetMachine.takeError();
+  self->targetMachine = std::move(*targetMachine);
+  self->optimize = makeOptimizingTransformer(/*optLevel=*/3, /*sizeLevel=*/0,
+                                             self->targetMachine.get());
+
+  auto jit =
+      orc::LLJITBuilder().setJITTargetMachineBuilder(*machineBuilder).create();
+  if (!jit)
+    return jit.takeError();
+  self->jit = std::move(*jit);
+  auto &dataLayout = self->jit->getDataLayout();
+  auto generator = orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      dataLayout.getGlobalPrefix());
+  if (!generator)
+    return generator.takeError();
+  self->jit->getMainJITDylib().addGenerator(std::move(*generator));
+
+  llvm::LLVMContext llvmContext;
+  auto llvmModule = translateModuleToLLVMIR(module, llvmContext);
+  if (!llvmModule)
+    return createStringError(inconvertibleErrorCode(),
+                             "failed to translate the model to LLVM IR");
+  llvmModule->setDataLayout(dataLayout);
+  llvmModule->setTargetTriple(
+      self->targetMachine->getTargetTriple().getTriple());
+
+  if (auto error = sys::fs::create_directories(cacheDir))
+    return make_error<StringError>(
+        "cannot create JIT cache directory `" + cacheDir + "`", error);
+
+  // Local functions and globals are made external, such that partitions can
+  // refer to the arcs and constants of other partitions.
+  SmallVector<std::unique_ptr<llvm::Module>> parts;
+  SplitModule(*llvmModule, numPartitions,
+              [&](auto part) { parts.push_back(std::move(part)); });
+  for (auto &part : parts) {
+    if (part->empty() && part->global_empty())
+      continue;
+    if (auto error = self->addPartition(*part, cacheDir))
+      return std::move(error);
+    ++self->numPartitions;
+  }
+  return self;
+}
+
+Error CachingJIT::addPartition(llvm::Module &part, StringRef cacheDir) {
+  // Hash the unoptimized IR, along with everything else that affects the
+  // generated code.
+  SmallString<0> bitcode;
+  raw_svector_ostream bitcodeStream(bitcode);
+  WriteBitcodeToFile(part, bitcodeStream);
+  SHA256 hasher;
+  hasher.update(getCirctVersion());
+  hasher.update(targetMachine->getTargetCPU());
+  hasher.update(targetMachine->getTargetFeatureString());
+  hasher.update(bitcode);
+  SmallString<128> path(cacheDir);
+  sys::path::append(path, toHex(hasher.final(), /*LowerCase=*/true) + ".o");
+
+  if (auto cached = MemoryBuffer::getFile(path)) {
+    ++numCachedPartitions;
+    return jit->addObjectFile(std::move(*cached));
+  }
+
+  if (auto error = optimize(&part))
+    return error;
+  orc::SimpleCompiler compiler(*targetMachine);
+  auto object = compiler(part);
+  if (!object)
+    return object.takeError();
+
+  // Write the object through a temporary file, such that concurrent runs never
+  // observe a partially written object. Failing to populate the cache only
+  // costs time in later runs.
+  if (auto error = writeToOutput(path, [&](raw_ostream &os) {
+        os << (*object)->getBuffer();
+        return Error::success();
+      }))
+    llvm::errs() << "warning: cannot write to JIT cache: "
+                 << toString(std::move(error)) << "\n";
+  return jit->addObjectFile(std::move(*object));
+}
+
+/// Return the storage offset of the model input the given clock is read from.
+static std::optional<unsigned> getClockOffset(Value clock) {
+  auto readOp = clock.getDefiningOp<arc::StateReadOp>();
+  if (!readOp)
+    return {};
+  auto state = readOp.getState();
+  if (auto getOp = state.getDefiningOp<arc::StorageGetOp>())
+    if (getOp.getStorage().isa<BlockArgument>())
+      return getOp.getOffset();
+  if (auto inputOp = state.getDefiningOp<arc::RootInputOp>())
+    if (auto offset = inputOp->getAttrOfType<IntegerAttr>("offset"))
+      return offset.getValue().getZExtValue();
+  return {};
+}
+
+/// Collect the clock and passthrough functions of each model, in the order in
+/// which LowerClocksToFuncs is going to extract them. The names are filled in
+/// by `collectFunctionNames` once the functions exist.
+static LogicalResult collectClocks(ModuleOp module,
+                                   MutableArrayRef<JITModel> models) {
+  unsigned modelIndex = 0;
+  for (auto modelOp : module.getOps<arc::ModelOp>()) {
+    auto &model = models[modelIndex++];
+    auto result = modelOp.walk([&](Operation *op) {
+      if (isa<arc::PassThroughOp>(op)) {
+        model.functions.push_back({});
+        return WalkResult::advance();
+      }
+      auto treeOp = dyn_cast<arc::ClockTreeOp>(op);
+      if (!treeOp)
+        return WalkResult::advance();
+
+      // Clocks are primary inputs, since LowerState drops derived clocks.
+      auto offset = getClockOffset(treeOp.getClock());
+      if (!offset || llvm::none_of(model.info.states, [&](auto &state) {
+            return state.type == arc::StateInfo::Input &&
+                   state.offset == *offset;
+          })) {
+        treeOp.emitError("clock is not an allocated model input");
+        return WalkResult::interrupt();
+      }
+      model.functions.push_back({"", *offset});
+      return WalkResult::advance();
+    });
+    if (result.wasInterrupted())
+      return failure();
+  }
+  return success();
+}
+
+/// Fill in the names of the functions LowerClocksToFuncs extracted, based on
+/// the calls it left behind in each model.
+static LogicalResult collectFunctionNames(ModuleOp module,
+                                          MutableArrayRef<JITModel> models) {
+  unsigned modelIndex = 0;
+  for (auto modelOp : module.getOps<arc::ModelOp>()) {
+    auto &model = models[modelIndex++];
+    unsigned index = 0;
+    for (auto callOp : modelOp.getOps<func::CallOp>()) {
+      if (index == model.functions.size())
+        break;
+      model.functions[index++].name = callOp.getCallee().str();
+    }
+    if (index != model.functions.size())
+      return modelOp.emitError("unexpected clock functions in model");
+  }
+  return success();
+}
+
+/// Parse the stimulus file. The first line names the driven inputs, and each
+/// following line holds their values for one cycle. Values are decimal, or
+/// hexadecimal and binary with a `0x` and `0b` prefix. Everything after a `#`
+/// is ignored.
+static LogicalResult parseStimulus(StringRef buffer,
+                                   const arc::ModelInfo &model,
+                                   Stimulus &stimulus) {
+  SmallVector<StringRef> lines, tokens;
+  buffer.split(lines, '\n');
+  bool haveHeader = false;
+  for (size_t lineNo = 0, e = lines.size(); lineNo < e; ++lineNo) {
+    auto error = [&]() -> raw_ostream & {
+      return llvm::errs() << stimulusFile << ":" << lineNo + 1 << ": error: ";
+    };
+    tokens.clear();
+    SplitString(lines[lineNo].split('#').first, tokens);
+    if (tokens.empty())
+      continue;
+
+    if (!haveHeader) {
+      for (auto token : tokens) {
+        auto it = llvm::find_if(model.states, [&](auto &state) {
+          return state.type == arc::StateInfo::Input && state.name == token;
+        });
+        if (it == model.states.end()) {
+          error() << "unknown input `" << token << "`\n";
+          return failure();
+        }
+        stimulus.inputs.push_back(&*it);
+      }
+      haveHeader = true;
+      continue;
+    }
+
+    if (tokens.size() != stimulus.inputs.size()) {
+      error() << "expected " << stimulus.inputs.size() << " values\n";
+      return failure();
+    }
+    auto &values = stimulus.lines.emplace_back();
+    for (auto [token, input] : llvm::zip(tokens, stimulus.inputs)) {
+      APInt value;
+      if (token.getAsInteger(0, value)) {
+        error() << "invalid value `" << token << "`\n";
+        return failure();
+      }
+      if (value.getActiveBits() > input->numBits) {
+        error() << "value `" << token << "` does not fit input `"
+                << input->name << "`\n";
+        return failure();
+      }
+      values.push_back(value.zextOrTrunc(input->numBits));
+    }
+  }
+  return success();
+}
+
+/// Lower the models to LLVM, JIT-compile them and simulate the given model with
+/// the stimulus provided on the command line.
+static LogicalResult runModel(ModuleOp module, TimingScope &ts,
+                              raw_ostream &os) {
+  SmallVector<arc::ModelInfo> infos;
+  if (failed(arc::collectModels(module, infos)))
+    return failure();
+  if (infos.size() != 1) {
+    llvm::errs() << "error: --run requires exactly one model, found "
+                 << infos.size() << "\n";
+    return failure();
+  }
+  SmallVector<JITModel, 1> models(infos.begin(), infos.end());
+  auto &model = models.front();
+
+  // Extract the clock functions and lower everything to LLVM.
+  if (failed(collectClocks(module, models)))
+    return failure();
+  {
+    PassManager pm(module.getContext());
+    pm.enableVerifier(verifyPasses);
+    pm.enableTiming(ts);
+    pm.addPass(arc::createLowerClocksToFuncsPass());
+    if (failed(pm.run(module)))
+      return failure();
+  }
+  if (failed(collectFunctionNames(module, models)))
+    return failure();
+  {
+    PassManager pm(module.getContext());
+    pm.enableVerifier(verifyPasses);
+    pm.enableTiming(ts);
+    populateLLVMLowering(pm);
+    if (failed(pm.run(module)))
+      return failure();
+  }
+
+  // JIT-compile the model.
+  std::unique_ptr<ExecutionEngine> engine;
+  std::unique_ptr<CachingJIT> cachingJIT;
+  auto lookup = [&](StringRef name) -> Expected<void *> {
+    if (cachingJIT)
+      return cachingJIT->lookup(name);
+    return engine->lookup(name);
+  };
+  {
+    auto jitTimer = ts.nest("JIT compilation");
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    if (!jitCacheDir.empty()) {
+      auto maybeJIT = CachingJIT::create(module, jitCacheDir,
+                                         std::max(1U, jitCachePartitions));
+      if (!maybeJIT) {
+        llvm::errs() << "error: failed to JIT-compile the model: "
+                     << toString(maybeJIT.takeError()) << "\n";
+        return failure();
+      }
+      cachingJIT = std::move(*maybeJIT);
+      llvm::errs() << "Reused " << cachingJIT->numCachedPartitions << " of "
+                   << cachingJIT->numPartitions
+                   << " model partitions from the JIT cache\n";
+    } else {
+      ExecutionEngineOptions options;
+      options.transformer = makeOptimizingTransformer(
+          /*optLevel=*/3, /*sizeLevel=*/0, /*targetMachine=*/nullptr);
+      auto maybeEngine = ExecutionEngine::create(module, options);
+      if (!maybeEngine) {
+        llvm::errs() << "error: failed to JIT-compile the model: "
+                     << toString(maybeEngine.takeError()) << "\n";
+        return failure();
+      }
+      engine = std::move(*maybeEngine);
+    }
+    for (auto &function : model.functions) {
+      auto addr = lookup(function.name);
+      if (!addr) {
+        llvm::errs() << "error: failed to look up `" << function.name
+                     << "`: " << toString(addr.takeError()) << "\n";
+        return failure();
+      }
+      function.fn = reinterpret_cast<void (*)(void *)>(*addr);
+    }
+  }
+
+  // Read the stimulus.
+  Stimulus stimulus;
+  if (!stimulusFile.empty()) {
+    std::string errorMessage;
+    auto buffer = openInputFile(stimulusFile, &errorMessage);
+    if (!buffer) {
+      llvm::errs() << errorMessage << "\n";
+      return failure();
+    }
+    if (failed(parseStimulus(buffer->getBuffer(), model.info, stimulus)))
+      return failure();
+  }
+  uint64_t cycles = numCycles ? numCycles : stimulus.lines.size();
+
+  // Group the clock functions by their clock.
+  SmallVector<ClockGroup> clockGroups;
+  for (auto &function : model.functions) {
+    if (!function.clockOffset)
+      continue;
+    auto it = llvm::find_if(clockGroups, [&](auto &group) {
+      return group.clockOffset == *function.clockOffset;
+    });
+    if (it == clockGroups.end())
+      it = &clockGroups.emplace_back(ClockGroup{*function.clockOffset, {}});
+    it->functions.push_back(function.fn);
+  }
+
+  // Clocks not driven by the stimulus rise once per cycle.
+  SmallVector<unsigned> freeClocks;
+  for (auto &group : clockGroups)
+    if (llvm::none_of(stimulus.inputs, [&](auto *input) {
+          return input->offset == group.clockOffset;
+        }))
+      freeClocks.push_back(group.clockOffset);
+
+  std::optional<TaskPool> taskPool;
+  if (numThreads > 1)
+    taskPool.emplace(numThreads);
+
+  std::vector<uint8_t> storage(model.info.numStateBytes, 0);
+  auto *state = storage.data();
+  auto callPassthrough = [&] {
+    for (auto &function : model.functions)
+      if (!function.clockOffset)
+        function.fn(state);
+  };
+
+  std::unique_ptr<llvm::ToolOutputFile> vcdOutput;
+  std::optional<VCDWriter> vcd;
+  if (!vcdFile.empty()) {
+    std::string errorMessage;
+    vcdOutput = openOutputFile(vcdFile, &errorMessage);
+    if (!vcdOutput) {
+      llvm::errs() << errorMessage << "\n";
+      return failure();
+    }
+    vcd.emplace(vcdOutput->os(), model.info, state);
+  }
+
+  SmallVector<const arc::StateInfo *> outputs;
+  for (auto &info : model.info.states)
+    if (info.type == arc::StateInfo::Output)
+      outputs.push_back(&info);
+
+  auto simTimer = ts.nest("Simulation");
+  auto startTime = std::chrono::steady_clock::now();
+  SmallVector<uint8_t> oldClocks(clockGroups.size());
+  for (uint64_t cycle = 0; cycle < cycles; ++cycle) {
+    for (auto [group, oldClock] : llvm::zip(clockGroups, oldClocks))
+      oldClock = state[group.clockOffset] & 1;
+
+    // Apply the inputs of the cycle. The last stimulus line stays in effect
+    // for any additional cycles.
+    if (!stimulus.lines.empty()) {
+      auto &values = stimulus.lines[std::min<uint64_t>(
+          cycle, stimulus.lines.size() - 1)];
+      for (auto [input, value] : llvm::zip(stimulus.inputs, values))
+        StoreIntToMemory(value, state + input->offset,
+                         (input->numBits + 7) / 8);
+    }
+    for (auto offset : freeClocks)
+      state[offset] = 1;
+
+    // Run the clock functions on a rising edge of their clock, and update the
+    // passthrough logic.
+    for (auto [group, oldClock] : llvm::zip(clockGroups, oldClocks)) {
+      if (oldClock || !(state[group.clockOffset] & 1))
+        continue;
+      if (taskPool && group.functions.size() > 1) {
+        taskPool->run(group.functions, state);
+        continue;
+      }
+      for (auto *fn : group.functions)
+        fn(state);
+    }
+    callPassthrough();
+
+    if (vcd)
+      vcd->writeTimestep(2 * cycle);
+    if (outputFormat != OutputDisabled) {
+      os << "cycle " << cycle << ":";
+      for (auto *output : outputs) {
+        APInt value(output->numBits, 0);
+        LoadIntFromMemory(value, state + output->offset,
+                          (output->numBits + 7) / 8);
+        os << " " << output->name << "=0x"
+           << StringRef(toString(value, 16, /*Signed=*/false)).lower();
+      }
+      os << "\n";
+    }
+
+    // Lower the free-running clocks for the next cycle.
+    if (!freeClocks.empty()) {
+      for (auto offset : freeClocks)
+        state[offset] = 0;
+      callPassthrough();
+      if (vcd)
+        vcd->writeTimestep(2 * cycle + 1);
+    }
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - startTime;
+
+  if (vcdOutput)
+    vcdOutput->keep();
+  llvm::errs() << "Simulated " << cycles << " cycles in "
+               << llvm::format("%.6f", elapsed.count()) << " s ("
+               << llvm::format("%.0f", cycles / elapsed.count())
+               << " cycles/s)\n";
+
+  // Sum up the activity counters of all tracked clusters.
+  if (activityTracking && activityStats) {
+    uint64_t checks = 0, skips = 0;
+    for (auto &info : model.info.states) {
+      if (info.name != "activity/checks" && info.name != "activity/skips")
+        continue;
+      uint64_t count;
+      std::memcpy(&count, state + info.offset, sizeof(count));
+      (info.name == "activity/checks" ? checks : skips) += count;
+    }
+    llvm::errs() << "Skipped " << skips << " of " << checks
+                 << " evaluations of activity-tracked logic ("
+                 << llvm::format("%.1f", checks ? 100.0 * skips / checks : 0.0)
+                 << "%)\n";
+  }
+
+  if (profile) {
+    auto addr = lookup(model.info.name + "_profile");
+    if (!addr) {
+      // Models without any functions have nothing to profile.
+      consumeError(addr.takeError());
+      return success();
+    }
+    // Share the report with the C++ models through the runtime header.
+    std::vector<ProfileCounter> counters;
+    for (auto &info : model.info.profile) {
+      auto kind = info.kind == arc::ProfileInfo::Clock ? ProfileCounter::Clock
+                  : info.kind == arc::ProfileInfo::Passthrough
+                      ? ProfileCounter::Passthrough
+                      : ProfileCounter::Arc;
+      counters.push_back({kind, info.name.c_str(), info.function});
+    }
+    std::ostringstream report;
+    writeProfileReport(report, model.info.name.c_str(), counters.data(),
+                       counters.size(),
+                       reinterpret_cast<const uint64_t *>(*addr));
+    llvm::errs() << report.str();
+  }
+  return success();
 }
 
 static LogicalResult processBuffer(
@@ -279,12 +1070,16 @@ static LogicalResult processBuffer(
     return failure();
   populatePipeline(pm);
 
-  if (printDebugInfo && outputFormat == OutputLLVM)
+  if (printDebugInfo && outputFormat == OutputLLVM && !runJIT)
     pm.nest<LLVM::LLVMFuncOp>().addPass(LLVM::createDIScopeForLLVMFuncOpPass());
 
   if (failed(pm.run(module.get())))
     return failure();
 
+  // Simulate the model in-process.
+  if (runJIT)
+    return runModel(module.get(), ts, outputFile.value()->os());
+
   // Handle MLIR output.
   if (runUntilBefore != UntilEnd || runUntilAfter != UntilEnd ||
       outputFormat == OutputMLIR) {
@@ -350,6 +1145,15 @@ processInput(MLIRContext &context, TimingScope &ts,
 }
 
 static LogicalResult executeArcilator(MLIRContext &context) {
+  if (runJIT && (runUntilBefore != UntilEnd || runUntilAfter != UntilEnd)) {
+    llvm::errs() << "error: --run requires the entire pipeline to run\n";
+    return failure();
+  }
+  if (runJIT && numLanes > 1) {
+    llvm::errs() << "error: --run does not support multiple lanes\n";
+    return failure();
+  }
+
   // Create the timing manager we use to sample execution times.
   DefaultTimingManager tm;
   applyDefaultTimingManagerCLOptions(tm);
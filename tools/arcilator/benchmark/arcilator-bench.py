@@ -0,0 +1,315 @@
+#!/usr/bin/env python3
+# Measures the simulation throughput of arcilator models.
+#
+# The script generates a set of synthetic designs that stress different parts
+# of the arcilator pipeline, compiles each of them to a native model with
+# `arcilator --run`, and reports the simulated cycles per second, the time it
+# takes to build the model, and the size of the model state. The designs drive
+# themselves through internal LFSRs, which start out in a non-zero state without
+# a reset, so no stimulus is needed, and all clocks rise once per cycle.
+#
+# Results can be written to a JSON file with `--json`, and compared against an
+# earlier such file with `--baseline`.
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+from dataclasses import asdict, dataclass, field
+from typing import *
+
+# Passes whose run time is reported for every design, as printed by
+# `--mlir-timing`.
+TIMED_PASSES = [
+    "ConvertToArcs", "Dedup", "InlineArcs", "LowerState", "SplitLoops",
+    "AllocateState", "LowerArcToLLVM", "JIT compilation"
+]
+
+
+class Builder:
+  """Accumulates the body of an `hw.module` with unique value names."""
+
+  def __init__(self):
+    self.lines = []
+    self.next_id = 0
+
+  def value(self, prefix: str = "v") -> str:
+    self.next_id += 1
+    return f"%{prefix}{self.next_id}"
+
+  def op(self, text: str, prefix: str = "v") -> str:
+    name = self.value(prefix)
+    self.lines.append(f"  {name} = {text}")
+    return name
+
+  def const(self, value: int, width: int) -> str:
+    return self.op(f"hw.constant {value} : i{width}", "c")
+
+  def extract(self, x: str, width: int, low: int, num: int) -> str:
+    return self.op(f"comb.extract {x} from {low} : (i{width}) -> i{num}")
+
+  def concat(self, parts: List[Tuple[str, int]]) -> str:
+    values = ", ".join(p for p, _ in parts)
+    types = ", ".join(f"i{w}" for _, w in parts)
+    return self.op(f"comb.concat {values} : {types}")
+
+  def rotate(self, x: str, width: int, amount: int) -> str:
+    hi = self.extract(x, width, 0, width - amount)
+    lo = self.extract(x, width, width - amount, amount)
+    return self.concat([(hi, width - amount), (lo, amount)])
+
+  def lfsr(self, clock: str, width: int = 64) -> str:
+    """A Galois LFSR as a self-driving source of changing values.
+
+    The register holds the LFSR state XORed with a non-zero seed, such that the
+    all-zero state models start out with is a seeded LFSR state and no reset is
+    needed.
+    """
+    reg = self.value("lfsr")
+    seed = self.const(1, width)
+    state = self.op(f"comb.xor {reg}, {seed} : i{width}")
+    one = self.const(1, width)
+    taps = self.const(0xd800000000000000 & ((1 << width) - 1) or 0x9, width)
+    shifted = self.op(f"comb.shru {state}, {one} : i{width}")
+    bit = self.extract(state, width, 0, 1)
+    mask = self.op(f"comb.replicate {bit} : (i1) -> i{width}")
+    feedback = self.op(f"comb.and {mask}, {taps} : i{width}")
+    next = self.op(f"comb.xor {shifted}, {feedback}, {seed} : i{width}")
+    self.lines.append(f"  {reg} = seq.compreg {next}, {clock} : i{width}")
+    return state
+
+  def module(self, name: str, ports: str, outputs: List[Tuple[str,
+                                                               int]]) -> str:
+    results = ", ".join(f"out{i}: i{w}" for i, (_, w) in enumerate(outputs))
+    values = ", ".join(v for v, _ in outputs)
+    types = ", ".join(f"i{w}" for _, w in outputs)
+    body = "\n".join(self.lines)
+    return (f"hw.module @{name}({ports}) -> ({results}) {{\n{body}\n"
+            f"  hw.output {values} : {types}\n}}\n")
+
+
+def wide_datapath(width: int = 1024, regs: int = 16) -> str:
+  """Independent registers with wide arithmetic on every cycle."""
+  b = Builder()
+  seed = b.lfsr("%clock")
+  seed = b.concat([(seed, 64)] * (width // 64))
+  outputs = []
+  for i in range(regs):
+    reg = b.value("r")
+    rot = b.rotate(reg, width, 7 + i)
+    sum = b.op(f"comb.add {reg}, {rot}, {seed} : i{width}")
+    three = b.const(3 + i, width)
+    shifted = b.op(f"comb.shru {reg}, {three} : i{width}")
+    next = b.op(f"comb.xor {sum}, {shifted} : i{width}")
+    b.lines.append(f"  {reg} = seq.compreg {next}, %clock : i{width}")
+    outputs.append((b.extract(reg, width, width - 64, 64), 64))
+  return b.module("WideDatapath", "%clock: i1", outputs)
+
+
+def deep_pipeline(depth: int = 512, width: int = 32) -> str:
+  """A long chain of registered arithmetic stages."""
+  b = Builder()
+  stage = b.extract(b.lfsr("%clock"), 64, 0, width)
+  for i in range(depth):
+    factor = b.const((0x9e3779b1 + 2 * i) & ((1 << width) - 1), width)
+    five = b.const(5, width)
+    product = b.op(f"comb.mul {stage}, {factor} : i{width}")
+    shifted = b.op(f"comb.shru {stage}, {five} : i{width}")
+    mixed = b.op(f"comb.xor {product}, {shifted} : i{width}")
+    stage = b.op(f"seq.compreg {mixed}, %clock : i{width}", "s")
+  return b.module("DeepPipeline", "%clock: i1", [(stage, width)])
+
+
+def large_memory(addr_bits: int = 20, width: int = 64) -> str:
+  """A large memory with a random-access read and write port."""
+  depth = 1 << addr_bits
+  b = Builder()
+  rand = b.lfsr("%clock")
+  raddr = b.extract(rand, 64, 0, addr_bits)
+  waddr = b.extract(rand, 64, 32, addr_bits)
+  true = b.const(1, 1)
+  acc = b.value("acc")
+  data = b.op(f'hw.instance "mem" @Memory(R0_addr: {raddr}: i{addr_bits}, '
+              f'R0_en: {true}: i1, R0_clk: %clock: i1, '
+              f'W0_addr: {waddr}: i{addr_bits}, W0_en: {true}: i1, '
+              f'W0_clk: %clock: i1, W0_data: {acc}: i{width}) -> '
+              f'(R0_data: i{width})')
+  mixed = b.op(f"comb.add {acc}, {data}, {rand} : i{width}")
+  b.lines.append(f"  {acc} = seq.compreg {mixed}, %clock : i{width}")
+  top = b.module("LargeMemory", "%clock: i1", [(acc, width)])
+  schema = ('hw.generator.schema @FIRRTLMem, "FIRRTL_Memory", ["depth", '
+            '"numReadPorts", "numWritePorts", "numReadWritePorts", '
+            '"readLatency", "writeLatency", "width", "maskGran", '
+            '"readUnderWrite", "writeUnderWrite", "writeClockIDs"]\n')
+  memory = (f"hw.module.generated @Memory, @FIRRTLMem("
+            f"%R0_addr: i{addr_bits}, %R0_en: i1, %R0_clk: i1, "
+            f"%W0_addr: i{addr_bits}, %W0_en: i1, %W0_clk: i1, "
+            f"%W0_data: i{width}) -> (R0_data: i{width}) attributes {{"
+            f"depth = {depth} : i64, maskGran = {width} : ui32, "
+            f"numReadPorts = 1 : ui32, numReadWritePorts = 0 : ui32, "
+            f"numWritePorts = 1 : ui32, readLatency = 1 : ui32, "
+            f"readUnderWrite = 0 : ui32, width = {width} : ui32, "
+            f"writeClockIDs = [], writeLatency = 1 : ui32, "
+            f"writeUnderWrite = 1 : i32}}\n")
+  return schema + memory + top
+
+
+def many_clocks(domains: int = 64, regs: int = 8) -> str:
+  """Many clock domains with a few counters each."""
+  b = Builder()
+  clocks = [f"%clock{i}" for i in range(domains)]
+  outputs = []
+  for clock in clocks:
+    rand = b.extract(b.lfsr(clock), 64, 0, 32)
+    for i in range(regs):
+      reg = b.value("r")
+      step = b.const(2 * i + 1, 32)
+      sum = b.op(f"comb.add {reg}, {step}, {rand} : i32")
+      b.lines.append(f"  {reg} = seq.compreg {sum}, {clock} : i32")
+      rand = reg
+    outputs.append((rand, 32))
+  ports = ", ".join(f"{c}: i1" for c in clocks)
+  return b.module("ManyClocks", ports, outputs)
+
+
+DESIGNS: Dict[str, Callable[[], str]] = {
+    "wide-datapath": wide_datapath,
+    "deep-pipeline": deep_pipeline,
+    "large-memory": large_memory,
+    "many-clocks": many_clocks,
+}
+
+
+@dataclass
+class Result:
+  design: str
+  cycles: int
+  cycles_per_second: float = 0.0
+  build_seconds: float = 0.0
+  state_bytes: int = 0
+  pass_seconds: Dict[str, float] = field(default_factory=dict)
+
+
+def run_arcilator(args, cmd: List[str]) -> subprocess.CompletedProcess:
+  cmd = [args.arcilator] + args.arcilator_args + cmd
+  proc = subprocess.run(cmd, capture_output=True, text=True)
+  if proc.returncode != 0:
+    sys.stderr.write(proc.stderr)
+    raise RuntimeError(f"`{' '.join(cmd)}` failed")
+  return proc
+
+
+def parse_timing(text: str) -> Dict[str, float]:
+  """Extract the wall time of each entry of an `--mlir-timing` list report."""
+  times = dict()
+  for line in text.splitlines():
+    match = re.match(r"^\s*([0-9.]+)\s+\(\s*[0-9.]+%\)\s+(.+?)\s*$", line)
+    if match:
+      name = match.group(2)
+      times[name] = times.get(name, 0.0) + float(match.group(1))
+  return times
+
+
+def benchmark(args, name: str) -> Result:
+  path = os.path.join(args.work_dir, f"{name}.mlir")
+  with open(path, "w") as f:
+    f.write(DESIGNS[name]())
+  state_file = os.path.join(args.work_dir, f"{name}.json")
+  result = Result(name, args.cycles)
+
+  # Build the model without simulating it, which includes the JIT compilation
+  # to native code.
+  start = time.perf_counter()
+  proc = run_arcilator(args, [
+      path, "--run", "--cycles=0", "--disable-output",
+      f"--state-file={state_file}", "--mlir-timing",
+      "--mlir-timing-display=list"
+  ])
+  result.build_seconds = time.perf_counter() - start
+  timing = parse_timing(proc.stderr)
+  result.pass_seconds = {p: timing[p] for p in TIMED_PASSES if p in timing}
+  with open(state_file) as f:
+    result.state_bytes = sum(m["numStateBytes"] for m in json.load(f))
+
+  # Simulate the model, keeping the fastest of the repetitions.
+  for _ in range(args.repeat):
+    proc = run_arcilator(
+        args, [path, "--run", f"--cycles={args.cycles}", "--disable-output"])
+    match = re.search(r"\(([0-9.]+) cycles/s\)", proc.stderr)
+    if not match:
+      raise RuntimeError(f"no throughput reported for `{name}`")
+    result.cycles_per_second = max(result.cycles_per_second,
+                                   float(match.group(1)))
+  return result
+
+
+def format_change(value: float, baseline: Optional[float],
+                  higher_is_better: bool) -> str:
+  if not baseline:
+    return ""
+  change = 100.0 * (value - baseline) / baseline
+  worse = change < 0 if higher_is_better else change > 0
+  return f" ({change:+.1f}%{'!' if worse and abs(change) >= 5 else ''})"
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description="Measure the simulation throughput of arcilator models")
+  parser.add_argument("--arcilator",
+                      default="arcilator",
+                      help="arcilator binary to benchmark")
+  parser.add_argument("--work-dir",
+                      default="arcilator-bench",
+                      help="directory for the generated designs")
+  parser.add_argument("--cycles",
+                      type=int,
+                      default=100000,
+                      help="number of cycles to simulate per design")
+  parser.add_argument("--repeat",
+                      type=int,
+                      default=3,
+                      help="simulations per design; the fastest is reported")
+  parser.add_argument("--design",
+                      action="append",
+                      choices=sorted(DESIGNS),
+                      help="design to benchmark (defaults to all)")
+  parser.add_argument("--json", help="write the results to this file")
+  parser.add_argument("--baseline",
+                      help="compare against results written with --json")
+  parser.add_argument("arcilator_args",
+                      nargs="*",
+                      help="additional arguments passed to arcilator")
+  args = parser.parse_args()
+  os.makedirs(args.work_dir, exist_ok=True)
+
+  baseline = dict()
+  if args.baseline:
+    with open(args.baseline) as f:
+      baseline = {r["design"]: r for r in json.load(f)}
+
+  results = []
+  print(f"{'design':<16} {'cycles/s':>18} {'build s':>16} {'state bytes':>12}")
+  for name in args.design or DESIGNS:
+    result = benchmark(args, name)
+    results.append(result)
+    base = baseline.get(name, {})
+    throughput = f"{result.cycles_per_second:.0f}" + format_change(
+        result.cycles_per_second, base.get("cycles_per_second"), True)
+    build = f"{result.build_seconds:.3f}" + format_change(
+        result.build_seconds, base.get("build_seconds"), False)
+    print(f"{name:<16} {throughput:>18} {build:>16} {result.state_bytes:>12}")
+    for pass_name, seconds in result.pass_seconds.items():
+      change = format_change(seconds,
+                             base.get("pass_seconds", {}).get(pass_name),
+                             False)
+      print(f"  {pass_name:<22} {seconds:.4f} s{change}")
+
+  if args.json:
+    with open(args.json, "w") as f:
+      json.dump([asdict(r) for r in results], f, indent=2)
+
+
+if __name__ == "__main__":
+  main()
@@ -14,6 +14,7 @@
 #include "circt/Dialect/Comb/CombDialect.h"
 #include "circt/Dialect/HW/HWDialect.h"
 #include "circt/Dialect/LLHD/IR/LLHDDialect.h"
+#include "circt/Dialect/LLHD/Simulator/BinaryTrace.h"
 #include "circt/Dialect/LLHD/Simulator/Engine.h"
 #include "circt/Dialect/LLHD/Simulator/Trace.h"
 #include "circt/Support/Version.h"
@@ -29,8 +30,10 @@
 #include "mlir/Target/LLVMIR/Export.h"
 #include "mlir/Transforms/Passes.h"
 
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/SHA256.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/ToolOutputFile.h"
 
@@ -77,6 +80,18 @@ static cl::opt<bool> dumpLayout("dump-layout",
                                 cl::desc("Dump the gathered instance layout"),
                                 cl::cat(mainCategory));
 
+static cl::opt<bool>
+    printStats("sim-stats",
+               cl::desc("Print the number of process wakeups and suppressed "
+                        "wakeups after simulation"),
+               cl::cat(mainCategory));
+
+static cl::opt<unsigned> numThreads(
+    "threads",
+    cl::desc("Number of threads evaluating the units woken up in the same "
+             "delta cycle"),
+    cl::value_desc("N"), cl::init(1), cl::cat(mainCategory));
+
 static cl::opt<std::string> root(
     "root",
     cl::desc("Specify the name of the entity to use as root of the design"),
@@ -113,9 +128,41 @@ static cl::opt<TraceMode> traceMode(
             TraceMode::NamedOnly, "named-only",
             "Only dump changes for real-time steps, only for top-level "
             "instance and signals not having the default name '(sig)?[0-9]*'"),
+        clEnumValN(TraceMode::Binary, "binary",
+                   "Dump signal changes for every time step and sub-step in "
+                   "a compact binary format, see -trace-to-vcd"),
         clEnumValN(TraceMode::None, "none", "Don't dump a signal trace")),
     cl::cat(mainCategory));
 
+static cl::opt<bool> traceToVCD(
+    "trace-to-vcd",
+    cl::desc("Convert the binary trace given as input to VCD instead of "
+             "running a simulation"),
+    cl::cat(mainCategory));
+
+static cl::opt<std::string> emitModel(
+    "emit-model",
+    cl::desc("Compile the design to an object file that can be simulated "
+             "with -load-model, without running a simulation"),
+    cl::value_desc("filename"), cl::cat(mainCategory));
+
+static cl::opt<std::string> loadModel(
+    "load-model",
+    cl::desc("Simulate the design with the model precompiled by -emit-model "
+             "instead of JIT-compiling it"),
+    cl::value_desc("filename"), cl::cat(mainCategory));
+
+static cl::opt<std::string> checkpoint(
+    "checkpoint",
+    cl::desc("Write a checkpoint of the simulation state to the given file "
+             "when the simulation stops, e.g. because of -T or -n"),
+    cl::value_desc("filename"), cl::cat(mainCategory));
+
+static cl::opt<std::string> restore(
+    "restore",
+    cl::desc("Resume the simulation from a checkpoint written by -checkpoint"),
+    cl::value_desc("filename"), cl::cat(mainCategory));
+
 static cl::list<std::string>
     sharedLibs("shared-libs",
                cl::desc("Libraries to link dynamically. Specify absolute path "
@@ -151,6 +198,19 @@ static int dumpLLVM(ModuleOp module, MLIRContext &context) {
   return 0;
 }
 
+/// Compute a hash identifying the simulated design, to check that a
+/// precompiled model matches it. Besides the design, it covers everything else
+/// that affects the compiled model, such as the version of the runtime
+/// interface it was compiled against.
+static std::string getDesignHash(StringRef input) {
+  llvm::SHA256 hasher;
+  hasher.update(getCirctVersion());
+  hasher.update(static_cast<uint8_t>(optimizationLevel.getValue()));
+  hasher.update(input);
+  hasher.update(root);
+  return llvm::toHex(hasher.final());
+}
+
 static LogicalResult applyMLIRPasses(ModuleOp module) {
   PassManager pm(module.getContext());
 
@@ -185,6 +245,20 @@ int main(int argc, char **argv) {
     exit(1);
   }
 
+  if (traceToVCD) {
+    if (auto err = convertBinaryTraceToVCD(file->getBuffer(), output->os())) {
+      llvm::errs() << toString(std::move(err)) << "\n";
+      return 1;
+    }
+    output->keep();
+    return 0;
+  }
+
+  ModelOptions modelOptions;
+  modelOptions.designHash = getDesignHash(file->getBuffer());
+  modelOptions.emitModelFile = emitModel;
+  modelOptions.modelFile = loadModel;
+
   // Parse the input file.
   SourceMgr mgr;
   mgr.AddNewSourceBuffer(std::move(file), SMLoc());
@@ -211,7 +285,10 @@ int main(int argc, char **argv) {
   llhd::sim::Engine engine(
       output->os(), *module, &applyMLIRPasses,
       makeOptimizingTransformer(optimizationLevel, 0, nullptr), root, traceMode,
-      sharedLibPaths);
+      sharedLibPaths, numThreads, modelOptions);
+
+  if (!emitModel.empty())
+    return 0;
 
   if (dumpLLVMDialect || dumpLLVMIR) {
     return dumpLLVM(engine.getModule(), context);
@@ -223,7 +300,22 @@ int main(int argc, char **argv) {
     return 0;
   }
 
-  engine.simulate(nSteps, maxTime);
+  if (!restore.empty())
+    engine.setRestoreFile(restore);
+
+  if (engine.simulate(nSteps, maxTime) != 0)
+    return 1;
+
+  if (!checkpoint.empty()) {
+    if (auto err = engine.writeCheckpoint(checkpoint)) {
+      llvm::errs() << "Failed to write the checkpoint: "
+                   << toString(std::move(err)) << "\n";
+      return 1;
+    }
+  }
+
+  if (printStats)
+    engine.dumpStatistics();
 
   output->keep();
   return 0;